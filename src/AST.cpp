@@ -568,12 +568,14 @@ struct Parser_State {
 
 	size_t atom() noexcept {
 		if (type_is(Token::Type::Open_Paran)) {
-			i++;
-
 			AST::Group_Expression x;
 			x.scope = current_scope;
 			x.depth = current_depth++;
+			x.loc.line = tokens[i].line;
+			x.loc.offset = tokens[i].lexeme.i;
 			defer { current_depth--; };
+			i++;
+
 			x.inner_idx = expression();
 			if (!x.inner_idx) return 0;
 			if (!type_is(Token::Type::Close_Paran)) return 0;
@@ -722,6 +724,8 @@ struct Parser_State {
 			AST::Group_Statement x;
 			x.scope = current_scope;
 			x.depth = current_depth++;
+			x.loc.line = tokens[i].line;
+			x.loc.offset = tokens[i].lexeme.i;
 			defer { current_depth = prev_depth; };
 			i++;
 
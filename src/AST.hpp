@@ -539,6 +539,73 @@ struct AST {
 };
 
 
+// Calls f(child_idx) on every direct child of nodes[idx], lists (arguments, statements, ...) are
+// followed through next_statement.
+template<typename F>
+void for_each_child(const std::vector<AST::Node>& nodes, size_t idx, F&& f) noexcept {
+	auto list = [&] (size_t i) { for (; i; i = nodes[i]->next_statement) f(i); };
+	auto one  = [&] (size_t i) { if (i) f(i); };
+
+	auto& node = nodes[idx];
+	switch (node.kind) {
+	case AST::Node::Argument_Kind:         one(node.Argument_.value_idx); break;
+	case AST::Node::Group_Expression_Kind: one(node.Group_Expression_.inner_idx); break;
+	case AST::Node::Group_Statement_Kind:  list(node.Group_Statement_.inner_idx); break;
+	case AST::Node::Return_Parameter_Kind: one(node.Return_Parameter_.type_identifier); break;
+	case AST::Node::Declaration_Kind:
+		one(node.Declaration_.type_expression_idx);
+		one(node.Declaration_.value_expression_idx);
+		break;
+	case AST::Node::Array_Access_Kind:
+		one(node.Array_Access_.identifier_array_idx);
+		one(node.Array_Access_.identifier_acess_idx);
+		break;
+	case AST::Node::Function_Call_Kind:
+		one(node.Function_Call_.identifier_idx);
+		list(node.Function_Call_.argument_list_idx);
+		break;
+	case AST::Node::Operation_List_Kind:
+		one(node.Operation_List_.left_idx);
+		list(node.Operation_List_.rest_idx);
+		break;
+	case AST::Node::Unary_Operation_Kind: one(node.Unary_Operation_.right_idx); break;
+	case AST::Node::Return_Call_Kind:     one(node.Return_Call_.return_value_idx); break;
+	case AST::Node::Type_Identifier_Kind:
+		if (node.Type_Identifier_.pointer_to) one(*node.Type_Identifier_.pointer_to);
+		if (node.Type_Identifier_.array_to)   one(*node.Type_Identifier_.array_to);
+		if (node.Type_Identifier_.array_size) one(*node.Type_Identifier_.array_size);
+		list(node.Type_Identifier_.parameter_type_list_idx);
+		list(node.Type_Identifier_.return_type_list_idx);
+		break;
+	case AST::Node::If_Kind:
+		one(node.If_.condition_idx);
+		one(node.If_.if_statement_idx);
+		one(node.If_.else_statement_idx);
+		break;
+	case AST::Node::For_Kind:
+		one(node.For_.init_statement_idx);
+		one(node.For_.cond_statement_idx);
+		one(node.For_.next_statement_idx);
+		one(node.For_.loop_statement_idx);
+		break;
+	case AST::Node::While_Kind:
+		one(node.While_.cond_statement_idx);
+		list(node.While_.loop_statement_idx);
+		break;
+	case AST::Node::Struct_Definition_Kind: list(node.Struct_Definition_.struct_line_idx); break;
+	case AST::Node::Initializer_List_Kind:
+		if (node.Initializer_List_.type_identifier) one(*node.Initializer_List_.type_identifier);
+		list(node.Initializer_List_.expression_list_idx);
+		break;
+	case AST::Node::Function_Definition_Kind:
+		list(node.Function_Definition_.parameter_list_idx);
+		list(node.Function_Definition_.return_list_idx);
+		list(node.Function_Definition_.statement_list_idx);
+		break;
+	default: break;
+	}
+}
+
 extern AST parse(
 	const std::vector<Token>& tokens, std::string_view file
 ) noexcept;
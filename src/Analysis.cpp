@@ -0,0 +1,115 @@
+#include "Analysis.hpp"
+
+#include "xstd.hpp"
+
+struct Purity_State {
+	const std::vector<AST::Node>& nodes;
+	std::string_view file;
+
+	// Names the body can call: its proc parameters and the pure procs it declares.
+	std::vector<std::string_view> callable;
+	bool pure = true;
+
+	Purity_State(const std::vector<AST::Node>& nodes, std::string_view file) noexcept
+		: nodes(nodes), file(file) {}
+};
+
+static bool is_value_type(
+	const std::vector<AST::Node>& nodes, size_t idx, std::string_view file
+) noexcept {
+	if (!idx || !nodes[idx].typecheck(AST::Node::Type_Identifier_Kind)) return false;
+	auto& type = nodes[idx].Type_Identifier_;
+
+	if (type.is_proc) return true;
+	if (type.pointer_to || type.array_to) return false;
+
+	auto name = string_view_from_view(file, type.identifier.lexeme);
+	return
+		name == "real" || name == "int" || name == "nat" || name == "byte" || name == "bool";
+}
+
+static bool is_pure_builtin(std::string_view name) noexcept {
+	return name == "int" || name == "len";
+}
+
+static void check_purity(Purity_State& state, size_t idx) noexcept {
+	if (!state.pure) return;
+
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx];
+	switch (node.kind) {
+	// A proc that is only declared doesn't do anything, we look at it when it's declared under a
+	// name and then only calls matter.
+	case AST::Node::Function_Definition_Kind:
+	case AST::Node::Struct_Definition_Kind:
+		return;
+	case AST::Node::Declaration_Kind: {
+		auto& decl = node.Declaration_;
+		auto value = decl.value_expression_idx;
+		if (value && nodes[value].typecheck(AST::Node::Function_Definition_Kind)) {
+			if (is_pure_function(nodes, value, state.file))
+				state.callable.push_back(string_view_from_view(state.file, decl.identifier.lexeme));
+			return;
+		}
+		break;
+	}
+	case AST::Node::Operation_List_Kind: {
+		auto& op = node.Operation_List_;
+		bool to_local = nodes[op.left_idx].typecheck(AST::Node::Identifier_Kind);
+		if (op.op == AST::Operator::Assign && !to_local) {
+			state.pure = false;
+			return;
+		}
+		break;
+	}
+	case AST::Node::Function_Call_Kind: {
+		auto& call = node.Function_Call_;
+		if (!nodes[call.identifier_idx].typecheck(AST::Node::Identifier_Kind)) {
+			state.pure = false;
+			return;
+		}
+
+		auto name = string_view_from_view(
+			state.file, nodes[call.identifier_idx].Identifier_.token.lexeme
+		);
+		bool callable = is_pure_builtin(name);
+		for (auto& x : state.callable) callable |= x == name;
+		if (!callable) {
+			state.pure = false;
+			return;
+		}
+		break;
+	}
+	default: break;
+	}
+
+	for_each_child(nodes, idx, [&] (size_t child) { check_purity(state, child); });
+}
+
+bool is_pure_function(
+	const std::vector<AST::Node>& nodes, size_t idx, std::string_view file
+) noexcept {
+	if (!nodes[idx].typecheck(AST::Node::Function_Definition_Kind)) return false;
+	auto& node = nodes[idx].Function_Definition_;
+
+	// Nothing to remember from a proc that doesn't return anything.
+	if (node.is_method || !node.return_list_idx) return false;
+
+	Purity_State state(nodes, file);
+
+	for (size_t i = node.parameter_list_idx; i; i = nodes[i]->next_statement) {
+		auto& param = nodes[i].Declaration_;
+		if (!is_value_type(nodes, param.type_expression_idx, file)) return false;
+
+		if (nodes[param.type_expression_idx].Type_Identifier_.is_proc)
+			state.callable.push_back(string_view_from_view(file, param.identifier.lexeme));
+	}
+
+	for (size_t i = node.return_list_idx; i; i = nodes[i]->next_statement)
+		if (!is_value_type(nodes, nodes[i].Return_Parameter_.type_identifier, file)) return false;
+
+	for (size_t i = node.statement_list_idx; i; i = nodes[i]->next_statement)
+		check_purity(state, i);
+
+	return state.pure;
+}
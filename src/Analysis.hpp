@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+
+#include "AST.hpp"
+
+// A proc is pure when two calls with the same arguments always give the same result and have no
+// other effect, which is what makes it safe to memoize. We ask that:
+// - it's not a method, those read their struct through the implicit parent,
+// - every parameter and return is a plain value (real, int, nat, byte, bool) or a proc,
+// - it doesn't print or sleep, and never writes through a pointer, a member or an array,
+// - every proc it calls is either a pure builtin, a pure proc declared in its body or one of its
+//   proc parameters. For the last one, only the caller knows what is passed, so it has to check
+//   that the proc arguments are pure too before using a memoized result.
+// There is nothing to say about captured state, proc bodies can't see the enclosing scopes.
+extern bool is_pure_function(
+	const std::vector<AST::Node>& nodes, size_t idx, std::string_view file
+) noexcept;
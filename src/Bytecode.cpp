@@ -1,20 +1,67 @@
 #include "Bytecode.hpp"
+#include "Analysis.hpp"
+#include "Typer.hpp"
 #include "xstd.hpp"
 
+#include <cmath>
 #include <thread>
+#include <algorithm>
 
 #define decl(name) size_t name(\
 const std::vector<AST::Node>& nodes, size_t idx, Program& program, std::string_view file\
 ) noexcept
 
+// How far the instruction can take the operand stack over where it was before it runs.
+static size_t stack_growth(const IS::Instruction& x) noexcept {
+	constexpr size_t L = sizeof(IS::Real);
+	switch (x.kind) {
+	case IS::Instruction::Constant_Kind:   return x.Constant_.n;
+	case IS::Instruction::Push_Kind:       return x.Push_.n;
+	case IS::Instruction::Stack_Load_Kind: return x.Stack_Load_.n;
+	case IS::Instruction::Load_At_Kind:    return x.Load_At_.n > 8 ? x.Load_At_.n - 8 : 0;
+	case IS::Instruction::CI2R_Kind:       return L > 8 ? L - 8 : 0;
+	case IS::Instruction::Load_Rsp_Kind:   return 8;
+	case IS::Instruction::True_Kind:
+	case IS::Instruction::False_Kind:
+		return L;
+	default: return 0;
+	}
+}
+
+// The code being compiled goes up to extra bytes over the stack it has now, see IS::Enter.
+static void note_stack(Program& program, size_t extra = 0) noexcept {
+	size_t used = 0;
+	if (program.stack_ptr > program.current_stack_base)
+		used = program.stack_ptr - program.current_stack_base;
+	program.max_stack = std::max(program.max_stack, used + extra);
+}
+
+// Where the bytes of the frame the instruction reads or writes end.
+static size_t frame_end(const IS::Instruction& x) noexcept {
+	switch (x.kind) {
+	case IS::Instruction::Stack_Load_Kind:  return x.Stack_Load_.memory_ptr + x.Stack_Load_.n;
+	case IS::Instruction::Save_Kind:        return x.Save_.memory_ptr + x.Save_.n;
+	case IS::Instruction::Memo_Lookup_Kind: return 2 * (size_t)x.Memo_Lookup_.n;
+	default: return 0;
+	}
+}
+
 void emit(Program& program, IS::Instruction x, AST::Source_Code_Loc loc) {
+	// What's on the stack once x ran is either consumed by a later instruction or what x pushed.
+	note_stack(program, stack_growth(x));
+	program.max_frame = std::max({ program.max_frame, program.memory_stack_ptr, frame_end(x) });
+
 	auto* f = &program.code;
-	if (program.current_function_idx) f = &program.functions[program.current_function_idx - 1];
-	// program.annotations[f->size()] = std::string("LOC: ") + std::to_string(loc.line);
+	auto* l = &program.locs;
+	if (program.current_function_idx) {
+		f = &program.functions[program.current_function_idx - 1];
+		l = &program.function_locs[program.current_function_idx - 1];
+	}
 	f->push_back(x);
+	l->push_back(loc);
 }
 
-size_t alloc_constant(Program& prog, long double constant) noexcept {
+size_t alloc_constant(Program& prog, IS::Real constant) noexcept {
 	prog.data.resize(prog.data.size() + sizeof(constant));
 	memcpy(prog.data.data() + prog.data.size() - sizeof(constant), &constant, sizeof(constant));
 	return prog.data.size() - sizeof(constant);
@@ -28,6 +75,54 @@ size_t alloc_constant(Program& prog, const char* data, size_t n) noexcept {
 	return alloc_constant(prog, (const std::uint8_t*)data, n);
 }
 
+static constexpr size_t Bool_Id = AST_Interpreter::Bool_Type::unique_id;
+static constexpr size_t Real_Id = AST_Interpreter::Real_Type::unique_id;
+static constexpr size_t Byte_Id = AST_Interpreter::Byte_Type::unique_id;
+static constexpr size_t Nat_Id  = AST_Interpreter::Nat_Type::unique_id;
+static constexpr size_t Int_Id  = AST_Interpreter::Int_Type::unique_id;
+
+static bool is_integer(size_t type_id) noexcept {
+	return type_id == Int_Id || type_id == Nat_Id || type_id == Byte_Id;
+}
+
+// Bytes a value of the type takes on the stack and in a frame. Bytes are ints there and bools a
+// real 0 or 1 like what comparisons give, so every number is a full slot the VM never has to
+// check the size of.
+static size_t value_size(Program& program, size_t type_id) noexcept {
+	if (is_integer(type_id))                      return sizeof(std::int64_t);
+	if (type_id == Real_Id || type_id == Bool_Id) return sizeof(IS::Real);
+	if (!type_id || !program.interpreter.types.count(type_id)) return 0;
+	return program.interpreter.types.at(type_id).get_size();
+}
+
+// Pointers are memory addresses, 8 bytes integers like nats.
+static bool is_pointer(Program& program, size_t type_id) noexcept {
+	return program.interpreter.types.at(type_id).kind == AST_Interpreter::Type::Pointer_Type_Kind;
+}
+
+static size_t type_of(const Program& program, size_t idx) noexcept {
+	return program.typed.types[idx];
+}
+
+// Converts the number on top of the stack to the type `to`. Anything that isn't a real, an int,
+// a nat or a byte is left as is.
+void convert(Program& program, size_t from, size_t to, AST::Source_Code_Loc loc) noexcept {
+	bool from_number = from == Real_Id || is_integer(from);
+	bool to_number   = to   == Real_Id || is_integer(to);
+	if (from == to || !from_number || !to_number) return;
+
+	// Integers are 8 bytes, a real might be more.
+	if (from == Real_Id) {
+		emit(program, IS::CR2I{ to == Nat_Id }, loc);
+		program.stack_ptr -= sizeof(IS::Real) - 8;
+	}
+	if (to == Real_Id) {
+		emit(program, IS::CI2R{ 0, from == Nat_Id }, loc);
+		program.stack_ptr += sizeof(IS::Real) - 8;
+	}
+	if (to   == Byte_Id) emit(program, IS::CI2B{}, loc);
+}
+
 
 decl(expression   );
 decl(identifier   );
@@ -45,6 +140,22 @@ decl(return_call  );
 decl(init_list    );
 decl(array_access );
 
+// Compiles the proc definition at idx in a new function.
+static void compile_proc(
+	const std::vector<AST::Node>& nodes, size_t idx, Program& program, std::string_view file
+) noexcept {
+	size_t f = program.functions.size();
+	size_t old_f = program.current_function_idx;
+	program.definition_functions[idx] = f;
+	program.functions.emplace_back();
+	program.function_locs.emplace_back();
+	program.pure_functions.push_back(false);
+	program.inline_infos.emplace_back();
+	program.current_function_idx = f + 1;
+	program.compile_function(nodes, idx, file);
+	program.current_function_idx = old_f;
+}
+
 decl(statement) {
 	size_t old_stack = program.stack_ptr;
 	auto ret = expression(nodes, idx, program, file);
@@ -81,83 +192,253 @@ decl(expression) {
 	return ret;
 }
 
+static bool is_const_declaration(const std::vector<AST::Node>& nodes, size_t idx) noexcept {
+	size_t type = nodes[idx].Declaration_.type_expression_idx;
+	return
+		type && nodes[type].typecheck(AST::Node::Type_Identifier_Kind) &&
+		nodes[type].Type_Identifier_.is_const;
+}
+
+static bool is_value_type(size_t type_id) noexcept {
+	return type_id == Real_Id || type_id == Bool_Id || is_integer(type_id);
+}
+
+// Whether the expression only depends on litterals, consts with a known value and calls of
+// pure procs, with numbers and bools everywhere. Names it reads are bound in bindings, to their
+// value or, for a proc, to what the interpreter needs to call it.
+using Bindings = std::vector<std::pair<std::string_view, AST_Interpreter::Value>>;
+static bool is_constant(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Program& program,
+	std::string_view file,
+	Bindings& bindings
+) noexcept {
+	auto& node = nodes[idx];
+	if (!is_value_type(type_of(program, idx))) return false;
+
+	switch (node.kind) {
+	case AST::Node::Litteral_Kind: {
+		auto type = node.Litteral_.token.type;
+		return
+			type == Token::Type::Number || type == Token::Type::True || type == Token::Type::False;
+	}
+	case AST::Node::Identifier_Kind: {
+		auto it = program.constant_values.find(program.typed.constants[idx]);
+		if (it == std::end(program.constant_values)) return false;
+		bindings.emplace_back(
+			string_view_from_view(file, node.Identifier_.token.lexeme), it->second.value
+		);
+		return true;
+	}
+	case AST::Node::Group_Expression_Kind:
+		return is_constant(nodes, node.Group_Expression_.inner_idx, program, file, bindings);
+	case AST::Node::Unary_Operation_Kind: {
+		auto& op = node.Unary_Operation_;
+		if (op.op != AST::Operator::Minus && op.op != AST::Operator::Not) return false;
+		return is_constant(nodes, op.right_idx, program, file, bindings);
+	}
+	case AST::Node::Operation_List_Kind: {
+		auto& op = node.Operation_List_;
+		switch (op.op) {
+		case AST::Operator::Plus: case AST::Operator::Minus: case AST::Operator::Star:
+		case AST::Operator::Div:  case AST::Operator::Mod:   case AST::Operator::Eq:
+		case AST::Operator::Neq:  case AST::Operator::Lt:    case AST::Operator::Leq:
+		case AST::Operator::Gt:
+			break;
+		default: return false;
+		}
+		return
+			is_constant(nodes, op.left_idx, program, file, bindings) &&
+			is_constant(nodes, op.rest_idx, program, file, bindings);
+	}
+	case AST::Node::Function_Call_Kind: {
+		auto& call = node.Function_Call_;
+		auto& callee = nodes[call.identifier_idx];
+		if (!callee.typecheck(AST::Node::Identifier_Kind)) return false;
+
+		size_t n = 0;
+		for (size_t i = call.argument_list_idx; i; i = nodes[i]->next_statement, ++n)
+			if (!is_constant(nodes, nodes[i].Argument_.value_idx, program, file, bindings))
+				return false;
+
+		auto name = string_view_from_view(file, callee.Identifier_.token.lexeme);
+		if (name == "int") return n == 1;
+
+		// The proc can't be another one at run time, and only its arguments are in its fence.
+		if (!program.typed.procs[call.identifier_idx]) return false;
+		auto& type = program.interpreter.types.at(type_of(program, call.identifier_idx));
+		if (!type.typecheck(AST_Interpreter::Type::User_Function_Type_Kind)) return false;
+
+		auto& f = type.User_Function_Type_;
+		if (!f.is_pure || f.parameter_type.size() != n || f.return_type.size() != 1) return false;
+		for (auto x : f.parameter_type) if (!is_value_type(x)) return false;
+
+		AST_Interpreter::Identifier proc;
+		proc.type_descriptor_id = f.unique_id;
+		bindings.emplace_back(name, proc);
+		return true;
+	}
+	default: return false;
+	}
+}
+
+// The value of a constant expression of the type, None when it couldn't be worked out. It runs
+// in a fence of its own with a fresh memo: what it gives only depends on the expression, not on
+// what was evaluated before nor on which thread compiles it.
+static AST_Interpreter::Value evaluate(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Program& program,
+	std::string_view file,
+	const Bindings& bindings,
+	size_t type
+) noexcept {
+	using Value = AST_Interpreter::Value;
+	auto& interpreter = program.interpreter;
+
+	size_t old_memory = interpreter.memory.size();
+	Memo_Cache memo(Program::Evaluation_Memo_Cap);
+	std::swap(memo, interpreter.memo);
+	interpreter.push_scope();
+	interpreter.scopes.back().fence = true;
+	interpreter.steps_left = Program::Evaluation_Steps;
+	interpreter.quiet = true;
+	interpreter.failed = false;
+	defer {
+		interpreter.pop_scope();
+		std::swap(memo, interpreter.memo);
+		interpreter.memory.resize(old_memory);
+		interpreter.steps_left = SIZE_MAX;
+		interpreter.quiet = false;
+		interpreter.failed = false;
+	};
+
+	for (auto& [name, x] : bindings) {
+		if (x.typecheck(Value::Identifier_Kind)) interpreter.new_variable(name, x);
+		else                                     interpreter.new_variable(name, interpreter.create_id(x));
+	}
+
+	auto v = interpreter.interpret(nodes, idx, file);
+	if (interpreter.failed) return nullptr;
+	if (v.typecheck(Value::Identifier_Kind)) v = interpreter.at(v.Identifier_);
+
+	if (type == Bool_Id) return v.typecheck(Value::Bool_Kind) ? v : nullptr;
+	if (!v.typecheck(Value::Real_Kind) && !v.typecheck(Value::Int_Kind)) return nullptr;
+	return interpreter.convert(v, type);
+}
+
+// Where the value is put in data, as the VM has it on the stack.
+static IS::Constant alloc_value(
+	Program& program, const AST_Interpreter::Value& v, size_t type
+) noexcept {
+	using Value = AST_Interpreter::Value;
+	if (is_integer(type)) {
+		std::int64_t x = v.Int_.x;
+		return { alloc_constant(program, (const std::uint8_t*)&x, sizeof(x)), sizeof(x) };
+	}
+	IS::Real x = v.typecheck(Value::Bool_Kind) ? (IS::Real)v.Bool_.x : (IS::Real)v.Real_.x;
+	return { alloc_constant(program, x), sizeof(x) };
+}
+
+// Emits the value of the expression as a constant if it's worked out at compile time.
+static bool emit_constant(
+	const std::vector<AST::Node>& nodes, size_t idx, Program& program, std::string_view file
+) noexcept {
+	Bindings bindings;
+	if (!is_constant(nodes, idx, program, file, bindings)) return false;
+
+	size_t type = type_of(program, idx);
+	auto v = evaluate(nodes, idx, program, file, bindings, type);
+	if (v.typecheck(AST_Interpreter::Value::None_Kind)) return false;
+
+	auto at = alloc_value(program, v, type);
+	emit(program, at, nodes[idx]->loc);
+	program.stack_ptr += at.n;
+	return true;
+}
+
 
 decl(identifier) {
 	auto& node = nodes[idx].Identifier_;
-	auto id = program.interpreter.lookup(string_view_from_view(file, node.token.lexeme));
 
-	auto& type = program.interpreter.types.at(id.Identifier_.type_descriptor_id);
-	emit(program, IS::Stack_Load({ id.Identifier_.memory_idx, type.get_size() }), node.loc);
+	auto constant = program.constant_values.find(program.typed.constants[idx]);
+	if (constant != std::end(program.constant_values)) {
+		emit(program, constant->second.at, node.loc);
+		program.stack_ptr += constant->second.at.n;
+		return type_of(program, idx);
+	}
 
-	program.stack_ptr += type.get_size();
+	auto id = program.interpreter.lookup(string_view_from_view(file, node.token.lexeme));
 
-	return type.get_unique_id();
+	size_t type = type_of(program, idx);
+	size_t size = value_size(program, type);
+	emit(program, IS::Stack_Load({ id.Identifier_.memory_idx, size }), node.loc);
+	program.stack_ptr += size;
+
+	return type;
 }
 decl(declaration) {
 	auto& node = nodes[idx].Declaration_;
-	size_t last_ptr = program.memory_stack_ptr;
-
 	auto name = string_view_from_view(file, node.identifier.lexeme);
-
-	size_t type_hint = 0;
-	size_t type_hint_size = 0;
+	auto value = node.value_expression_idx;
 
 	AST_Interpreter::Identifier id;
 	id.memory_idx = program.memory_stack_ptr;
-	
-	if (node.type_expression_idx) {
-		auto t = program.interpreter.type_interpret(nodes, node.type_expression_idx, file);
-		type_hint = t.get_unique_id();
-		type_hint_size = t.get_size();
-		emit(program, IS::Alloc{ type_hint_size }, node.loc);
-		program.memory_stack_ptr += type_hint_size;
-	}
 
+	if (value && nodes[value].typecheck(AST::Node::Function_Definition_Kind)) {
+		auto t = program.interpreter.type_interpret(nodes, value, file);
+		id.type_descriptor_id = t.User_Function_Type_.unique_id;
 
-	if (node.value_expression_idx) {
-		// >Type
+		// The top level procs are already compiled, see compile_top_level_procs.
+		auto compiled = program.definition_functions.find(value);
+		size_t f = compiled != std::end(program.definition_functions) ?
+			compiled->second : program.functions.size();
 
-		type_hint = expression(nodes, node.value_expression_idx, program, file);
-		if (!type_hint) { // if expression return false that means that we are dealing with
-		                  // a type definition like vec2 := struct { x := 0; y := 0; };
+		program.memory_stack_ptr += t.get_size();
+		emit(program, IS::Constantf{ f }, node.loc);
+		emit(program, IS::Save({ id.memory_idx, t.get_size() }), node.loc);
+		program.interpreter.new_variable(name, id);
 
-			auto t = program.interpreter.type_interpret(nodes, node.value_expression_idx, file);
-			type_hint = t.get_unique_id();
-			type_hint_size = t.get_size();
-
-			if (t.typecheck(AST_Interpreter::Type::User_Function_Type_Kind)) {
-				id.memory_idx = program.memory_stack_ptr;
-				id.type_descriptor_id = t.User_Function_Type_.unique_id;
-
-				emit(program, IS::Alloc{ t.get_size() }, node.loc);
-				program.memory_stack_ptr += t.get_size();
-				emit(program, IS::Constantf{ program.functions.size() }, node.loc);
-				emit(program, IS::Save({ id.memory_idx, t.get_size() }), node.loc);
-				program.interpreter.new_variable(name, id);
-
-				size_t old_f = program.current_function_idx;
-				program.functions.emplace_back();
-				program.current_function_idx = program.functions.size();
-				program.compile_function(nodes, node.value_expression_idx, file);
-				program.current_function_idx = old_f;
-			}
-			if (t.kind == AST_Interpreter::Type::User_Struct_Type_Kind) {
-				program.interpreter.type_name_to_hash[name] = t.User_Struct_Type_.unique_id;
-			}
+		if (compiled == std::end(program.definition_functions))
+			compile_proc(nodes, value, program, file);
+		return 0;
+	}
+	if (value && nodes[value].typecheck(AST::Node::Struct_Definition_Kind)) {
+		auto t = program.interpreter.type_interpret(nodes, value, file);
+		program.interpreter.type_name_to_hash[name] = t.User_Struct_Type_.unique_id;
+		return 0;
+	}
 
+	// The type checker already infered the type of the variable when it isn't explicit.
+	id.type_descriptor_id = type_of(program, idx);
+	size_t size = value_size(program, id.type_descriptor_id);
+
+	// A const known at compile time is only a constant in data, see identifier.
+	Bindings bindings;
+	if (
+		value && is_const_declaration(nodes, idx) && is_value_type(id.type_descriptor_id) &&
+		is_constant(nodes, value, program, file, bindings)
+	) {
+		auto v = evaluate(nodes, value, program, file, bindings, id.type_descriptor_id);
+		if (!v.typecheck(AST_Interpreter::Value::None_Kind)) {
+			auto at = alloc_value(program, v, id.type_descriptor_id);
+			program.constant_values[idx] = { v, at };
+			program.interpreter.new_variable(name, id);
 			return 0;
 		}
+	}
 
-		if (!node.type_expression_idx) {
-			type_hint_size = program.interpreter.types.at(type_hint).get_size();
-			emit(program, IS::Alloc{ type_hint_size }, node.loc);
-			program.memory_stack_ptr += type_hint_size;
-		}
-		id.type_descriptor_id = type_hint;
+	program.memory_stack_ptr += size;
+
+	if (value) {
+		convert(program, expression(nodes, value, program, file), id.type_descriptor_id, node.loc);
+		emit(program, IS::Save({ id.memory_idx, size }), node.loc);
+		program.stack_ptr -= size;
+	} else if (program.current_function_idx) {
+		program.inline_infos[program.current_function_idx - 1].uninitialized = true;
 	}
 
-	emit(program, IS::Save({ id.memory_idx, type_hint_size }), node.loc);
-	program.stack_ptr -= type_hint_size;
 	program.interpreter.new_variable(name, id);
 	return 0;
 }
@@ -166,108 +447,135 @@ decl(litteral) {
 	auto view = node.token.lexeme;
 
 	if (node.token.type == Token::Type::Number) {
-		static std::string temp;
+		thread_local std::string temp;
 		temp.clear();
 		temp.resize(view.size);
 		memcpy(temp.data(), file.data() + view.i, view.size);
+		std::int64_t i = 0;
+		if (type_of(program, idx) == Int_Id && AST_Interpreter::parse_integer(temp, i)) {
+			emit(
+				program,
+				IS::Constant{ alloc_constant(program, (const std::uint8_t*)&i, sizeof(i)), 8 },
+				node.loc
+			);
+			program.stack_ptr += sizeof(i);
+			return Int_Id;
+		}
+
 		char* end_ptr = nullptr;
-		long double x = std::strtold(temp.c_str(), &end_ptr);
+		IS::Real x = (IS::Real)std::strtold(temp.c_str(), &end_ptr);
 
-		emit(program, IS::Constant{ alloc_constant(program, x), 8 }, node.loc);
+		emit(program, IS::Constant{ alloc_constant(program, x), sizeof(x) }, node.loc);
 		program.stack_ptr += sizeof(x);
-		return AST_Interpreter::Real_Type::unique_id;
+		return Real_Id;
 	}
 	if (node.token.type == Token::Type::True) {
 		emit(program, IS::True{}, node.loc);
-		program.stack_ptr += sizeof(long double);
-		return AST_Interpreter::Bool_Type::unique_id;
+		program.stack_ptr += sizeof(IS::Real);
+		return Bool_Id;
 	}
 	if (node.token.type == Token::Type::False) {
 		emit(program, IS::False{}, node.loc);
-		program.stack_ptr += sizeof(long double);
-		return AST_Interpreter::Bool_Type::unique_id;
+		program.stack_ptr += sizeof(IS::Real);
+		return Bool_Id;
 	}
 	if (node.token.type == Token::Type::String) {
 		thread_local std::vector<std::uint8_t> temp_data;
-		temp_data.resize(view.size - 2 + 8);
-		*((long double*)temp_data.data()) = view.size - 2;
-		memcpy(temp_data.data() + 8, file.data() + view.i + 1, view.size - 2);
+		// The length comes first, as a real.
+		IS::Real length = view.size - 2;
+		temp_data.resize(sizeof(length) + view.size - 2);
+		memcpy(temp_data.data(), &length, sizeof(length));
+		memcpy(temp_data.data() + sizeof(length), file.data() + view.i + 1, view.size - 2);
 		emit(program, IS::Constant({
 			alloc_constant(program, temp_data.data(), temp_data.size()), temp_data.size()
 		}), node.loc);
 		program.stack_ptr += temp_data.size();
-		return program.interpreter.create_array_type(
-			AST_Interpreter::Byte_Type::unique_id,
-			temp_data.size()
-		).get_unique_id();
+		return type_of(program, idx);
 	}
 
 	return 0;
 }
 decl(list_op) {
 	auto& node = nodes[idx].Operation_List_;
+	size_t type = type_of(program, idx);
 
 	if (node.op == AST::Operator::Assign) {
-		size_t before_stack = program.stack_ptr;
-		expression(nodes, node.rest_idx, program, file);
+		size_t right_type = expression(nodes, node.rest_idx, program, file);
 
 		auto& ident = nodes[node.left_idx].Identifier_;
 		auto id = program.interpreter.lookup(string_view_from_view(file, ident.token.lexeme));
-		emit(
-			program,
-			IS::Save({ id.Identifier_.memory_idx, program.stack_ptr - before_stack }),
-			node.loc
-		);
-		program.stack_ptr = before_stack;
+		convert(program, right_type, type, node.loc);
+
+		size_t size = value_size(program, type);
+		emit(program, IS::Save({ id.Identifier_.memory_idx, size }), node.loc);
+		program.stack_ptr -= size;
 
 		// assignement returns the value of the assignee so we evaluate it at the end.
 		return expression(nodes, node.left_idx, program, file);
 	}
 	if (node.op == AST::Operator::As) {
-		size_t left_type_id = expression(nodes, node.left_idx, program, file);
-		auto rest_type  = program.interpreter.type_interpret(nodes, node.rest_idx, file);
-		auto& left_type = program.interpreter.types.at(left_type_id);
-		if (
-			program.interpreter.types.at(left_type_id).kind ==
-			AST_Interpreter::Type::Pointer_Type_Kind
-		) {
-			return rest_type.get_unique_id();
-		}
+		convert(program, expression(nodes, node.left_idx, program, file), type, node.loc);
+		return type;
+	}
 
-		if (
-			left_type.kind == AST_Interpreter::Type::Byte_Type_Kind &&
-			rest_type.kind == AST_Interpreter::Type::Real_Type_Kind
-		) {
-			emit(program, IS::CB2R{}, node.loc);
-			program.stack_ptr += 7;
+	// >TODO(Tackwin): handle a (op) b (op) c. For now we handle only a (op) b
+	// Both sides are converted to the operand type the type checker picked: int or nat when both
+	// are integers, real otherwise. The left one is promoted under the right one, that keeps the
+	// two loads next to each other for the peephole pass.
+	size_t operand = program.typed.operand_types[idx];
+	size_t before_stack = program.stack_ptr;
+	size_t left_type = expression(nodes, node.left_idx, program, file);
+	convert(program, expression(nodes, node.rest_idx, program, file), operand, node.loc);
+	if (is_integer(left_type) && operand == Real_Id)
+		emit(program, IS::CI2R{ sizeof(IS::Real), left_type == Nat_Id }, node.loc);
+
+	if (is_integer(operand)) {
+		bool is_nat = operand == Nat_Id;
+		switch (node.op) {
+		case AST::Operator::Plus:  emit(program, IS::Add_I{}, node.loc); break;
+		case AST::Operator::Minus: emit(program, IS::Sub_I{}, node.loc); break;
+		case AST::Operator::Star:  emit(program, IS::Mul_I{}, node.loc); break;
+		case AST::Operator::Eq:    emit(program, IS::Eq_I{}, node.loc); break;
+		case AST::Operator::Neq:   emit(program, IS::Neq_I{}, node.loc); break;
+		case AST::Operator::Lt:
+			emit(program, is_nat ? IS::Instruction(IS::Lt_U{}) : IS::Lt_I{}, node.loc);
+			break;
+		case AST::Operator::Leq:
+			emit(program, is_nat ? IS::Instruction(IS::Leq_U{}) : IS::Leq_I{}, node.loc);
+			break;
+		case AST::Operator::Gt:
+			emit(program, is_nat ? IS::Instruction(IS::Gt_U{}) : IS::Gt_I{}, node.loc);
+			break;
+		case AST::Operator::Mod:
+			emit(program, is_nat ? IS::Instruction(IS::Mod_U{}) : IS::Mod_I{}, node.loc);
+			break;
+		case AST::Operator::Div:
+			emit(program, is_nat ? IS::Instruction(IS::Div_U{}) : IS::Div_I{}, node.loc);
+			break;
+		default: assert("Not supported"); break;
+		}
+	} else {
+		switch (node.op) {
+		case AST::Operator::Plus:   emit(program, IS::Add{}, node.loc); break;
+		case AST::Operator::Minus:  emit(program, IS::Sub{}, node.loc); break;
+		case AST::Operator::Star:   emit(program, IS::Mul{}, node.loc); break;
+		case AST::Operator::Eq:     emit(program, IS::Eq{}, node.loc); break;
+		case AST::Operator::Neq:    emit(program, IS::Neq{}, node.loc); break;
+		case AST::Operator::Lt:     emit(program, IS::Lt{}, node.loc); break;
+		case AST::Operator::Leq:    emit(program, IS::Leq{}, node.loc); break;
+		case AST::Operator::Gt:     emit(program, IS::Gt{}, node.loc); break;
+		case AST::Operator::Mod:    emit(program, IS::Mod{}, node.loc); break;
+		case AST::Operator::Div:    emit(program, IS::Div{}, node.loc); break;
+		default: assert("Not supported"); break;
 		}
-
-		return rest_type.get_unique_id();
 	}
 
-	// >TODO(Tackwin): handle a (op) b (op) c. For now we handle only a (op) b
-	size_t left_type_id  = expression(nodes, node.left_idx, program, file);
-	size_t right_type_id = expression(nodes, node.rest_idx, program, file);
-
-	switch (node.op) {
-	case AST::Operator::Plus:   emit(program, IS::Add{}, node.loc); break;
-	case AST::Operator::Minus:  emit(program, IS::Sub{}, node.loc); break;
-	case AST::Operator::Star:   emit(program, IS::Mul{}, node.loc); break;
-	case AST::Operator::Eq:     emit(program, IS::Eq{}, node.loc); break;
-	case AST::Operator::Neq:    emit(program, IS::Neq{}, node.loc); break;
-	case AST::Operator::Lt:     emit(program, IS::Lt{}, node.loc); break;
-	case AST::Operator::Leq:    emit(program, IS::Leq{}, node.loc); break;
-	case AST::Operator::Gt:     emit(program, IS::Gt{}, node.loc); break;
-	case AST::Operator::Mod:    emit(program, IS::Mod{}, node.loc); break;
-	case AST::Operator::Div:    emit(program, IS::Div{}, node.loc); break;
-	default: assert("Not supported"); break;
-	}
-
-	program.stack_ptr -= sizeof(long double);
-	return left_type_id;
+	program.stack_ptr = before_stack + value_size(program, type);
+	return type;
 }
 decl(unary_op) {
 	auto& node = nodes[idx].Unary_Operation_;
+	size_t type = type_of(program, idx);
 
 	size_t right_type = 0;
 	if (node.op != AST::Operator::Amp)
@@ -275,46 +583,47 @@ decl(unary_op) {
 
 	switch(node.op) {
 		case AST::Operator::Minus:
-			emit(program, IS::Neg{}, node.loc);
-			return AST_Interpreter::Real_Type::unique_id;
+			if (type == Int_Id) emit(program, IS::Neg_I{}, node.loc);
+			else                emit(program, IS::Neg{}, node.loc);
+			return type;
 		case AST::Operator::Not:
+			// Not works on reals, an integer is converted first.
+			convert(program, right_type, Real_Id, node.loc);
 			emit(program, IS::Not{}, node.loc);
-			return AST_Interpreter::Bool_Type::unique_id;
+			return type;
 		case AST::Operator::Inc: {
 			auto& ident = nodes[node.right_idx].Identifier_;
 			auto id = program.interpreter.lookup(string_view_from_view(file, ident.token.lexeme));
-			emit(program, IS::Inc{}, node.loc);
-			emit(program, IS::Save({ id.Identifier_.memory_idx, 8 }), node.loc);
-			program.stack_ptr -= 8;
-			return AST_Interpreter::Void_Type::unique_id;
+			if (is_integer(right_type)) emit(program, IS::Inc_I{}, node.loc);
+			else                        emit(program, IS::Inc{}, node.loc);
+			if (right_type == Byte_Id) convert(program, Int_Id, Byte_Id, node.loc);
+
+			size_t size = value_size(program, right_type);
+			emit(program, IS::Save({ id.Identifier_.memory_idx, size }), node.loc);
+			program.stack_ptr -= size;
+			return type;
 		}
 		case AST::Operator::Star: {
-			auto ptr_type = program.interpreter.types.at(right_type);
-			assert(ptr_type.kind == AST_Interpreter::Type::Pointer_Type_Kind);
-			auto under_type = program.interpreter.types.at(
-				ptr_type.Pointer_Type_.user_type_descriptor_idx
-			);
-
-			emit(program, IS::Load_At{ under_type.get_size() }, node.loc);
+			// A byte is one byte in memory, it's widened to an int as it's loaded.
+			if (type == Byte_Id) emit(program, IS::Load_At_Byte{}, node.loc);
+			else                 emit(program, IS::Load_At{ value_size(program, type) }, node.loc);
 			program.stack_ptr -= 8;
-			program.stack_ptr += under_type.get_size();
-			return under_type.get_unique_id();
+			program.stack_ptr += value_size(program, type);
+			return type;
 		}
 		case AST::Operator::Amp: {
-			assert(nodes[node.right_idx].kind == AST::Node::Identifier_Kind);
 			auto& ident = nodes[node.right_idx].Identifier_;
 			auto id = program.interpreter.lookup(string_view_from_view(file, ident.token.lexeme));
+			std::uint64_t offset = id.Identifier_.memory_idx;
 			emit(program, IS::Load_Rsp{}, node.loc);
 			emit(
 				program,
-				IS::Constant({ alloc_constant(program, id.Identifier_.memory_idx), 8 }),
+				IS::Constant({ alloc_constant(program, (const std::uint8_t*)&offset, 8), 8 }),
 				node.loc
 			);
-			emit(program, IS::Add{}, node.loc);
+			emit(program, IS::Add_I{}, node.loc);
 			program.stack_ptr += 8;
-			return program.interpreter.create_pointer_type(
-				id.Identifier_.type_descriptor_id
-			).get_unique_id();
+			return type;
 		}
 		default:
 			return 0;
@@ -349,20 +658,22 @@ decl(if_call) {
 	auto& node = nodes[idx].If_;
 
 	auto cond_type = expression(nodes, node.condition_idx, program, file);
-	program.stack_ptr -= 8;
+	convert(program, cond_type, Real_Id, node.loc);
+	program.stack_ptr -= sizeof(IS::Real);
 
 	size_t if_idx = program.get_current_function()->size();
 	emit(program, IS::If_Jmp_Rel({ 2 }), node.loc);
 	auto jmp_else = program.get_current_function()->size();
 	emit(program, IS::Jmp_Rel({ 0 }), node.loc);
-	emit(program, IS::Pop({ 8 }), node.loc);
+	emit(program, IS::Pop({ sizeof(IS::Real) }), node.loc);
 	statement(nodes, node.if_statement_idx, program, file);
 	auto jmp_out_idx = program.get_current_function()->size();
 	emit(program, IS::Jmp_Rel({ 0 }), node.loc);
-	emit(program, IS::Pop({ 8 }), node.loc);
 
+	// The else pops the condition too.
 	auto jmp_else_offset = program.get_current_function()->size() - jmp_else;
 	program.get_current_function()->at(jmp_else).Jmp_Rel_.dt_ip = jmp_else_offset;
+	emit(program, IS::Pop({ sizeof(IS::Real) }), node.loc);
 
 	statement(nodes, node.else_statement_idx, program, file);
 
@@ -384,13 +695,14 @@ decl(for_loop) {
 	statement(nodes, node.init_statement_idx, program, file);
 
 	size_t top_idx = program.get_current_function()->size();
-	expression(nodes, node.cond_statement_idx, program, file);
-	program.stack_ptr -= 8;
+	auto cond_type = expression(nodes, node.cond_statement_idx, program, file);
+	convert(program, cond_type, Real_Id, node.loc);
+	program.stack_ptr -= sizeof(IS::Real);
 	emit(program, IS::If_Jmp_Rel({ 3 }), node.loc);
-	emit(program, IS::Pop({ 8 }), node.loc);
+	emit(program, IS::Pop({ sizeof(IS::Real) }), node.loc);
 	size_t jmp_idx = program.get_current_function()->size();
 	emit(program, IS::Jmp_Rel({ 0 }), node.loc);
-	emit(program, IS::Pop({ 8 }), node.loc);
+	emit(program, IS::Pop({ sizeof(IS::Real) }), node.loc);
 
 	statement(nodes, node.loop_statement_idx, program, file);
 	statement(nodes, node.next_statement_idx, program, file);
@@ -406,87 +718,266 @@ decl(for_loop) {
 decl(while_loop) {
 	return 0;
 }
+// When tail is set the call is emitted as a Tail_Call_At if it can be, tail is then left set.
+static size_t call(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Program& program,
+	std::string_view file,
+	bool& tail
+) noexcept;
+
 decl(function_call) {
+	bool tail = false;
+	return call(nodes, idx, program, file, tail);
+}
+
+// The function a call through that identifier always calls, SIZE_MAX when it's a proc value only
+// known at run time. The identifier has to name a proc that is never reassigned.
+static size_t static_callee(const Program& program, size_t identifier_idx) noexcept {
+	auto it = program.definition_functions.find(program.typed.procs[identifier_idx]);
+	return it == std::end(program.definition_functions) ? SIZE_MAX : it->second;
+}
+
+// The function a call through that identifier is replaced with, SIZE_MAX when it's called. The
+// callee has to be known statically and its body mustn't call anything: it can't be recursive
+// and doesn't need its own frame.
+static size_t inline_candidate(const Program& program, size_t identifier_idx) noexcept {
+	if (!program.inline_budget) return SIZE_MAX;
+
+	size_t f = static_callee(program, identifier_idx);
+	if (f == SIZE_MAX) return SIZE_MAX;
+
+	auto& info = program.inline_infos[f];
+	if (!info.compiled || !info.balanced) return SIZE_MAX;
+
+	size_t size = 0;
+	for (auto& x : program.functions[f]) switch (x.kind) {
+	case IS::Instruction::Call_Kind:
+	case IS::Instruction::Call_At_Kind:
+	case IS::Instruction::Tail_Call_At_Kind:
+	case IS::Instruction::Tail_Call_Kind:
+	case IS::Instruction::Load_Rsp_Kind:
+		return SIZE_MAX;
+	case IS::Instruction::Memo_Lookup_Kind:
+	case IS::Instruction::Memo_Store_Kind:
+	case IS::Instruction::Enter_Kind:
+		break;
+	default:
+		size++;
+		break;
+	}
+	return size <= program.inline_budget ? f : SIZE_MAX;
+}
+
+// The n argument bytes are on the stack. The frame of f is laid out right after our variables
+// and its body copied with its memory offsets moved there, its returns jump past the end with the
+// returned value on the stack. The memo is dropped, looking it up would cost more than the body.
+static void inline_call(Program& program, size_t f, size_t n, AST::Source_Code_Loc loc) noexcept {
+	size_t base = program.memory_stack_ptr;
+	if (n) emit(program, IS::Save({ base, n }), loc);
+
+	// Those bytes held something else before, zeroed like Enter does when a local needs it.
+	size_t frame = program.functions[f].front().Enter_.frame;
+	if (program.inline_infos[f].uninitialized && frame > n) {
+		thread_local std::vector<std::uint8_t> zeros;
+		zeros.assign(frame - n, 0);
+		size_t ptr = alloc_constant(program, zeros.data(), zeros.size());
+		emit(program, IS::Constant{ ptr, zeros.size() }, loc);
+		emit(program, IS::Save({ base + n, zeros.size() }), loc);
+	}
+
+	// The body starts where the arguments were.
+	auto stack = program.inline_infos[f].stack;
+	if (stack > n) note_stack(program, stack - n);
+
+	// The body keeps its own locations.
+	auto& body = program.functions[f];
+	auto& body_locs = program.function_locs[f];
+	for (size_t i = 0; i < body.size(); ++i) {
+		auto x = body[i];
+		switch (x.kind) {
+		case IS::Instruction::Stack_Load_Kind:   x.Stack_Load_.memory_ptr += base; break;
+		case IS::Instruction::Save_Kind:         x.Save_.memory_ptr += base; break;
+		case IS::Instruction::Memo_Lookup_Kind:
+		case IS::Instruction::Memo_Store_Kind:
+		case IS::Instruction::Enter_Kind:
+			x = {};
+			break;
+		case IS::Instruction::Ret_Kind:
+			if (i + 1 == body.size()) x = {};
+			else                      x = IS::Jmp_Rel{ (int)(body.size() - i) };
+			break;
+		default: break;
+		}
+		emit(program, x, body_locs[i]);
+	}
+}
+
+static size_t call(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Program& program,
+	std::string_view file,
+	bool& tail
+) noexcept {
 	auto& node = nodes[idx].Function_Call_;
 
 	auto name = string_view_from_view(file, nodes[node.identifier_idx].Identifier_.token.lexeme);
 	if (name == "print") {
+		tail = false;
 		size_t arg_type_id = expression(
 			nodes, nodes[node.argument_list_idx].Argument_.value_idx, program, file
 		);
-		if (
-			program.interpreter.types.at(arg_type_id).get_unique_id() ==
-			AST_Interpreter::Byte_Type::unique_id
-		) {
+		if (arg_type_id == Byte_Id) {
 			emit(program, IS::Print_Byte{}, node.loc);
 			return 0;
+		} else if (arg_type_id == Int_Id) {
+			emit(program, IS::Print_Int{}, node.loc);
+			return 0;
+		} else if (arg_type_id == Nat_Id || is_pointer(program, arg_type_id)) {
+			emit(program, IS::Print_Nat{}, node.loc);
+			return 0;
 		} else {
 			emit(program, IS::Print{}, node.loc);
 			return 0;
 		}
 	}
 	if (name == "sleep") {
-		expression(
+		tail = false;
+		size_t arg_type_id = expression(
 			nodes, nodes[node.argument_list_idx].Argument_.value_idx, program, file
 		);
+		convert(program, arg_type_id, Real_Id, node.loc);
 		emit(program, IS::Sleep{}, node.loc);
 		return 0;
 	}
+	if (emit_constant(nodes, idx, program, file)) {
+		tail = false;
+		return type_of(program, idx);
+	}
 	if (name == "int") {
-		expression(
+		tail = false;
+		size_t arg_type_id = expression(
 			nodes, nodes[node.argument_list_idx].Argument_.value_idx, program, file
 		);
-		emit(program, IS::Int{}, node.loc);
-		return 0;
+		convert(program, arg_type_id, Int_Id, node.loc);
+		return Int_Id;
 	}
 
+	auto& type = program.interpreter.types.at(type_of(program, node.identifier_idx));
+
+	const std::vector<size_t>* parameter_types = nullptr;
+	const std::vector<size_t>* return_types = nullptr;
+	if (type.kind == AST_Interpreter::Type::User_Function_Type_Kind) {
+		parameter_types = &type.User_Function_Type_.parameter_type;
+		return_types    = &type.User_Function_Type_.return_type;
+	} else if (type.kind == AST_Interpreter::Type::Function_Signature_Kind) {
+		parameter_types = &type.Function_Signature_.parameter_types;
+		return_types    = &type.Function_Signature_.return_types;
+	}
 
-	auto id = program.interpreter.lookup(name);
-	auto& type = program.interpreter.types.at(id.Identifier_.type_descriptor_id);
+	// What the callee returns goes straight to our caller, it has to be what we return.
+	if (!return_types || return_types->size() != 1) tail = false;
+	else if (return_types->front() != program.current_return_type) tail = false;
 
 	size_t old_stack = program.stack_ptr;
-	for (size_t i = node.argument_list_idx; i; i = nodes[i]->next_statement) {
+	size_t arg_idx = 0;
+	for (size_t i = node.argument_list_idx; i; i = nodes[i]->next_statement, arg_idx++) {
 		auto& param = nodes[i].Argument_;
 		size_t arg_type = expression(nodes, param.value_idx, program, file);
+		if (parameter_types && arg_idx < parameter_types->size()) {
+			convert(program, arg_type, (*parameter_types)[arg_idx], node.loc);
+			arg_type = (*parameter_types)[arg_idx];
+		}
+
+		// The frame is gone once the tail call is made, a pointer could point into it.
+		auto& t = program.interpreter.types.at(arg_type);
+		if (t.kind == AST_Interpreter::Type::Pointer_Type_Kind) tail = false;
 	}
 
 	size_t bef_stack = program.stack_ptr;
-	expression(nodes, node.identifier_idx, program, file);
-	emit(program, IS::Call_At{bef_stack - old_stack}, node.loc);
+	size_t inlined = inline_candidate(program, node.identifier_idx);
+	size_t callee  = static_callee(program, node.identifier_idx);
+	if (inlined != SIZE_MAX) {
+		tail = false;
+		inline_call(program, inlined, bef_stack - old_stack, node.loc);
+	} else if (callee != SIZE_MAX) {
+		// Linked to the code address of the function, the proc variable isn't loaded.
+		if (tail) emit(program, IS::Tail_Call{ callee, bef_stack - old_stack }, node.loc);
+		else      emit(program, IS::Call{ callee, bef_stack - old_stack }, node.loc);
+	} else {
+		expression(nodes, node.identifier_idx, program, file);
+		if (tail) emit(program, IS::Tail_Call_At{bef_stack - old_stack}, node.loc);
+		else      emit(program, IS::Call_At{bef_stack - old_stack}, node.loc);
+	}
 	program.stack_ptr = old_stack;
 
-	if (type.kind == AST_Interpreter::Type::User_Function_Type_Kind) {
-		for (auto& x : type.User_Function_Type_.return_type) {
-			auto& ret_type = program.interpreter.types.at(x);
-			program.stack_ptr += ret_type.get_size();
-		}
-		if (type.User_Function_Type_.return_type.empty()) return 0;
-		// >TODO(Tackwin): >Return Handle multiple returns
-		return program.interpreter.types.at(
-			type.User_Function_Type_.return_type.front()
-		).get_unique_id();
-	} else if (type.kind == AST_Interpreter::Type::Function_Signature_Kind) {
-		for (auto& x : type.Function_Signature_.return_types) {
-			auto& ret_type = program.interpreter.types.at(x);
-			program.stack_ptr += ret_type.get_size();
-		}
-		if (type.Function_Signature_.return_types.empty()) return 0;
-		return program.interpreter.types.at(
-			type.Function_Signature_.return_types.front()
-		).get_unique_id();
-	}
-	return 0;
+	if (return_types) for (auto& x : *return_types) program.stack_ptr += value_size(program, x);
+	note_stack(program);
+	// >TODO(Tackwin): >Return Handle multiple returns
+	return type_of(program, idx);
+}
+// A return of the function being compiled, it has to leave only the returned value on the stack
+// for the function to be inlined.
+static void emit_return(Program& program, size_t to_return, AST::Source_Code_Loc loc) noexcept {
+	if (program.current_function_idx && program.stack_ptr != program.current_stack_base + to_return)
+		program.inline_infos[program.current_function_idx - 1].balanced = false;
+	emit(program, IS::Ret{ to_return }, loc);
 }
 decl(return_call) {
 	auto& node = nodes[idx].Return_Call_;
 
+	// return f(...) in a function reuses its frame for f, f's return is then our return. The
+	// memoized result of the current proc is not stored in that case.
+	auto value_idx = node.return_value_idx;
+	if (
+		program.current_function_idx &&
+		value_idx &&
+		!nodes[value_idx]->next_statement &&
+		nodes[value_idx].typecheck(AST::Node::Function_Call_Kind)
+	) {
+		bool tail = true;
+		size_t old_stack = program.stack_ptr;
+		size_t ret_type = call(nodes, value_idx, program, file, tail);
+		if (tail) {
+			program.stack_ptr = old_stack;
+			return 0;
+		}
+
+		if (ret_type && program.current_return_type) {
+			convert(program, ret_type, program.current_return_type, node.loc);
+			ret_type = program.current_return_type;
+		}
+		size_t to_return = value_size(program, ret_type);
+		if (program.current_memo) {
+			auto memo = *program.current_memo;
+			memo.ret_n = to_return;
+			emit(program, memo, node.loc);
+		}
+
+		emit_return(program, to_return, node.loc);
+		return 0;
+	}
+
 	size_t to_return = 0;
 	for (size_t i = node.return_value_idx; i; i = nodes[i]->next_statement) {
 		size_t ret_type = expression(nodes, i, program, file);
-		to_return += program.interpreter.types.at(ret_type).get_size();
+		// >TODO(Tackwin): >Return Handle multiple returns
+		if (i == node.return_value_idx && program.current_return_type) {
+			convert(program, ret_type, program.current_return_type, node.loc);
+			ret_type = program.current_return_type;
+		}
+		to_return += value_size(program, ret_type);
 	}
 
-	emit(program, IS::Ret{ to_return }, node.loc);
+	if (program.current_memo) {
+		auto memo = *program.current_memo;
+		memo.ret_n = to_return;
+		emit(program, memo, node.loc);
+	}
+
+	emit_return(program, to_return, node.loc);
 	return 0;
 }
 decl(init_list) {
@@ -496,32 +987,16 @@ decl(init_list) {
 	AST_Interpreter::Identifier new_id;
 	new_id.memory_idx = program.stack_ptr;
 
-	// If we have a type hint 'vec{0, 0}' we take that
-	if (node.type_identifier) {
-		auto type = program.interpreter.type_interpret(nodes, *node.type_identifier, file);
-
-		new_id.type_descriptor_id = type.get_unique_id();
-	} else {
-		// Else we try to deduce it
-		// >TODO(Tackwin): auto deduce type from context.
-		assert(false);
-	}
-
-	// We alloc enough size to hold the type that we got
-	size_t type_size = program.interpreter.types.at(new_id.type_descriptor_id).get_size();
-	emit(program, IS::Alloc{type_size}, node.loc);
+	// The type checker asks for a type hint 'vec{0, 0}'.
+	new_id.type_descriptor_id = type_of(program, idx);
 
 	size_t running_ptr = 0;
 
 	// we go through every expression in the init list and copy it to the allocated memory section
 	// right now we assume that every field is filled but we will change that letter. >TODO(Tackwin)
 	for (size_t i = node.expression_list_idx; i; i = nodes[i]->next_statement) {
-		auto& n = nodes[i];
-
 		size_t type_idx = expression(nodes, i, program, file);
-		size_t running_type_size = program.interpreter.types.at(type_idx).get_size();
-
-		running_ptr += running_type_size;
+		running_ptr += value_size(program, type_idx);
 	}
 	emit(program, IS::Save({ new_id.memory_idx, running_ptr }), node.loc);
 	program.stack_ptr -= running_ptr;
@@ -556,6 +1031,7 @@ void Program::compile_function(
 	defer{ interpreter.pop_scope(); };
 
 	size_t running = 0;
+	std::uint64_t proc_mask = 0;
 	for (size_t i = node.parameter_list_idx; i; i = nodes[i]->next_statement) {
 		auto& param = nodes[i].Declaration_;
 
@@ -563,62 +1039,484 @@ void Program::compile_function(
 
 		AST_Interpreter::Identifier id;
 		id.memory_idx = running;
-		id.type_descriptor_id =
-			interpreter.type_interpret(nodes, param.type_expression_idx, file).get_unique_id();
+		id.type_descriptor_id = typed.types[i];
 
-		running += interpreter.types.at(id.type_descriptor_id).get_size();
+		auto& type = interpreter.types.at(id.type_descriptor_id);
+		if (type.kind == AST_Interpreter::Type::Function_Signature_Kind && running < 64)
+			proc_mask |= 1ull << running;
+		running += value_size(*this, id.type_descriptor_id);
 
 		interpreter.new_variable(name, id);
 	}
 
 	memory_stack_ptr += running;
 
+	auto old_memo = current_memo;
+	auto old_return_type = current_return_type;
+	auto old_stack_base = current_stack_base;
+	auto old_max_stack = max_stack;
+	auto old_max_frame = max_frame;
+	defer {
+		current_memo = old_memo;
+		current_return_type = old_return_type;
+		current_stack_base = old_stack_base;
+		max_stack = old_max_stack;
+		max_frame = old_max_frame;
+	};
+	current_stack_base = stack_ptr;
+	max_stack = 0;
+	max_frame = 0;
+	current_memo.reset();
+	current_return_type = 0;
+	if (node.return_list_idx) {
+		auto& ret = nodes[node.return_list_idx].Return_Parameter_;
+		current_return_type =
+			interpreter.type_interpret(nodes, ret.type_identifier, file).get_unique_id();
+	}
+
+	// Filled once the body is compiled.
+	emit(*this, IS::Enter{}, node.loc);
+
+	bool pure = is_pure_function(nodes, idx, file);
+	pure_functions[current_function_idx - 1] = pure;
+	if (memoize && pure && running <= Memo_Cache::Max_Key_Size) {
+		IS::Memo_Store memo;
+		memo.function_id = current_function_idx;
+		memo.n = running;
+		memo.proc_mask = proc_mask;
+		emit(*this, IS::Memo_Lookup{ memo.function_id, memo.n, memo.proc_mask }, node.loc);
+		current_memo = memo;
+
+		// Room for the copy of the arguments the lookup does.
+		memory_stack_ptr += running;
+	}
+
 	for (size_t i = node.statement_list_idx; i; i = nodes[i]->next_statement) {
 		statement(nodes, i, *this, file);
 	}
 
-	emit(*this, IS::Ret{}, {});
+	emit_return(*this, 0, node.loc);
+	inline_infos[current_function_idx - 1].compiled = true;
+	inline_infos[current_function_idx - 1].stack = max_stack;
+	functions[current_function_idx - 1].front() = IS::Enter{ max_frame, max_stack };
 
 	memory_stack_ptr -= running;
 }
 
-extern Program compile(
+// Appends the functions compiled in part, with their constants. Indices of functions and offsets
+// in data are moved past what the program already has.
+static void merge(Program& program, Program& part) noexcept {
+	size_t first = program.functions.size();
+	size_t data = program.data.size();
+	program.data.insert(std::end(program.data), std::begin(part.data), std::end(part.data));
+
+	for (auto& f : part.functions) for (auto& x : f) switch (x.kind) {
+	case IS::Instruction::Call_Kind:        x.Call_.f_idx += first; break;
+	case IS::Instruction::Tail_Call_Kind:   x.Tail_Call_.f_idx += first; break;
+	case IS::Instruction::Constantf_Kind:   x.Constantf_.ptr += first; break;
+	case IS::Instruction::Constant_Kind:    x.Constant_.ptr += data; break;
+	case IS::Instruction::Memo_Lookup_Kind: x.Memo_Lookup_.function_id += (std::uint32_t)first; break;
+	case IS::Instruction::Memo_Store_Kind:  x.Memo_Store_.function_id += (std::uint32_t)first; break;
+	default: break;
+	}
+
+	auto append = [] (auto& to, auto& from) {
+		to.insert(
+			std::end(to), std::make_move_iterator(std::begin(from)), std::make_move_iterator(std::end(from))
+		);
+	};
+	append(program.functions, part.functions);
+	append(program.function_locs, part.function_locs);
+	append(program.pure_functions, part.pure_functions);
+	append(program.inline_infos, part.inline_infos);
+	for (auto& [idx, f] : part.definition_functions) program.definition_functions[idx] = first + f;
+}
+
+// The bodies of the top level procs only see the types declared outside of them, they don't
+// depend on each other and are compiled before the top level code. They are split in contiguous
+// ranges, each compiled on its own thread in a copy of the program as the type checker left it
+// and merged back in order: the program is the same whatever the number of threads.
+static void compile_top_level_procs(
+	const std::vector<AST::Node>& nodes, std::string_view file, Program& program, size_t threads
+) noexcept {
+	std::vector<size_t> procs;
+	for (size_t idx = 1; idx < nodes.size(); ++idx) {
+		if (nodes[idx]->depth != 0 || !nodes[idx].typecheck(AST::Node::Declaration_Kind)) continue;
+
+		auto value = nodes[idx].Declaration_.value_expression_idx;
+		if (value && nodes[value].typecheck(AST::Node::Function_Definition_Kind))
+			procs.push_back(value);
+	}
+	if (procs.empty()) return;
+
+	// A thread isn't worth it for a handful of procs.
+	constexpr size_t Min_Procs_Per_Thread = 32;
+	if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = std::min(threads, (procs.size() + Min_Procs_Per_Thread - 1) / Min_Procs_Per_Thread);
+
+	std::vector<Program> parts(threads);
+	auto work = [&] (size_t k) {
+		auto& part = parts[k];
+		part.typed = program.typed;
+		part.interpreter = program.interpreter;
+		part.memoize = program.memoize;
+		part.inline_budget = program.inline_budget;
+		for (size_t i = procs.size() * k / threads; i < procs.size() * (k + 1) / threads; ++i)
+			compile_proc(nodes, procs[i], part, file);
+	};
+
+	std::vector<std::thread> pool;
+	for (size_t k = 1; k < threads; ++k) pool.emplace_back(work, k);
+	work(0);
+	for (auto& x : pool) x.join();
+
+	for (auto& x : parts) merge(program, x);
+}
+
+extern Object compile_object(
 	const std::vector<AST::Node>& nodes,
-	std::string_view file
+	std::string_view file,
+	const std::vector<Extern_Proc>& imports,
+	size_t inline_budget,
+	size_t threads
 ) noexcept {
 	Program program;
+	program.inline_budget = inline_budget;
+	Object object;
+
+	// The imports the file names and doesn't declare itself.
+	std::unordered_set<std::string_view> named;
+	for (size_t idx = 1; idx < nodes.size(); ++idx) if (nodes[idx].typecheck(AST::Node::Identifier_Kind))
+		named.insert(string_view_from_view(file, nodes[idx].Identifier_.token.lexeme));
+	for (size_t idx = 1; idx < nodes.size(); ++idx) {
+		if (nodes[idx]->depth != 0 || !nodes[idx].typecheck(AST::Node::Declaration_Kind)) continue;
+		named.erase(string_view_from_view(file, nodes[idx].Declaration_.identifier.lexeme));
+	}
+	for (auto& x : imports) if (named.erase(x.name)) object.imports.push_back(x);
+
+	program.typed = type_check(nodes, file, program.interpreter, object.imports);
+	if (!program.typed.ok) {
+		object.ok = false;
+		return object;
+	}
+
+	emit(program, IS::Enter{}, {});
 
+	// An import is a proc variable like a declared proc, its constant is relocated to the proc.
+	for (size_t i = 0; i < object.imports.size(); ++i) {
+		auto& x = object.imports[i];
+
+		AST_Interpreter::Identifier id;
+		id.memory_idx = program.memory_stack_ptr;
+		id.type_descriptor_id = program.interpreter.create_signature_type(
+			x.parameter_types, x.return_types
+		).get_unique_id();
+
+		program.memory_stack_ptr += 8;
+		program.import_constants.push_back(program.code.size());
+		emit(program, IS::Constantf{ i }, {});
+		emit(program, IS::Save({ id.memory_idx, 8 }), {});
+		program.interpreter.new_variable(x.name, id);
+	}
+
+	compile_top_level_procs(nodes, file, program, threads);
 	for (size_t idx = 1; idx < nodes.size(); ++idx) if (nodes[idx]->depth == 0) {
 		statement(nodes, idx, program, file);
 	}
+	program.max_frame = std::max(program.max_frame, program.memory_stack_ptr);
+	program.code.front() = IS::Enter{ program.max_frame, program.max_stack };
 
-	emit(program, IS::Exit(), {});
-
-	std::unordered_map<size_t, size_t> map_idx;
-	std::unordered_map<size_t, size_t> map_cst;
+	object.data = std::move(program.data);
+	object.code = std::move(program.code);
+	object.locs = std::move(program.locs);
 	for (size_t i = 0; i < program.functions.size(); ++i) {
-		map_cst[i] = alloc_constant(program, program.code.size());
-		map_idx[i] = program.code.size();
-		program.code.insert(
-			std::end(program.code),
-			std::begin(program.functions[i]),
-			std::end(program.functions[i])
+		object.functions.push_back(object.code.size());
+		object.code.insert(
+			std::end(object.code), std::begin(program.functions[i]), std::end(program.functions[i])
+		);
+		object.locs.insert(
+			std::end(object.locs),
+			std::begin(program.function_locs[i]),
+			std::end(program.function_locs[i])
 		);
 	}
+	object.pure_functions = std::move(program.pure_functions);
+
+	size_t next_import = 0;
+	for (size_t ip = 0; ip < object.code.size(); ++ip) {
+		using Relocation = Object::Relocation;
+		switch (object.code[ip].kind) {
+		case IS::Instruction::Call_Kind:
+		case IS::Instruction::Tail_Call_Kind:
+		case IS::Instruction::Memo_Lookup_Kind:
+		case IS::Instruction::Memo_Store_Kind:
+			object.relocations.push_back({ Relocation::Function, ip });
+			break;
+		case IS::Instruction::Constant_Kind:
+			object.relocations.push_back({ Relocation::Data, ip });
+			break;
+		case IS::Instruction::Constantf_Kind: {
+			bool import =
+				next_import < program.import_constants.size() &&
+				program.import_constants[next_import] == ip;
+			if (import) next_import++;
+			object.relocations.push_back({ import ? Relocation::Import : Relocation::Function, ip });
+			break;
+		}
+		default: break;
+		}
+	}
+
+	// A name declared twice exports its last declaration, the one the file sees afterward.
+	std::unordered_map<std::string_view, size_t> declared;
+	for (size_t idx = 1; idx < nodes.size(); ++idx) {
+		if (nodes[idx]->depth != 0 || !nodes[idx].typecheck(AST::Node::Declaration_Kind)) continue;
+
+		auto& node = nodes[idx].Declaration_;
+		auto it = program.definition_functions.find(node.value_expression_idx);
+		if (it != std::end(program.definition_functions))
+			declared[string_view_from_view(file, node.identifier.lexeme)] = it->second;
+	}
+	for (auto& x : exports_of(nodes, file)) {
+		size_t f = declared.at(x.name);
+		object.exports.push_back({ std::move(x), f });
+	}
+
+	return object;
+}
+
+extern Program compile(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file,
+	size_t inline_budget,
+	size_t threads
+) noexcept {
+	std::vector<Object> objects;
+	objects.push_back(compile_object(nodes, file, {}, inline_budget, threads));
+	return link(objects);
+}
+
+// Where each instruction puts its payload, see IS::Word.
+static IS::Operands operands(const IS::Instruction& x) noexcept {
+	IS::Operands res;
+	switch (x.kind) {
+	case IS::Instruction::Constant_Kind:     res.a = x.Constant_.n;   res.b = x.Constant_.ptr; break;
+	case IS::Instruction::Constantf_Kind:    res.b = x.Constantf_.ptr; break;
+	case IS::Instruction::Push_Kind:         res.b = x.Push_.n; break;
+	case IS::Instruction::Enter_Kind:        res.a = x.Enter_.frame; res.b = x.Enter_.stack; break;
+	case IS::Instruction::Pop_Kind:          res.b = x.Pop_.n; break;
+	case IS::Instruction::Load_At_Kind:      res.b = x.Load_At_.n; break;
+	case IS::Instruction::Call_At_Kind:      res.b = x.Call_At_.n; break;
+	case IS::Instruction::Tail_Call_At_Kind: res.b = x.Tail_Call_At_.n; break;
+	case IS::Instruction::Ret_Kind:          res.b = x.Ret_.n; break;
+	case IS::Instruction::Jmp_Rel_Kind:      res.b = (std::uint32_t)x.Jmp_Rel_.dt_ip; break;
+	case IS::Instruction::If_Jmp_Rel_Kind:   res.b = (std::uint32_t)x.If_Jmp_Rel_.dt_ip; break;
+	case IS::Instruction::If_Not_Jmp_Rel_Kind:
+		res.b = (std::uint32_t)x.If_Not_Jmp_Rel_.dt_ip;
+		break;
+	#define X(k) case IS::Instruction::Jmp_Unless_##k##_Kind:\
+		res.b = (std::uint32_t)x.Jmp_Unless_##k##_.dt_ip;\
+		break;
+	IS_COMPARISON_LIST(X)
+	#undef X
+	case IS::Instruction::Load_Load_Kind:
+		res.a = x.Load_Load_.memory_ptr_a;
+		res.b = x.Load_Load_.memory_ptr_b;
+		break;
+	#define X(k) case IS::Instruction::Load_Load_##k##_Kind:\
+		res.a = x.Load_Load_##k##_.memory_ptr_a;\
+		res.b = x.Load_Load_##k##_.memory_ptr_b;\
+		break;
+	IS_LOAD_LOAD_LIST(X)
+	#undef X
+	case IS::Instruction::Inc_At_Kind:       res.b = x.Inc_At_.memory_ptr; break;
+	case IS::Instruction::Inc_I_At_Kind:     res.b = x.Inc_I_At_.memory_ptr; break;
+	case IS::Instruction::CI2R_Kind:         res.a = x.CI2R_.from_nat; res.b = x.CI2R_.offset; break;
+	case IS::Instruction::CR2I_Kind:         res.a = x.CR2I_.to_nat; break;
+	case IS::Instruction::Stack_Load_Kind:
+		res.a = x.Stack_Load_.n;
+		res.b = x.Stack_Load_.memory_ptr;
+		break;
+	case IS::Instruction::Save_Kind:
+		res.a = x.Save_.n;
+		res.b = x.Save_.memory_ptr;
+		break;
+	case IS::Instruction::Call_Kind:
+		res.a = x.Call_.n;
+		res.b = x.Call_.f_idx;
+		break;
+	case IS::Instruction::Tail_Call_Kind:
+		res.a = x.Tail_Call_.n;
+		res.b = x.Tail_Call_.f_idx;
+		break;
+	case IS::Instruction::Memo_Lookup_Kind:
+		res.a = x.Memo_Lookup_.n;
+		res.b = x.Memo_Lookup_.function_id;
+		res.c = x.Memo_Lookup_.proc_mask;
+		break;
+	case IS::Instruction::Memo_Store_Kind:
+		static_assert(Memo_Cache::Max_Key_Size < (1 << 12));
+		res.a = x.Memo_Store_.n | (x.Memo_Store_.ret_n << 12);
+		res.b = x.Memo_Store_.function_id;
+		res.c = x.Memo_Store_.proc_mask;
+		break;
+	default: break;
+	}
+	return res;
+}
+
+void Program::encode() noexcept {
+	#define X(x) + 1
+	static_assert(1 IS_LIST(X) <= 256, "Opcodes are on one byte.");
+	#undef X
+
+	bytecode.clear();
+	wide.clear();
+	bytecode.reserve(code.size());
+
+	for (auto& x : code) {
+		auto op = operands(x);
+
+		if (op.a >= IS::Wide || op.b > UINT32_MAX || op.c) {
+			wide.push_back(op);
+			op.a = IS::Wide;
+			op.b = wide.size() - 1;
+		}
+
+		bytecode.push_back((IS::Word)x.kind | (op.a << 8) | (op.b << 32));
+	}
+
+	line_table.build(locs);
+}
+
+AST::Source_Code_Loc Program::loc_of(size_t ip) const noexcept {
+	return line_table.find(ip);
+}
+
+static void write_varint(std::vector<std::uint8_t>& bytes, std::uint64_t x) noexcept {
+	for (; x >= 0x80; x >>= 7) bytes.push_back((std::uint8_t)(x | 0x80));
+	bytes.push_back((std::uint8_t)x);
+}
+static std::uint64_t read_varint(const std::uint8_t*& it) noexcept {
+	std::uint64_t x = 0;
+	for (size_t shift = 0;; shift += 7) {
+		auto byte = *it++;
+		x |= (std::uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return x;
+	}
+}
+// Deltas are mostly small either way, zigzag keeps the negative ones small too.
+static std::uint64_t zigzag(size_t from, size_t to) noexcept {
+	auto d = (std::int64_t)(to - from);
+	return ((std::uint64_t)d << 1) ^ (std::uint64_t)(d >> 63);
+}
+static size_t unzigzag(size_t from, std::uint64_t x) noexcept {
+	return from + (size_t)((x >> 1) ^ (~(x & 1) + 1));
+}
 
-	for (auto& x : program.code) {
-		if (x.typecheck(IS::Instruction::Call_Kind))
-			x.Call_.f_idx = map_idx[x.Call_.f_idx];
-		if (x.kind == IS::Instruction::Constantf_Kind)
-			x = IS::Constant{ map_cst[x.Constantf_.ptr], 8 };
+void Line_Table::build(const std::vector<AST::Source_Code_Loc>& locs) noexcept {
+	bytes.clear();
+	checkpoints.clear();
+
+	Checkpoint state;
+	size_t runs = 0;
+	for (size_t ip = 0; ip < locs.size(); ++ip) {
+		auto& loc = locs[ip];
+		bool same =
+			ip && loc.line == state.loc.line && loc.offset == state.loc.offset &&
+			loc.length == state.loc.length;
+		if (same) continue;
+
+		if (runs++ % Checkpoint_Every == 0) {
+			state.byte = bytes.size();
+			checkpoints.push_back(state);
+		}
+		write_varint(bytes, ip - state.ip);
+		write_varint(bytes, zigzag(state.loc.line,   loc.line));
+		write_varint(bytes, zigzag(state.loc.offset, loc.offset));
+		write_varint(bytes, zigzag(state.loc.length, loc.length));
+		state.ip  = ip;
+		state.loc = loc;
 	}
+}
 
-	return program;
+AST::Source_Code_Loc Line_Table::find(size_t ip) const noexcept {
+	if (checkpoints.empty()) return {};
+
+	// A checkpoint is the state before decoding a run, it has the location of the run before.
+	// From the last one at or before ip, the runs are decoded up to the one containing ip.
+	auto cp = std::upper_bound(
+		std::begin(checkpoints), std::end(checkpoints), ip,
+		[](size_t ip, const Checkpoint& x) { return ip < x.ip; }
+	);
+	auto state = *(cp - 1);
+	auto* it  = bytes.data() + state.byte;
+	auto* end = bytes.data() + bytes.size();
+	while (it < end) {
+		size_t start = state.ip + read_varint(it);
+		if (start > ip) break;
+
+		state.ip = start;
+		state.loc.line   = unzigzag(state.loc.line,   read_varint(it));
+		state.loc.offset = unzigzag(state.loc.offset, read_varint(it));
+		state.loc.length = unzigzag(state.loc.length, read_varint(it));
+	}
+	return state.loc;
+}
+
+extern size_t memory_traffic(const Program& program, size_t ip) noexcept {
+	auto& x = program.code[ip];
+	auto op = operands(x);
+	switch (x.kind) {
+	// Pop both operands, push the result.
+	case IS::Instruction::Add_Kind:   case IS::Instruction::Sub_Kind:   case IS::Instruction::Mul_Kind:
+	case IS::Instruction::Div_Kind:   case IS::Instruction::Mod_Kind:   case IS::Instruction::Eq_Kind:
+	case IS::Instruction::Neq_Kind:   case IS::Instruction::Lt_Kind:    case IS::Instruction::Leq_Kind:
+	case IS::Instruction::Gt_Kind:    case IS::Instruction::Add_I_Kind: case IS::Instruction::Sub_I_Kind:
+	case IS::Instruction::Mul_I_Kind: case IS::Instruction::Div_I_Kind: case IS::Instruction::Mod_I_Kind:
+	case IS::Instruction::Div_U_Kind: case IS::Instruction::Mod_U_Kind: case IS::Instruction::Eq_I_Kind:
+	case IS::Instruction::Neq_I_Kind: case IS::Instruction::Lt_I_Kind:  case IS::Instruction::Leq_I_Kind:
+	case IS::Instruction::Gt_I_Kind:  case IS::Instruction::Lt_U_Kind:  case IS::Instruction::Leq_U_Kind:
+	case IS::Instruction::Gt_U_Kind:
+	#define X(k) case IS::Instruction::Load_Load_##k##_Kind:
+	IS_LOAD_LOAD_LIST(X)
+	#undef X
+		return 24;
+	// Pop one, push one.
+	case IS::Instruction::Neg_Kind:   case IS::Instruction::Neg_I_Kind: case IS::Instruction::Not_Kind:
+	case IS::Instruction::Inc_Kind:   case IS::Instruction::Inc_I_Kind: case IS::Instruction::CI2R_Kind:
+	case IS::Instruction::CR2I_Kind:  case IS::Instruction::CI2B_Kind:  case IS::Instruction::Inc_At_Kind:
+	case IS::Instruction::Inc_I_At_Kind:
+	#define X(k) case IS::Instruction::Jmp_Unless_##k##_Kind:
+	IS_COMPARISON_LIST(X)
+	#undef X
+		return 16;
+	case IS::Instruction::If_Jmp_Rel_Kind:     case IS::Instruction::If_Not_Jmp_Rel_Kind:
+	case IS::Instruction::Print_Kind:          case IS::Instruction::Print_Int_Kind:
+	case IS::Instruction::Print_Nat_Kind:      case IS::Instruction::Print_Byte_Kind:
+	case IS::Instruction::Sleep_Kind:          case IS::Instruction::True_Kind:
+	case IS::Instruction::False_Kind:          case IS::Instruction::Load_Rsp_Kind:
+		return 8;
+	case IS::Instruction::Load_Load_Kind:      return 32;
+	// Read from the data or the memory, written on the stack, or the other way around.
+	case IS::Instruction::Constant_Kind:
+	case IS::Instruction::Stack_Load_Kind:
+	case IS::Instruction::Save_Kind:           return 2 * op.a;
+	case IS::Instruction::Load_At_Kind:        return 8 + 2 * op.b;
+	case IS::Instruction::Load_At_Byte_Kind:   return 8 + 1 + 8;
+	// A call leaves the arguments where they are, a tail call moves them over its own.
+	case IS::Instruction::Call_At_Kind:        return 8;
+	case IS::Instruction::Tail_Call_At_Kind:   return 8 + 2 * op.b;
+	case IS::Instruction::Tail_Call_Kind:      return 2 * op.a;
+	// The returned value is moved down to where the frame starts.
+	case IS::Instruction::Ret_Kind:            return 2 * op.b;
+	default:                                   return 0;
+	}
 }
 
 void Program::debug() const noexcept {
 	for (size_t i = 0; i < code.size(); ++i) {
-		printf(">% 5d ", (int)i);
+		printf(">% 5d L%-4zu ", (int)i, loc_of(i).line + 1);
 		if (annotations.count(i)) printf("| %-100s |", annotations.at(i).c_str());
 		code[i].debug(*this);
 		printf("\n");
@@ -628,12 +1526,11 @@ void Program::debug() const noexcept {
 void IS::Instruction::debug(const Program& program) const noexcept {
 	printf("%-10s", name());
 	if (typecheck(Constant_Kind)) {
-		printf(
-			": const:[%zu](%llf), %zu",
-			Constant_.ptr,
-			*(long double*)(program.data.data() + Constant_.ptr),
-			Constant_.n
-		);
+		// The type isn't known here, an int and a real can both be 8 bytes, so the raw bytes.
+		printf(": const:[%zu](", Constant_.ptr);
+		for (size_t i = 0; i < Constant_.n; ++i)
+			printf(i ? " %02x" : "%02x", (unsigned)program.data[Constant_.ptr + i]);
+		printf("), %zu", Constant_.n);
 	}
 	if (typecheck(Push_Kind)) {
 		printf(": %zu", Push_.n);
@@ -641,6 +1538,15 @@ void IS::Instruction::debug(const Program& program) const noexcept {
 	if (typecheck(Call_Kind)) {
 		printf(": f:[%zu], %zu", Call_.f_idx, Call_.n);
 	}
+	if (typecheck(Tail_Call_At_Kind)) {
+		printf(": %zu", Tail_Call_At_.n);
+	}
+	if (typecheck(Tail_Call_Kind)) {
+		printf(": f:[%zu], %zu", Tail_Call_.f_idx, Tail_Call_.n);
+	}
+	if (typecheck(CI2R_Kind)) {
+		printf(": %zu%s", CI2R_.offset, CI2R_.from_nat ? ", nat" : "");
+	}
 	if (typecheck(Ret_Kind)) {
 		printf(": %zu", Ret_.n);
 	}
@@ -653,8 +1559,28 @@ void IS::Instruction::debug(const Program& program) const noexcept {
 	if (typecheck(If_Jmp_Rel_Kind)) {
 		printf(": %d", If_Jmp_Rel_.dt_ip);
 	}
-	if (typecheck(Alloc_Kind)) {
-		printf(": %zu", Alloc_.n);
+	if (typecheck(If_Not_Jmp_Rel_Kind)) {
+		printf(": %d", If_Not_Jmp_Rel_.dt_ip);
+	}
+	#define X(k) if (typecheck(Jmp_Unless_##k##_Kind)) printf(": %d", Jmp_Unless_##k##_.dt_ip);
+	IS_COMPARISON_LIST(X)
+	#undef X
+	if (typecheck(Load_Load_Kind)) {
+		printf(": stack:[%zu], stack:[%zu]", Load_Load_.memory_ptr_a, Load_Load_.memory_ptr_b);
+	}
+	#define X(k) if (typecheck(Load_Load_##k##_Kind)) printf(\
+		": stack:[%zu], stack:[%zu]", Load_Load_##k##_.memory_ptr_a, Load_Load_##k##_.memory_ptr_b\
+	);
+	IS_LOAD_LOAD_LIST(X)
+	#undef X
+	if (typecheck(Inc_At_Kind)) {
+		printf(": mem:[%zu]", Inc_At_.memory_ptr);
+	}
+	if (typecheck(Inc_I_At_Kind)) {
+		printf(": mem:[%zu]", Inc_I_At_.memory_ptr);
+	}
+	if (typecheck(Enter_Kind)) {
+		printf(": frame %zu, stack %zu", Enter_.frame, Enter_.stack);
 	}
 	if (typecheck(Stack_Load_Kind)) {
 		printf(": stack:[%zu], %zu", Stack_Load_.memory_ptr, Stack_Load_.n);
@@ -665,258 +1591,501 @@ void IS::Instruction::debug(const Program& program) const noexcept {
 	if (typecheck(Save_Kind)) {
 		printf(": mem:[%zu], %zu", Save_.memory_ptr, Save_.n);
 	}
+	if (typecheck(Memo_Lookup_Kind)) {
+		printf(": f:[%u], %u", Memo_Lookup_.function_id, Memo_Lookup_.n);
+	}
+	if (typecheck(Memo_Store_Kind)) {
+		printf(": f:[%u], %u, %u", Memo_Store_.function_id, Memo_Store_.n, Memo_Store_.ret_n);
+	}
 }
 
+// sp points right past the top of the stack. Nothing checks there's room, the Enter of every
+// function made it.
 template<typename T>
-T pop_stack(std::vector<std::uint8_t>& stack) noexcept {
-	T x = *reinterpret_cast<T*>(stack.data() + stack.size() - sizeof(T));
-	stack.resize(stack.size() - sizeof(T));
+T pop_stack(std::uint8_t*& sp) noexcept {
+	sp -= sizeof(T);
+	T x;
+	memcpy(&x, sp, sizeof(T));
 	return x;
 }
-void pop_stack(std::vector<std::uint8_t>& stack, size_t n) noexcept {
-	stack.resize(stack.size() - n);
-}
 template<typename T>
-T peek_stack(std::vector<std::uint8_t>& stack) noexcept {
-	T x = *reinterpret_cast<T*>(stack.data() + stack.size() - sizeof(T));
+T peek_stack(const std::uint8_t* sp) noexcept {
+	T x;
+	memcpy(&x, sp - sizeof(T), sizeof(T));
 	return x;
 }
 template<typename T>
-void push_stack(T x, std::vector<std::uint8_t>& stack) noexcept {
-	stack.resize(stack.size() + sizeof(T));
-	memcpy(stack.data() + stack.size() - sizeof(T), &x, sizeof(T));
+void push_stack(T x, std::uint8_t*& sp) noexcept {
+	memcpy(sp, &x, sizeof(T));
+	sp += sizeof(T);
 }
-void push_stack(std::vector<std::uint8_t>& stack, const std::uint8_t* data, size_t n) noexcept {
-	stack.resize(stack.size() + n);
-	memcpy(stack.data() + stack.size() - n, data, n);
+void push_stack(std::uint8_t*& sp, const std::uint8_t* data, size_t n) noexcept {
+	memcpy(sp, data, n);
+	sp += n;
 }
 
-void Bytecode_VM::execute(const Program& program) noexcept {
-	stack_frame.clear();
-	stack_frame.push_back(0);
+// Every proc passed in the arguments needs to be pure for the result to only depend on them.
+static bool memo_usable(
+	const Program& program, const std::uint8_t* args, std::uint64_t proc_mask
+) noexcept {
+	for (size_t i = 0; proc_mask; ++i, proc_mask >>= 1) if (proc_mask & 1) {
+		std::uint64_t address;
+		memcpy(&address, args + i, sizeof(address));
+		if (!program.pure_addresses.count(address)) return false;
+	}
+	return true;
+}
 
-	call_stack.clear();
-	call_stack.push_back(0);
+void Bytecode_VM::fault(const Program& program, size_t ip, const char* what) const noexcept {
+	println("Line %zu: %s", program.loc_of(ip).line + 1, what);
+	// Every return address but the top level's is right after the call.
+	for (size_t i = frames.size() - 1; i > 0; --i)
+		println("  called from line %zu", program.loc_of(frames[i].ret - 1).line + 1);
+}
 
-	memory_stack_frame.clear();
-	memory_stack_frame.push_back(0);
+// GCC and Clang can take the address of a label, execute() then jumps from handler to handler
+// instead of going back to a switch. Building with EASE_SWITCH_DISPATCH keeps the switch.
+#if !defined(EASE_SWITCH_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+#define EASE_COMPUTED_GOTO 1
+#else
+#define EASE_COMPUTED_GOTO 0
+#endif
 
-	for (size_t ip = 0, n_max = 0; ip < program.code.size(); ++ip, ++n_max) {
-		auto inst = program.code[ip];
+void Bytecode_VM::execute(const Program& program) noexcept {
+	using IS::Real;
+
+	stack.resize(Initial_Stack);
+
+	frames.clear();
+	frames.push_back({});
+
+	const IS::Word* code = program.bytecode.data();
+	const size_t code_size = program.bytecode.size();
+
+	#if EASE_COMPUTED_GOTO
+	#define X(x) &&op_##x,
+	static const void* const labels[] = { &&op_None, IS_LIST(X) };
+	#undef X
+	auto handler = [&] (std::uint8_t opcode) { return (std::uintptr_t)labels[opcode]; };
+	#else
+	auto handler = [] (std::uint8_t opcode) { return (std::uintptr_t)opcode; };
+	#endif
+
+	// A jump can land right past the end, the program exits there.
+	decoded.resize(code_size + 1);
+	for (size_t ip = 0; ip < code_size; ++ip) {
+		auto word = code[ip];
+		auto& x = decoded[ip];
+		x.handler = handler(IS::opcode(word));
+		x.a = IS::operand_a(word);
+		x.b = IS::operand_b(word);
+		x.c = 0;
+		if (x.a == IS::Wide) {
+			auto& wide = program.wide[x.b];
+			x.a = wide.a;
+			x.b = wide.b;
+			x.c = wide.c;
+		}
+	}
+	decoded[code_size] = { handler(IS::Instruction::Exit_Kind) };
+
+	size_t ip = 0;
+	const Decoded* arg = nullptr;
+
+	// fp points to the frame of the current call. Frames keep offsets, the stack only moves when
+	// an Enter grows it.
+	std::uint8_t* base = stack.data();
+	std::uint8_t* fp   = base;
+	std::uint8_t* sp   = base;
+
+	// Every handler ends with NEXT. With computed gotos it jumps straight to the handler of the
+	// next instruction, each one has its own indirect jump for the branch predictor to learn.
+	#define DECODE() \
+		arg = &decoded[ip]; \
+		if (profiler && ip < code_size) profiler->record(ip, IS::opcode(code[ip]))
+	#if EASE_COMPUTED_GOTO
+	#define OP(k) op_##k
+	#define DISPATCH() do { DECODE(); goto *(const void*)arg->handler; } while (false)
+	#define NEXT do { ++ip; DISPATCH(); } while (false)
+	#else
+	#define OP(k) case IS::Instruction::k##_Kind
+	#define DISPATCH() DECODE()
+	#define NEXT break
+	#endif
+
+	#if EASE_COMPUTED_GOTO
+	DISPATCH();
+	#else
+	for (;; ++ip) {
+		DISPATCH();
+	#endif
 
 		//size_t col = 0;
-		//for (size_t i = 0; i < call_stack.size(); ++i) printf("-");
+		//for (size_t i = 0; i < frames.size(); ++i) printf("-");
 		//col += printf("|");
-		//for (size_t i = 0; i < stack.size(); i += sizeof(long double)) {
-		//	col +=  printf("%10.5Lf|", *reinterpret_cast<long double*>(stack.data() + i));
+		//for (auto* x = base; x < sp; x += sizeof(Real)) {
+		//	col +=  printf("%10.5Lf|", (long double)*reinterpret_cast<Real*>(x));
 		//}
 		//for (col %= 100; col < 100; ++col) printf(" ");
 		//inst.debugln();
 		//fflush(stdout);
 
-		#define BINARY_OP(k, op) case IS::Instruction::k : { \
-			auto b = pop_stack<long double>(stack); \
-			auto a = pop_stack<long double>(stack); \
-			push_stack<long double>(a op b, stack); \
-			break; \
+		#define BINARY_OP(k, op) OP(k): { \
+			auto b = pop_stack<Real>(sp); \
+			auto a = pop_stack<Real>(sp); \
+			push_stack<Real>(a op b, sp); \
+			NEXT; \
 		}
 
-		switch(inst.kind) {
-			case IS::Instruction::None_Kind: break;
-			case IS::Instruction::Constant_Kind: {
-				assert(inst.Constant_.ptr + inst.Constant_.n <= program.data.size());
-				push_stack(
-					stack,
-					program.data.data() + inst.Constant_.ptr,
-					inst.Constant_.n
-				);
-				break;
-			}
-			BINARY_OP(Add_Kind, +);
-			BINARY_OP(Sub_Kind, -);
-			BINARY_OP(Mul_Kind, *);
-			BINARY_OP(Div_Kind, /);
-			BINARY_OP(Eq_Kind, ==);
-			BINARY_OP(Neq_Kind, !=);
-			BINARY_OP(Lt_Kind, < );
-			BINARY_OP(Leq_Kind, <=);
-			BINARY_OP(Gt_Kind, > );
-			case IS::Instruction::Mod_Kind: {
-				auto b = pop_stack<long double>(stack);
-				auto a = pop_stack<long double>(stack);
-				push_stack<long double>(std::fmodl(a, b), stack);
-				break;
-			}
-			case IS::Instruction::Inc_Kind: {
-				auto b = pop_stack<long double>(stack);
-				push_stack<long double>(b + 1, stack);
-				break;
-			}
-			case IS::Instruction::Not_Kind: {
-				auto x = pop_stack<bool>(stack);
-				push_stack(!x, stack);
-				break;
-			}
-			case IS::Instruction::Neg_Kind: {
-				auto x = pop_stack<long double>(stack);
-				push_stack(-x, stack);
-				break;
-			}
-			case IS::Instruction::Print_Kind: {
-				auto x = peek_stack<long double>(stack);
-				printf("[%zu] %Lf\n", ip, x);
-				break;
-			}
-			case IS::Instruction::Print_Byte_Kind: {
-				auto x = peek_stack<char>(stack);
-				printf("%c", x);
-				break;
-			}
-			case IS::Instruction::Sleep_Kind: {
-				auto x = peek_stack<long double>(stack);
+		// Add, sub and mul are done on unsigned so overflows wrap around instead of being UB.
+		#define INT_OP(k, op) OP(k): { \
+			auto b = pop_stack<std::uint64_t>(sp); \
+			auto a = pop_stack<std::uint64_t>(sp); \
+			push_stack<std::uint64_t>(a op b, sp); \
+			NEXT; \
+		}
+		#define INT_CMP(k, T, op) OP(k): { \
+			auto b = pop_stack<T>(sp); \
+			auto a = pop_stack<T>(sp); \
+			push_stack<Real>(a op b, sp); \
+			NEXT; \
+		}
+		// INT64_MIN / -1 overflows, x / -1 and x % -1 are given by minus_one instead.
+		#define INT_DIV(k, T, op, minus_one) OP(k): { \
+			auto b = pop_stack<T>(sp); \
+			auto a = pop_stack<T>(sp); \
+			if (b == 0) { \
+				fault(program, ip, "Integer division by zero."); \
+				goto done; \
+			} \
+			if (std::is_signed_v<T> && b == (T)-1) \
+				push_stack<T>(minus_one, sp); \
+			else \
+				push_stack<T>(a op b, sp); \
+			NEXT; \
+		}
+
+		#define JMP_UNLESS(k, T, op) OP(k): { \
+			auto b = pop_stack<T>(sp); \
+			auto a = pop_stack<T>(sp); \
+			if (!(a op b)) ip += (std::int32_t)arg->b - 1; \
+			NEXT; \
+		}
+		#define LOAD_LOAD_OP(k, T, op) OP(k): { \
+			T a; \
+			T b; \
+			memcpy(&a, fp + arg->a, sizeof(T)); \
+			memcpy(&b, fp + arg->b, sizeof(T)); \
+			push_stack<T>(a op b, sp); \
+			NEXT; \
+		}
+
+		#if !EASE_COMPUTED_GOTO
+		switch (arg->handler) {
+		#endif
+			OP(None):
+			OP(Constantf):
+				NEXT;
+			OP(Constant): {
+				assert(arg->b + arg->a <= program.data.size());
+				push_stack(sp, program.data.data() + arg->b, arg->a);
+				NEXT;
+			}
+			BINARY_OP(Add, +);
+			BINARY_OP(Sub, -);
+			BINARY_OP(Mul, *);
+			BINARY_OP(Div, /);
+			BINARY_OP(Eq, ==);
+			BINARY_OP(Neq, !=);
+			BINARY_OP(Lt, < );
+			BINARY_OP(Leq, <=);
+			BINARY_OP(Gt, > );
+			OP(Mod): {
+				auto b = pop_stack<Real>(sp);
+				auto a = pop_stack<Real>(sp);
+				push_stack<Real>(std::fmod(a, b), sp);
+				NEXT;
+			}
+			OP(Inc): {
+				auto b = pop_stack<Real>(sp);
+				push_stack<Real>(b + 1, sp);
+				NEXT;
+			}
+			OP(Not): {
+				auto x = pop_stack<Real>(sp);
+				push_stack<Real>(!x, sp);
+				NEXT;
+			}
+			OP(Neg): {
+				auto x = pop_stack<Real>(sp);
+				push_stack(-x, sp);
+				NEXT;
+			}
+			OP(Print): {
+				auto x = peek_stack<Real>(sp);
+				printf("[%zu] %Lf\n", ip, (long double)x);
+				NEXT;
+			}
+			OP(Print_Byte): {
+				auto x = peek_stack<std::int64_t>(sp);
+				printf("%c", (char)x);
+				NEXT;
+			}
+			OP(Sleep): {
+				auto x = peek_stack<Real>(sp);
 				std::this_thread::sleep_for(
 					std::chrono::nanoseconds((long long)(1'000'000'000 * x))
 				);
-				break;
+				NEXT;
 			}
-			case IS::Instruction::True_Kind: {
-				push_stack<bool>(true, stack);
-				break;
+			OP(True): {
+				push_stack<Real>(1, sp);
+				NEXT;
 			}
-			case IS::Instruction::False_Kind: {
-				push_stack<bool>(false, stack);
-				break;
+			OP(False): {
+				push_stack<Real>(0, sp);
+				NEXT;
 			}
-			case IS::Instruction::Push_Kind: {
-				stack.resize(stack.size() + inst.Push_.n);
-				break;
+			OP(Push): {
+				memset(sp, 0, arg->b);
+				sp += arg->b;
+				NEXT;
 			}
-			case IS::Instruction::Pop_Kind: {
-				stack.resize(stack.size() - inst.Pop_.n);
-				break;
+			OP(Pop): {
+				sp -= arg->b;
+				NEXT;
 			}
-			case IS::Instruction::Stack_Load_Kind: {
-				push_stack(
-					stack,
-					memory.data() + inst.Stack_Load_.memory_ptr + memory_stack_frame.back(),
-					inst.Stack_Load_.n
-				);
-				break;
-			}
-			case IS::Instruction::Load_At_Kind: {
-				auto ptr = pop_stack<long double>(stack);
-				assert((size_t)ptr <= memory.size());
-				push_stack(
-					stack,
-					memory.data() + (size_t)ptr,
-					inst.Load_At_.n
-				);
-				break;
+			OP(Stack_Load): {
+				push_stack(sp, fp + arg->b, arg->a);
+				NEXT;
 			}
-			case IS::Instruction::Save_Kind: {
-				assert(
-					memory.size() >=
-					inst.Save_.memory_ptr + inst.Save_.n + memory_stack_frame.back()
-				);
-				memcpy(
-					memory.data() + inst.Save_.memory_ptr + memory_stack_frame.back(),
-					stack.data() + stack.size() - inst.Save_.n,
-					inst.Save_.n
-				);
-				pop_stack(stack, inst.Save_.n);
-				break;
-			}
-			case IS::Instruction::Alloc_Kind: {
-				memory.resize(memory.size() + inst.Alloc_.n);
-				break;
-			}
-			case IS::Instruction::Call_Kind: {
-				call_stack.push_back(ip + 1);
-				stack_frame.push_back(stack.size() - inst.Call_.n);
-				memory_stack_frame.push_back(memory.size());
-
-				memory.resize(memory.size() + inst.Call_.n);
-				memcpy(
-					memory.data() + memory.size() - inst.Call_.n,
-					stack .data() + stack .size() - inst.Call_.n,
-					inst.Call_.n
-				);
-
-				stack.resize(stack.size() - inst.Call_.n);
+			OP(Load_At): {
+				auto ptr = pop_stack<std::uint64_t>(sp);
+				assert(ptr <= stack.size());
+				push_stack(sp, base + ptr, arg->b);
+				NEXT;
+			}
+			OP(Load_At_Byte): {
+				auto ptr = pop_stack<std::uint64_t>(sp);
+				assert(ptr < stack.size());
+				push_stack<std::int64_t>(base[ptr], sp);
+				NEXT;
+			}
+			OP(Save): {
+				sp -= arg->a;
+				memcpy(fp + arg->b, sp, arg->a);
+				NEXT;
+			}
+			OP(Enter): {
+				// The top level of a file after the first one can have operands left over its frame.
+				auto* vars = fp + arg->a;
+				auto* top  = std::max(sp, vars);
+				if ((size_t)(base + stack.size() - top) < arg->b) {
+					size_t at = fp - base;
+					size_t used = sp - base;
+					stack.resize(std::max(2 * stack.size(), (size_t)(top - base) + arg->b));
+					base = stack.data();
+					fp = base + at;
+					sp = base + used;
+					vars = fp + arg->a;
+				}
+				if (sp < vars) {
+					memset(sp, 0, vars - sp);
+					sp = vars;
+				}
+				NEXT;
+			}
+			OP(Call): {
+				fp = sp - arg->a;
+				frames.push_back({ ip + 1, (size_t)(fp - base) });
+				ip = arg->b - 1;
+				NEXT;
+			}
+			OP(Call_At): {
+				auto ret = ip + 1;
+				ip = pop_stack<std::uint64_t>(sp) - 1;
+				fp = sp - arg->b;
+				frames.push_back({ ret, (size_t)(fp - base) });
+				NEXT;
+			}
+			OP(Tail_Call_At): {
+				ip = pop_stack<std::uint64_t>(sp) - 1;
+
+				// The caller's return address and frame stay, only the arguments are replaced.
+				size_t n = arg->b;
+				memmove(fp, sp - n, n);
+				sp = fp + n;
+				NEXT;
+			}
+			OP(Tail_Call): {
+				ip = arg->b - 1;
 
-				ip = inst.Call_.f_idx - 1;
-				break;
+				size_t n = arg->a;
+				memmove(fp, sp - n, n);
+				sp = fp + n;
+				NEXT;
 			}
-			case IS::Instruction::Call_At_Kind: {
-				call_stack.push_back(ip + 1);
-				ip = pop_stack<long double>(stack) - 1;
-				stack_frame.push_back(stack.size() - inst.Call_At_.n);
-				memory_stack_frame.push_back(memory.size());
+			OP(If_Jmp_Rel): {
+				if (peek_stack<Real>(sp)) ip += (std::int32_t)arg->b - 1;
+				NEXT;
+			}
+			OP(If_Not_Jmp_Rel): {
+				if (!pop_stack<Real>(sp)) ip += (std::int32_t)arg->b - 1;
+				NEXT;
+			}
+			OP(Jmp_Rel): {
+				ip += (std::int32_t)arg->b - 1;
+				NEXT;
+			}
+			OP(Ret): {
+				// The returned value moves down to where the arguments were, for the caller.
+				memmove(fp, sp - arg->b, arg->b);
+				sp = fp + arg->b;
+
+				ip = frames.back().ret - 1;
+				frames.pop_back();
+				fp = base + frames.back().base;
+				NEXT;
+			}
+			OP(Memo_Lookup): {
+				size_t n = arg->a;
+				memcpy(fp + n, fp, n);
+				if (!memo_usable(program, fp, arg->c)) NEXT;
 
-				memory.resize(memory.size() + inst.Call_At_.n);
-				memcpy(
-					memory.data() + memory.size() - inst.Call_At_.n,
-					stack .data() + stack .size() - inst.Call_At_.n,
-					inst.Call_At_.n
-				);
+				auto entry = memo.find(arg->b, fp, n);
+				if (!entry) NEXT;
 
-				stack.resize(stack.size() - inst.Call_At_.n);
+				sp = fp;
+				push_stack(sp, entry->value, entry->value_size);
 
-				break;
+				ip = frames.back().ret - 1;
+				frames.pop_back();
+				fp = base + frames.back().base;
+				NEXT;
 			}
-			case IS::Instruction::If_Jmp_Rel_Kind: {
-				if (peek_stack<long double>(stack)) ip += inst.If_Jmp_Rel_.dt_ip - 1;
-				break;
+			OP(Memo_Store): {
+				size_t n     = arg->a & 0xfff;
+				size_t ret_n = arg->a >> 12;
+				auto* key = fp + n;
+				if (!memo_usable(program, key, arg->c)) NEXT;
+
+				memo.insert(arg->b, key, n, sp - ret_n, ret_n);
+				NEXT;
 			}
-			case IS::Instruction::Jmp_Rel_Kind: {
-				ip += inst.Jmp_Rel_.dt_ip - 1;
-				break;
+			OP(Load_Rsp): {
+				push_stack<std::uint64_t>(fp - base, sp);
+				NEXT;
 			}
-			case IS::Instruction::CB2R_Kind: {
-				auto x = pop_stack<std::uint8_t>(stack);
-				push_stack<long double>((long double)x, stack);
-				break;
+			OP(Exit): goto done;
+			OP(CI2R): {
+				auto* slot = sp - sizeof(std::int64_t) - arg->b;
+
+				std::int64_t x;
+				memcpy(&x, slot, sizeof(x));
+				Real r = arg->a ? (Real)(std::uint64_t)x : (Real)x;
+				// A real wider than the int pushes up what's over it.
+				if constexpr (sizeof(Real) > sizeof(x)) {
+					memmove(slot + sizeof(r), slot + sizeof(x), arg->b);
+					sp += sizeof(r) - sizeof(x);
+				}
+				memcpy(slot, &r, sizeof(r));
+				NEXT;
 			}
-			case IS::Instruction::Ret_Kind: {
-				thread_local std::vector<std::uint8_t> temp;
-				temp.clear();
-				temp.insert(
-					std::end(temp),
-					std::end(stack) - inst.Ret_.n,
-					std::end(stack)
-				);
-
-				ip = call_stack.back() - 1;
-				stack.resize(stack_frame.back());
-				memory.resize(memory_stack_frame.back());
-				
-				call_stack.pop_back();
-				stack_frame.pop_back();
-				memory_stack_frame.pop_back();
-
-				stack.insert(
-					std::end(stack),
-					std::begin(temp),
-					std::end(temp)
-				);
-
-				break;
+			OP(CR2I): {
+				auto x = pop_stack<Real>(sp);
+				if (arg->a) push_stack<std::int64_t>((std::uint64_t)x, sp);
+				else                   push_stack<std::int64_t>((std::int64_t)x, sp);
+				NEXT;
+			}
+			OP(CI2B): {
+				auto x = pop_stack<std::int64_t>(sp);
+				push_stack<std::int64_t>((std::uint8_t)x, sp);
+				NEXT;
+			}
+			INT_OP(Add_I, +);
+			INT_OP(Sub_I, -);
+			INT_OP(Mul_I, *);
+			INT_DIV(Div_I, std::int64_t, /, (std::int64_t)(0 - (std::uint64_t)a));
+			INT_DIV(Mod_I, std::int64_t, %, 0);
+			INT_DIV(Div_U, std::uint64_t, /, a / b);
+			INT_DIV(Mod_U, std::uint64_t, %, a % b);
+			INT_CMP(Eq_I, std::int64_t, ==);
+			INT_CMP(Neq_I, std::int64_t, !=);
+			INT_CMP(Lt_I, std::int64_t, <);
+			INT_CMP(Leq_I, std::int64_t, <=);
+			INT_CMP(Gt_I, std::int64_t, >);
+			INT_CMP(Lt_U, std::uint64_t, <);
+			INT_CMP(Leq_U, std::uint64_t, <=);
+			INT_CMP(Gt_U, std::uint64_t, >);
+			OP(Neg_I): {
+				auto x = pop_stack<std::uint64_t>(sp);
+				push_stack<std::uint64_t>(0 - x, sp);
+				NEXT;
+			}
+			OP(Inc_I): {
+				auto x = pop_stack<std::uint64_t>(sp);
+				push_stack<std::uint64_t>(x + 1, sp);
+				NEXT;
+			}
+			OP(Inc_At): {
+				auto* slot = fp + arg->b;
+				Real x;
+				memcpy(&x, slot, sizeof(x));
+				x += 1;
+				memcpy(slot, &x, sizeof(x));
+				NEXT;
+			}
+			OP(Inc_I_At): {
+				auto* slot = fp + arg->b;
+				std::uint64_t x;
+				memcpy(&x, slot, sizeof(x));
+				x += 1;
+				memcpy(slot, &x, sizeof(x));
+				NEXT;
 			}
-			case IS::Instruction::Load_Rsp_Kind: {
-				push_stack<long double>(memory_stack_frame.back(), stack);
-				break;
+			JMP_UNLESS(Jmp_Unless_Eq, Real, ==);
+			JMP_UNLESS(Jmp_Unless_Neq, Real, !=);
+			JMP_UNLESS(Jmp_Unless_Lt, Real, <);
+			JMP_UNLESS(Jmp_Unless_Leq, Real, <=);
+			JMP_UNLESS(Jmp_Unless_Gt, Real, >);
+			JMP_UNLESS(Jmp_Unless_Eq_I, std::int64_t, ==);
+			JMP_UNLESS(Jmp_Unless_Neq_I, std::int64_t, !=);
+			JMP_UNLESS(Jmp_Unless_Lt_I, std::int64_t, <);
+			JMP_UNLESS(Jmp_Unless_Leq_I, std::int64_t, <=);
+			JMP_UNLESS(Jmp_Unless_Gt_I, std::int64_t, >);
+			JMP_UNLESS(Jmp_Unless_Lt_U, std::uint64_t, <);
+			JMP_UNLESS(Jmp_Unless_Leq_U, std::uint64_t, <=);
+			JMP_UNLESS(Jmp_Unless_Gt_U, std::uint64_t, >);
+			OP(Load_Load): {
+				push_stack(sp, fp + arg->a, 8);
+				push_stack(sp, fp + arg->b, 8);
+				NEXT;
 			}
-			case IS::Instruction::Exit_Kind: {
-				ip = program.code.size();
-				break;
+			LOAD_LOAD_OP(Load_Load_Add, Real, +);
+			LOAD_LOAD_OP(Load_Load_Sub, Real, -);
+			LOAD_LOAD_OP(Load_Load_Mul, Real, *);
+			LOAD_LOAD_OP(Load_Load_Add_I, std::uint64_t, +);
+			LOAD_LOAD_OP(Load_Load_Sub_I, std::uint64_t, -);
+			LOAD_LOAD_OP(Load_Load_Mul_I, std::uint64_t, *);
+			OP(Print_Int): {
+				auto x = peek_stack<std::int64_t>(sp);
+				printf("[%zu] %lld\n", ip, (long long)x);
+				NEXT;
 			}
-			case IS::Instruction::Int_Kind: {
-				auto x = pop_stack<long double>(stack);
-				x = (long double)(long long int)x;
-				push_stack<long double>(x, stack);
-				break;
+			OP(Print_Nat): {
+				auto x = peek_stack<std::uint64_t>(sp);
+				printf("[%zu] %llu\n", ip, (unsigned long long)x);
+				NEXT;
 			}
-			default: assert("Not supported"); break;
+		#if !EASE_COMPUTED_GOTO
+			default: assert("Not supported"); NEXT;
 		}
 	}
+	#endif
+done:
+	#undef DECODE
+	#undef DISPATCH
+	#undef NEXT
+	#undef OP
+	return;
 }
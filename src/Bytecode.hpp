@@ -3,14 +3,29 @@
 #include <new>
 #include <any>
 #include <vector>
+#include <optional>
+#include <unordered_set>
 #include <unordered_map>
 
 #include "xstd.hpp"
+#include "Memo.hpp"
 #include "Interpreter.hpp"
+#include "Typer.hpp"
 
 struct Program;
 namespace IS {
 
+	// What the VM computes reals with, bools and comparisons are reals too. An IEEE double by
+	// default: a real takes 8 bytes on the stack, in memory and in the constants like every other
+	// value, and x86-64 computes it with SSE2 scalar instructions. Building with
+	// EASE_LONG_DOUBLE_REALS makes it a long double instead, x87 and 16 bytes on x86-64 Linux.
+	// Code and memory addresses are 8 bytes integers whatever the reals are.
+	#ifdef EASE_LONG_DOUBLE_REALS
+	using Real = long double;
+	#else
+	using Real = double;
+	#endif
+
 	struct Constant {
 		size_t ptr = 0;
 		size_t n = 0;
@@ -21,8 +36,13 @@ namespace IS {
 	struct Push {
 		size_t n = 0;
 	};
-	struct Alloc {
-		size_t n = 0;
+	// First instruction of every function and of the top level code of every file. The frame
+	// starts with the arguments where the caller pushed them, frame is how many bytes its
+	// variables go up to, zeroed past the arguments. Then come the operands, stack is the most
+	// they take. The VM makes room for both there and doesn't check anywhere else.
+	struct Enter {
+		size_t frame = 0;
+		size_t stack = 0;
 	};
 	struct Pop {
 		size_t n = 0;
@@ -34,10 +54,14 @@ namespace IS {
 	struct Load_At {
 		size_t n = 0;
 	};
+	// Like Load_At for a byte, it's pushed as an int.
+	struct Load_At_Byte {};
 	struct Save {
 		size_t memory_ptr = 0;
 		size_t n = 0;
 	};
+	// The n argument bytes on top of the stack stay where they are and start the frame of the
+	// callee. Ret moves the n bytes it returns down to where that frame started.
 	struct Call {
 		size_t f_idx = 0;
 		size_t n = 0;
@@ -45,6 +69,15 @@ namespace IS {
 	struct Call_At {
 		size_t n = 0;
 	};
+	// Like Call_At but in place of the current call, the n argument bytes become the new frame.
+	struct Tail_Call_At {
+		size_t n = 0;
+	};
+	// Call and Tail_Call_At of a proc known at compile time, f_idx is its code address.
+	struct Tail_Call {
+		size_t f_idx = 0;
+		size_t n = 0;
+	};
 	struct Ret {
 		size_t n = 0;
 	};
@@ -54,7 +87,21 @@ namespace IS {
 	struct If_Jmp_Rel {
 		int dt_ip = 0;
 	};
-	struct Int {};
+	// Start and returns of a memoized proc. The lookup returns straight away on a cache hit, and
+	// otherwise keeps a copy of the n argument bytes right after them since the body can
+	// overwrite its parameters. Bit i of proc_mask is set when a proc value starts at byte i of
+	// the arguments, the cache is skipped if that proc isn't pure.
+	struct Memo_Lookup {
+		std::uint32_t function_id = 0;
+		std::uint32_t n = 0;
+		std::uint64_t proc_mask = 0;
+	};
+	struct Memo_Store {
+		std::uint32_t function_id = 0;
+		std::uint16_t n = 0;
+		std::uint16_t ret_n = 0;
+		std::uint64_t proc_mask = 0;
+	};
 	struct Exit {};
 	struct True  {};
 	struct False {};
@@ -74,31 +121,207 @@ namespace IS {
 	struct Print {};
 	struct Print_Byte {};
 	struct Sleep {};
-	struct CB2R {};
 	struct Load_Rsp {};
 
+	// Integer arithmetic on 8 bytes two's complement values, the _U ones are for nats. Like the
+	// real ones, comparisons push a real 0 or 1.
+	struct Add_I {};
+	struct Sub_I {};
+	struct Mul_I {};
+	struct Div_I {};
+	struct Mod_I {};
+	struct Div_U {};
+	struct Mod_U {};
+	struct Eq_I {};
+	struct Neq_I {};
+	struct Lt_I {};
+	struct Leq_I {};
+	struct Gt_I {};
+	struct Lt_U {};
+	struct Leq_U {};
+	struct Gt_U {};
+	struct Neg_I {};
+	struct Inc_I {};
+	struct Print_Int {};
+	struct Print_Nat {};
+
+	// Conversions between integers (int and nat), bytes and reals. On the stack bytes are ints,
+	// CI2B only wraps the int in [0, 255]. CI2R converts the integer that is offset bytes under
+	// the top of the stack.
+	struct CI2R {
+		size_t offset = 0;
+		bool from_nat = false;
+	};
+	struct CR2I {
+		bool to_nat = false;
+	};
+	struct CI2B {};
+
+	// Only made by the peephole pass. Inc_At and Inc_I_At add one to the 8 bytes at memory_ptr
+	// in place, what Stack_Load, Inc, Save did. If_Not_Jmp_Rel pops the condition and jumps when
+	// it's false, the if and for loop both had to pop it after an If_Jmp_Rel.
+	struct Inc_At {
+		size_t memory_ptr = 0;
+	};
+	struct Inc_I_At {
+		size_t memory_ptr = 0;
+	};
+	struct If_Not_Jmp_Rel {
+		int dt_ip = 0;
+	};
+
+	// Superinstructions, picked by the peephole pass from what the count mode shows loops spend
+	// their time on. The Jmp_Unless_ ones pop the two operands of their comparison and jump when
+	// it's false, they are the comparison followed by an If_Not_Jmp_Rel.
+	#define IS_COMPARISON_LIST(X)\
+	X(Eq) X(Neq) X(Lt) X(Leq) X(Gt) X(Eq_I) X(Neq_I) X(Lt_I) X(Leq_I) X(Gt_I) X(Lt_U) X(Leq_U) X(Gt_U)
+
+	#define X(x) struct Jmp_Unless_##x { int dt_ip = 0; };
+	IS_COMPARISON_LIST(X)
+	#undef X
+
+	// Push the 8 bytes at memory_ptr_a then at memory_ptr_b, the _Op ones then do Op on them.
+	// That's two Stack_Load and what follows.
+	struct Load_Load {
+		size_t memory_ptr_a = 0;
+		size_t memory_ptr_b = 0;
+	};
+	#define IS_LOAD_LOAD_LIST(X) X(Add) X(Sub) X(Mul) X(Add_I) X(Sub_I) X(Mul_I)
+
+	#define X(x) struct Load_Load_##x { size_t memory_ptr_a = 0; size_t memory_ptr_b = 0; };
+	IS_LOAD_LOAD_LIST(X)
+	#undef X
+
 
 	#define IS_LIST(X)\
 	X(Constant) X(Neg) X(Not) X(Add) X(Sub) X(Mul) X(Div) X(True) X(False) X(Neq) \
-	X(Print) X(Push) X(Pop) X(Stack_Load) X(Save) X(Alloc) X(Call) X(Ret) \
+	X(Print) X(Push) X(Pop) X(Stack_Load) X(Save) X(Call) X(Ret) \
 	X(Exit) X(Sleep) X(Eq) X(Gt) X(Lt) X(Jmp_Rel) X(If_Jmp_Rel) X(Mod) X(Inc) X(Call_At)\
-	X(Constantf) X(Int) X(Leq) X(Load_At) X(Print_Byte) X(CB2R) X(Load_Rsp)
+	X(Constantf) X(Leq) X(Load_At) X(Load_At_Byte) X(Print_Byte) X(Load_Rsp)\
+	X(Memo_Lookup) X(Memo_Store) X(Tail_Call_At) X(Tail_Call) X(Enter)\
+	X(Add_I) X(Sub_I) X(Mul_I) X(Div_I) X(Mod_I) X(Div_U) X(Mod_U) X(Eq_I) X(Neq_I) X(Lt_I)\
+	X(Leq_I) X(Gt_I) X(Lt_U) X(Leq_U) X(Gt_U) X(Neg_I) X(Inc_I) X(Print_Int) X(Print_Nat)\
+	X(CI2R) X(CR2I) X(CI2B) X(Inc_At) X(Inc_I_At) X(If_Not_Jmp_Rel)\
+	X(Jmp_Unless_Eq) X(Jmp_Unless_Neq) X(Jmp_Unless_Lt) X(Jmp_Unless_Leq) X(Jmp_Unless_Gt)\
+	X(Jmp_Unless_Eq_I) X(Jmp_Unless_Neq_I) X(Jmp_Unless_Lt_I) X(Jmp_Unless_Leq_I)\
+	X(Jmp_Unless_Gt_I) X(Jmp_Unless_Lt_U) X(Jmp_Unless_Leq_U) X(Jmp_Unless_Gt_U)\
+	X(Load_Load) X(Load_Load_Add) X(Load_Load_Sub) X(Load_Load_Mul)\
+	X(Load_Load_Add_I) X(Load_Load_Sub_I) X(Load_Load_Mul_I)
 
 	struct Instruction {
 		sum_type(Instruction, IS_LIST);
 
 		void debug(const Program& program) const noexcept;
 	};
+
+	// The VM runs an encoded copy of the code where every instruction is one 8 bytes word: the
+	// opcode (the Kind) in the low byte, then a 24 bits operand a and a 32 bits operand b. When
+	// the operands of an instruction don't fit, a is Wide and b is its index in Program::wide.
+	using Word = std::uint64_t;
+	struct Operands {
+		std::uint64_t a = 0;
+		std::uint64_t b = 0;
+		std::uint64_t c = 0; // Only in wide operands.
+	};
+	static constexpr std::uint64_t Wide = 0xFFFFFF;
+
+	inline std::uint8_t  opcode   (Word x) noexcept { return (std::uint8_t)x; }
+	inline std::uint64_t operand_a(Word x) noexcept { return (x >> 8) & 0xFFFFFF; }
+	inline std::uint64_t operand_b(Word x) noexcept { return x >> 32; }
+};
+
+// Where in the source each instruction comes from, kept out of the code so the VM never sees it.
+// Consecutive instructions from the same place make one run, every run is varints: how many
+// instructions since the start of the previous run, then the zigzag deltas of its line, offset
+// and length from the previous run's. A checkpoint keeps the whole state every Checkpoint_Every
+// runs, a lookup decodes at most that many.
+struct Line_Table {
+	static constexpr size_t Checkpoint_Every = 32;
+	struct Checkpoint {
+		size_t ip = 0;
+		size_t byte = 0;
+		AST::Source_Code_Loc loc;
+	};
+
+	std::vector<std::uint8_t> bytes;
+	std::vector<Checkpoint>   checkpoints;
+
+	void build(const std::vector<AST::Source_Code_Loc>& locs) noexcept;
+	AST::Source_Code_Loc find(size_t ip) const noexcept;
 };
 
 struct Program {
 	std::vector<std::uint8_t>    data;
 	std::vector<IS::Instruction> code;
+	// The location of each instruction of code while it's compiled and rewritten, encode() packs
+	// it in the line table.
+	std::vector<AST::Source_Code_Loc> locs;
+	Line_Table line_table;
+
+	// What the VM runs, code encoded by encode(). Same indices as code.
+	std::vector<IS::Word>     bytecode;
+	std::vector<IS::Operands> wide;
+
 	std::vector<std::vector<IS::Instruction>> functions;
+	std::vector<std::vector<AST::Source_Code_Loc>> function_locs;
+	// Where in data the code address of each function is stored, to move them with the code.
+	std::vector<size_t> function_constants;
 
 	size_t current_function_idx = 0;
 	std::unordered_map<size_t, std::string> annotations;
 
+	// What the type checker worked out, the code is emitted from it. The program can't run when
+	// it found a type error.
+	Typed_AST typed;
+	bool ok = true;
+
+	// Memoize pure procs, see is_pure_function.
+	bool memoize = true;
+
+	// Small procs are inlined at their calls when it's known statically which proc is called
+	// and it calls nothing itself, up to that many instructions. 0 turns it off.
+	static constexpr size_t Default_Inline_Budget = 64;
+	size_t inline_budget = Default_Inline_Budget;
+	// What inlining a function needs to know, one per functions.
+	struct Inline_Info {
+		// Ret drops what's under the returned value, the jump an inlined return becomes can't.
+		bool balanced = true;
+		bool compiled = false;
+		// What its Enter makes room for, the body then runs on top of our stack.
+		size_t stack = 0;
+		// A local is declared without a value, it counts on Enter zeroing it.
+		bool uninitialized = false;
+	};
+	std::vector<Inline_Info> inline_infos;
+	// The function compiled from each proc definition node.
+	std::unordered_map<size_t, size_t> definition_functions;
+	// Stack size where the body of the function being compiled starts, and the most it went
+	// over it so far. Same for the bytes of its frame, see IS::Enter.
+	size_t current_stack_base = 0;
+	size_t max_stack = 0;
+	size_t max_frame = 0;
+	// Where the Constantf of each import is in code, they point to an import not a function.
+	std::vector<size_t> import_constants;
+	// One per functions, and after linking the code address of every pure proc.
+	std::vector<bool> pure_functions;
+	std::unordered_set<size_t> pure_addresses;
+	// Set while compiling the body of a memoized proc, every return has to store its result.
+	std::optional<IS::Memo_Store> current_memo;
+	// Type the proc being compiled returns, returned values are converted to it.
+	size_t current_return_type = 0;
+
+	// Const declarations and calls of pure procs with constant arguments are worked out by the
+	// interpreter while compiling, up to that many nodes each and with a memo of that capacity
+	// of their own. What takes more is computed when the program runs.
+	static constexpr size_t Evaluation_Steps    = 1 << 20;
+	static constexpr size_t Evaluation_Memo_Cap = 1 << 10;
+	struct Constant_Value {
+		AST_Interpreter::Value value;
+		IS::Constant at;
+	};
+	// By const declaration, the ones whose value is known. They take no memory.
+	std::unordered_map<size_t, Constant_Value> constant_values;
+
 	size_t stack_ptr = 0;
 	size_t memory_stack_ptr = 0;
 
@@ -111,24 +334,133 @@ struct Program {
 	) noexcept;
 	std::vector<IS::Instruction>* get_current_function() noexcept;
 
+	// Needs to be called again every time code is modified.
+	void encode() noexcept;
+	// Where the instruction at ip comes from, from the line table.
+	AST::Source_Code_Loc loc_of(size_t ip) const noexcept;
+
 	void debug() const noexcept;
 };
 
+// A file compiled on its own, its code only knows its own functions, constants and imports by
+// their index in it. link() puts objects one after the other in a program and rewrites what the
+// relocations point at to where it ends up.
+struct Object {
+	std::vector<std::uint8_t> data;
+	// The top level code then every function, each one starts at its index in functions.
+	std::vector<IS::Instruction> code;
+	std::vector<AST::Source_Code_Loc> locs;
+	std::vector<size_t> functions;
+	std::vector<bool> pure_functions;
+
+	struct Export {
+		Extern_Proc proc;
+		size_t function = 0;
+	};
+	// The top level procs another file can call, and the ones of other files this one calls.
+	std::vector<Export> exports;
+	std::vector<Extern_Proc> imports;
+
+	struct Relocation {
+		enum Kind {
+			// The index of one of our functions: Call, Tail_Call, Constantf and the Memo ones.
+			Function,
+			// An offset in our data: Constant.
+			Data,
+			// The index of one of our imports: Constantf.
+			Import
+		};
+		Kind kind = Function;
+		size_t ip = 0;
+	};
+	std::vector<Relocation> relocations;
+
+	bool ok = true;
+
+	size_t top_level_size() const noexcept {
+		return functions.empty() ? code.size() : functions.front();
+	}
+};
+
+// The top level procs of a file that can be exported, see Extern_Proc. Only looks at their
+// declarations, it's known before any file is compiled what they can call in each other.
+extern std::vector<Extern_Proc> exports_of(
+	const std::vector<AST::Node>& nodes, std::string_view file
+) noexcept;
+
+// Compiles a file that calls the imports as if they were declared before its first line. Only
+// the ones it names are kept in the object. The top level procs are compiled on that many
+// threads, 0 for one per core.
+extern Object compile_object(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file,
+	const std::vector<Extern_Proc>& imports = {},
+	size_t inline_budget = Program::Default_Inline_Budget,
+	size_t threads = 0
+) noexcept;
+
+// Runs the top level code of the objects in order, an import calls the first other object
+// exporting it. The program isn't ok if one can't be found. See Link.cpp.
+extern Program link(const std::vector<Object>& objects) noexcept;
+
+// A single file, compiled to an object and linked.
 extern Program compile(
 	const std::vector<AST::Node>& nodes,
-	std::string_view file
+	std::string_view file,
+	size_t inline_budget = Program::Default_Inline_Budget,
+	size_t threads = 0
 ) noexcept;
 
+// Rewrites the linked code of the program with cheaper sequences, interns its constants and
+// encodes it again, see Peephole.cpp.
+extern void peephole(Program& program) noexcept;
+
+// Writes the program to a .winc file, and maps one back ready to run without compiling anything.
+// See Winc.cpp for the format, loading refuses a file that doesn't check out. A loaded program
+// has its bytecode but not the code it was encoded from.
+extern bool save_program(const Program& program, const char* path) noexcept;
+extern bool load_program(Program& program, const char* path) noexcept;
+
+// Bytes an instruction copies to and from the stack and the memory, values counted as 8 bytes.
+// It's an estimate of the memory traffic to compare with the register VM, see the bench mode.
+extern size_t memory_traffic(const Program& program, size_t ip) noexcept;
+
 struct Bytecode_VM {
+	// The frames of the calls one after the other, each one followed by its operands. It's as
+	// big as the Enter instructions that ran asked for, it starts with Initial_Stack bytes and
+	// at least doubles when one needs more. Addresses are offsets in it.
+	static constexpr size_t Initial_Stack = 1 << 16;
 	std::vector<std::uint8_t> stack;
-	std::vector<std::uint8_t> memory;
 
-	std::vector<size_t> call_stack;
-	std::vector<size_t> stack_frame;
-	std::vector<size_t> memory_stack_frame;
+	// The calls in progress, the top level is the first one.
+	struct Frame {
+		// Code address to return to.
+		size_t ret = 0;
+		// Offset of the frame in stack.
+		size_t base = 0;
+	};
+	std::vector<Frame> frames;
 
 	size_t immediate_register = 0;
 
+	// The code decoded before it runs, one per instruction and an Exit past the end. The handler
+	// is the address of the code running the instruction with computed gotos, its opcode with
+	// the switch. The operands are unpacked, wide ones included.
+	struct Decoded {
+		std::uintptr_t handler = 0;
+		std::uint64_t a = 0;
+		std::uint64_t b = 0;
+		std::uint64_t c = 0;
+	};
+	std::vector<Decoded> decoded;
+
+	Memo_Cache memo;
+
+	// Counts the opcodes run when set, see Opcode_Profiler.
+	Opcode_Profiler* profiler = nullptr;
+
 	void execute(const Program& prog) noexcept;
+	// Reports a run time error at ip with the lines of the calls that led there.
+	void fault(const Program& prog, size_t ip, const char* what) const noexcept;
 
 };
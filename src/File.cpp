@@ -1,8 +1,20 @@
 #include "File.hpp"
+#include "xstd.hpp"
 
 #include <stdio.h>
 #include <algorithm>
 
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 void read_whole_text(
 	const std::filesystem::path& path, char* out_buffer, size_t out_buffer_size
 ) noexcept {
@@ -34,4 +46,81 @@ std::string read_whole_text(const std::filesystem::path& path) noexcept {
 
 	fclose(file);
 	return result;
-}
\ No newline at end of file
+}
+bool write_whole_file(const std::filesystem::path& path, const void* data, size_t size) noexcept {
+	FILE* file = fopen(path.generic_string().c_str(), "wb");
+	if (!file) return false;
+
+	bool ok = fwrite(data, 1, size, file) == size;
+	ok &= fclose(file) == 0;
+	return ok;
+}
+
+#ifdef _WIN32
+
+bool Mapped_File::open(const std::filesystem::path& path) noexcept {
+	close();
+
+	HANDLE file = CreateFileW(
+		path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr
+	);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	defer { CloseHandle(file); };
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) return false;
+
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) return false;
+
+	auto* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	data = (const std::uint8_t*)view;
+	size = (size_t)file_size.QuadPart;
+	handle = mapping;
+	return true;
+}
+
+void Mapped_File::close() noexcept {
+	if (data) UnmapViewOfFile(data);
+	if (handle) CloseHandle(handle);
+	data = nullptr;
+	size = 0;
+	handle = nullptr;
+}
+
+#else
+
+bool Mapped_File::open(const std::filesystem::path& path) noexcept {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	defer { ::close(fd); };
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) return false;
+
+	auto* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) return false;
+
+	data = (const std::uint8_t*)view;
+	size = (size_t)st.st_size;
+	return true;
+}
+
+void Mapped_File::close() noexcept {
+	if (data) munmap((void*)data, size);
+	data = nullptr;
+	size = 0;
+}
+
+#endif
+
+Mapped_File::~Mapped_File() noexcept {
+	close();
+}
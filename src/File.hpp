@@ -1,9 +1,30 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 #include <filesystem>
 
 extern void read_whole_text(
 	const std::filesystem::path& path, char* out_buffer, size_t out_buffer_size
 ) noexcept;
-extern std::string read_whole_text(const std::filesystem::path& path) noexcept;
\ No newline at end of file
+extern std::string read_whole_text(const std::filesystem::path& path) noexcept;
+extern bool write_whole_file(
+	const std::filesystem::path& path, const void* data, size_t size
+) noexcept;
+
+// A whole file mapped read-only in memory, unmapped when it goes away.
+struct Mapped_File {
+	const std::uint8_t* data = nullptr;
+	size_t size = 0;
+
+	Mapped_File() noexcept = default;
+	Mapped_File(const Mapped_File&) = delete;
+	Mapped_File& operator=(const Mapped_File&) = delete;
+	~Mapped_File() noexcept;
+
+	bool open(const std::filesystem::path& path) noexcept;
+	void close() noexcept;
+
+private:
+	void* handle = nullptr;
+};
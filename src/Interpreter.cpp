@@ -1,4 +1,5 @@
 #include "Interpreter.hpp"
+#include "Analysis.hpp"
 #include "AST.hpp"
 
 #include "xstd.hpp"
@@ -8,8 +9,41 @@
 
 using Value = AST_Interpreter::Value;
 using Type = AST_Interpreter::Type;
+using Identifier = AST_Interpreter::Identifier;
+using Pointer = AST_Interpreter::Pointer;
+using Real = AST_Interpreter::Real;
+using Int = AST_Interpreter::Int;
+
+// What goes wrong while interpreting, see AST_Interpreter::quiet.
+#define report(x, ...) do { failed = true; if (!quiet) println(x, __VA_ARGS__); } while (false)
+#define reports(x)     do { failed = true; if (!quiet) printlns(x); } while (false)
+
+// A number is true when it isn't 0, like in the compiled code. False for what's neither that
+// nor a bool.
+static bool to_condition(Value& x) noexcept {
+	if (x.typecheck(Value::Int_Kind))  x = AST_Interpreter::Bool{ x.Int_.x != 0 };
+	if (x.typecheck(Value::Real_Kind)) x = AST_Interpreter::Bool{ x.Real_.x != 0 };
+	return x.typecheck(Value::Bool_Kind);
+}
 
 Value AST_Interpreter::interpret(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
+	// Nothing runs anymore once something went wrong, what's on the way out gets None.
+	if (failed || !steps_left) {
+		failed = true;
+		return nullptr;
+	}
+	steps_left--;
+
+	if (profiler) {
+		profiler->enter_node(idx, nodes[idx]->loc.line);
+		auto v = dispatch(nodes, idx, file);
+		profiler->exit_node();
+		return v;
+	}
+	return dispatch(nodes, idx, file);
+}
+
+Value AST_Interpreter::dispatch(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
 	auto& node = nodes[idx];
 	switch (node.kind) {
 	case AST::Node::Identifier_Kind:          return identifier   (nodes, idx, file);
@@ -46,24 +80,28 @@ Value AST_Interpreter::interpret(
 	Value v;
 	for (size_t idx = f.start_idx; idx; idx = nodes[idx]->next_statement) {
 		v = interpret(nodes, idx, file);
+		if (failed) return nullptr;
 		if (v.typecheck(Value::Return_Call_Kind)) break;
 	}
 
 	if (!v.typecheck(Value::Return_Call_Kind) && !f.return_type.empty()) {
-		printlns("Reached end of non void returning function.");
+		reports("Reached end of non void returning function.");
 		return nullptr;
 	}
 	if (!v.typecheck(Value::Return_Call_Kind)) return nullptr;
 	auto& r = v.Return_Call_;
+	if (r.tail_call) return v;
 	if (r.values.size() != f.return_type.size()) {
-		println(
+		report(
 			"Trying to return from a function with wrong number of return parameters, "
 			"expected %zu got %zu.", f.return_type.size(), r.values.size()
 		);
 		return nullptr;
 	}
 
-	return r.values.empty() ? nullptr : at(r.values.front());
+	// A None returned has no type, see create_id.
+	if (r.values.empty() || !r.values.front().type_descriptor_id) return nullptr;
+	return convert(at(r.values.front()), f.return_type.front());
 }
 
 Value AST_Interpreter::init_list(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
@@ -78,8 +116,15 @@ Value AST_Interpreter::init_list(AST_Nodes nodes, size_t idx, std::string_view f
 
 		switch (type.kind) {
 			case Type::Real_Type_Kind:
+			case Type::Int_Type_Kind:
+			case Type::Nat_Type_Kind:
+			case Type::Byte_Type_Kind:
 				copy(
-					interpret(nodes, node.expression_list_idx, file), new_identifier.memory_idx
+					convert(
+						interpret(nodes, node.expression_list_idx, file),
+						new_identifier.type_descriptor_id
+					),
+					new_identifier.memory_idx
 				);
 				break;
 			case Type::Array_View_Type_Kind: {
@@ -93,9 +138,10 @@ Value AST_Interpreter::init_list(AST_Nodes nodes, size_t idx, std::string_view f
 					idx;
 					idx = nodes[idx]->next_statement, i++
 				) {
-					auto underlying_type = types[type.Array_View_Type_.user_type_descriptor_idx];
+					auto underlying_id = type.Array_View_Type_.user_type_descriptor_idx;
+					auto underlying_type = types[underlying_id];
 					copy(
-						interpret(nodes, idx, file),
+						convert(interpret(nodes, idx, file), underlying_id),
 						array_data + i * underlying_type.get_size()
 					);
 				}
@@ -116,7 +162,7 @@ Value AST_Interpreter::init_list(AST_Nodes nodes, size_t idx, std::string_view f
 					idx = nodes[idx]->next_statement, i++
 				)
 					copy(
-						interpret(nodes, idx, file),
+						convert(interpret(nodes, idx, file), user_struct.member_types[i]),
 						new_identifier.memory_idx + user_struct.member_offsets[i]
 					);
 
@@ -129,12 +175,12 @@ Value AST_Interpreter::init_list(AST_Nodes nodes, size_t idx, std::string_view f
 				break;
 			}
 			default:
-				printlns("TODO");
+				reports("TODO");
 				break;
 		}
 		return new_identifier;
 	}
-	printlns("Please specify the type explicitely.");
+	reports("Please specify the type explicitely.");
 
 	return nullptr;
 }
@@ -146,8 +192,12 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 		case AST::Operator::Minus: {
 			auto x = interpret(nodes, node.right_idx, file);
 			if (x.typecheck(Value::Identifier_Kind)) x = at(x.cast<Identifier>());
-			if (x.typecheck(Value::Real_Kind)) {
-				println("Type error, expected long double got %s", x.name());
+			if (x.typecheck(Value::Int_Kind)) {
+				// -x of a nat or a byte is an int.
+				return Int{ (std::int64_t)(0 - (std::uint64_t)x.Int_.x) };
+			}
+			if (!x.typecheck(Value::Real_Kind)) {
+				report("Type error, expected a number got %s", x.name());
 				return nullptr;
 			}
 			return Real{ -x.cast<Real>().x };
@@ -155,25 +205,36 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 		case AST::Operator::Plus: {
 			auto x = interpret(nodes, node.right_idx, file);
 			if (x.typecheck(Value::Identifier_Kind)) x = at(x.cast<Identifier>());
-			if (x.typecheck(Value::Real_Kind)) {
-				println("Type error, expected long double got %s", x.name());
+			if (!x.typecheck(Value::Real_Kind) && !x.typecheck(Value::Int_Kind)) {
+				report("Type error, expected a number got %s", x.name());
 				return nullptr;
 			}
-			return Real{ +x.cast<Real>().x };
+			return x;
 		}
 		case AST::Operator::Inc: {
 			auto x = interpret(nodes, node.right_idx, file);
 			if (!x.typecheck(Value::Identifier_Kind)) {
-				println("Type error, expected identifier got %s", x.name());
+				report("Type error, expected identifier got %s", x.name());
 				return nullptr;
 			}
 
-			if (x.cast<Identifier>().type_descriptor_id != Real_Type::unique_id)  {
-				println("Type error, expected long double got %s", x.name());
+			auto id = x.cast<Identifier>();
+			if (id.type_descriptor_id == Byte_Type::unique_id) {
+				memory[id.memory_idx]++;
+				return id;
+			}
+			if (is_integer(id.type_descriptor_id)) {
+				std::uint64_t v;
+				memcpy(&v, memory.data() + id.memory_idx, sizeof(v));
+				v++;
+				memcpy(memory.data() + id.memory_idx, &v, sizeof(v));
+				return id;
+			}
+			if (id.type_descriptor_id != Real_Type::unique_id)  {
+				report("Type error, expected a number got %s", x.name());
 				return nullptr;
 			}
 
-			auto id = x.cast<Identifier>();
 			long double v;
 			memcpy(&v, memory.data() + id.memory_idx, sizeof(long double));
 			v++;
@@ -184,7 +245,7 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 		case AST::Operator::Amp: {
 			auto x = interpret(nodes, node.right_idx, file);
 			if (!x.typecheck(Value::Identifier_Kind)) {
-				println("Type error, expected Identifier got %s", x.name());
+				report("Type error, expected Identifier got %s", x.name());
 				return nullptr;
 			}
 
@@ -197,7 +258,7 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 			auto x = interpret(nodes, node.right_idx, file);
 			if (x.typecheck(Value::Identifier_Kind)) x = at(x.cast<Identifier>());
 			if (!x.typecheck(Value::Pointer_Kind)) {
-				println("Type error, expected Pointer got %s", x.name());
+				report("Type error, expected Pointer got %s", x.name());
 				return nullptr;
 			}
 
@@ -209,8 +270,8 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 		case AST::Operator::Not: {
 			auto x = interpret(nodes, node.right_idx, file);
 			if (x.typecheck(Value::Identifier_Kind)) x = at(x.cast<Identifier>());
-			if (!x.typecheck(Value::Bool_Kind)) {
-				println("Type error, expected Bool got %s", x.name());
+			if (!to_condition(x)) {
+				report("Type error, expected Bool got %s", x.name());
 				return nullptr;
 			}
 
@@ -223,202 +284,41 @@ Value AST_Interpreter::unary_op(AST_Nodes nodes, size_t idx, std::string_view fi
 Value AST_Interpreter::list_op(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
 	auto& node = nodes[idx].Operation_List_;
 	switch(node.op) {
-		case AST::Operator::Gt: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-			
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Bool{ left.cast<Real>().x > right.cast<Real>().x };
-		}
-		case AST::Operator::Eq: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-			
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Bool{ left.cast<Real>().x == right.cast<Real>().x };
-		}
-		case AST::Operator::Neq: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-			
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Bool{ left.cast<Real>().x != right.cast<Real>().x };
-		}
-		case AST::Operator::Lt: {
+		case AST::Operator::Gt:
+		case AST::Operator::Eq:
+		case AST::Operator::Neq:
+		case AST::Operator::Lt:
+		case AST::Operator::Leq:
+		case AST::Operator::Star:
+		case AST::Operator::Div:
+		case AST::Operator::Mod:
+		case AST::Operator::Minus: {
 			auto left  = interpret(nodes, node.left_idx, file);
 			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Bool{ left.cast<Real>().x < right.cast<Real>().x };
+			return arithmetic(node.op, left, right);
 		}
 		case AST::Operator::Assign: {
 			auto left  = interpret(nodes, node.left_idx, file);
 			auto right = interpret(nodes, node.rest_idx, file);
 
 			if (!left.typecheck(Value::Identifier_Kind)) {
-				println("Error expected Identifier for the lhs, got %s", left.name());
+				report("Error expected Identifier for the lhs, got %s", left.name());
 				return nullptr;
 			}
-			copy(right, left.Identifier_.memory_idx);
+			copy(
+				convert(right, left.Identifier_.type_descriptor_id), left.Identifier_.memory_idx
+			);
 			return left;
 		}
-		case AST::Operator::Leq: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Bool{ left.cast<Real>().x <= right.cast<Real>().x };
-		}
 		case AST::Operator::Plus: {
-			Real sum{ 0 };
-			auto left  = interpret(nodes, node.left_idx, file);
-			if (left.typecheck(Value::Identifier_Kind)) left  = at(left.cast<Identifier>());
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-
-			sum.x = left.Real_.x;
+			auto sum = interpret(nodes, node.left_idx, file);
 			for (size_t i = node.rest_idx; i; i = nodes[i]->next_statement) {
-				auto right = interpret(nodes, i, file);
-				if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-				if (!right.typecheck(Value::Real_Kind)) {
-					println("Error expected long double for the rhs, got %s", right.name());
-					return nullptr;
-				}
-
-				sum.x += right.Real_.x;
+				sum = arithmetic(node.op, sum, interpret(nodes, i, file));
+				if (sum.typecheck(Value::None_Kind)) return nullptr;
 			}
 
 			return sum;
 		}
-		case AST::Operator::Star: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Real{ left.cast<Real>().x * right.cast<Real>().x };
-		}
-		case AST::Operator::Div: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Real{ left.cast<Real>().x / right.cast<Real>().x };
-		}
-		case AST::Operator::Mod: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Real{ std::fmodl(left.cast<Real>().x, right.cast<Real>().x) };
-		}
-		case AST::Operator::Minus: {
-			auto left  = interpret(nodes, node.left_idx, file);
-			auto right = interpret(nodes, node.rest_idx, file);
-
-			if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
-			if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
-			
-			if (!left.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the lhs, got %s", left.name());
-				return nullptr;
-			}
-			if (!right.typecheck(Value::Real_Kind)) {
-				println("Error expected long double for the rhs, got %s", right.name());
-				return nullptr;
-			}
-
-			return Real{ left.cast<Real>().x - right.cast<Real>().x };
-		}
 		case AST::Operator::Dot: {
 			auto root_struct = interpret(nodes, node.left_idx, file);
 			if ( root_struct.typecheck(Value::Pointer_Kind)) {
@@ -428,7 +328,7 @@ Value AST_Interpreter::list_op(AST_Nodes nodes, size_t idx, std::string_view fil
 				root_struct = id;
 			}
 			if (!root_struct.typecheck(Value::Identifier_Kind)) {
-				println("Expected an Identifier but got %s instead.", root_struct.name());
+				report("Expected an Identifier but got %s instead.", root_struct.name());
 				return nullptr;
 			}
 
@@ -461,7 +361,7 @@ Value AST_Interpreter::list_op(AST_Nodes nodes, size_t idx, std::string_view fil
 						return next_id;
 					}
 					default:
-						printlns("Should not happen.");
+						reports("Should not happen.");
 						return {};
 				}
 			};
@@ -469,19 +369,149 @@ Value AST_Interpreter::list_op(AST_Nodes nodes, size_t idx, std::string_view fil
 			return helper(root_struct.Identifier_, node.rest_idx, helper);
 		}
 		default:{
-			println("Unsupported operation %s", AST::op_to_string(node.op));
+			report("Unsupported operation %s", AST::op_to_string(node.op));
 			return nullptr;
 		}
 	}
 }
 
+static long double int_to_real(const Int& x) noexcept {
+	if (x.type_descriptor_id == AST_Interpreter::Nat_Type::unique_id)
+		return (long double)(std::uint64_t)x.x;
+	return (long double)x.x;
+}
+
+bool AST_Interpreter::is_integer(size_t type_id) noexcept {
+	return
+		type_id == Int_Type::unique_id ||
+		type_id == Nat_Type::unique_id ||
+		type_id == Byte_Type::unique_id;
+}
+
+bool AST_Interpreter::parse_integer(std::string_view litteral, std::int64_t& x) noexcept {
+	for (auto c : litteral) if (c < '0' || c > '9') return false;
+
+	auto end = litteral.data() + litteral.size();
+	auto res = std::from_chars(litteral.data(), end, x);
+	return res.ec == std::errc() && res.ptr == end;
+}
+
+// Integers stay integers as long as both sides are, the result is a nat if one of them is.
+// Otherwise the integer side is promoted to a real.
+Value AST_Interpreter::arithmetic(AST::Operator op, Value left, Value right) noexcept {
+	if (left .typecheck(Value::Identifier_Kind)) left  = at(left .cast<Identifier>());
+	if (right.typecheck(Value::Identifier_Kind)) right = at(right.cast<Identifier>());
+
+	if (!left.typecheck(Value::Real_Kind) && !left.typecheck(Value::Int_Kind)) {
+		report("Error expected a number for the lhs, got %s", left.name());
+		return nullptr;
+	}
+	if (!right.typecheck(Value::Real_Kind) && !right.typecheck(Value::Int_Kind)) {
+		report("Error expected a number for the rhs, got %s", right.name());
+		return nullptr;
+	}
+
+	if (left.typecheck(Value::Int_Kind) && right.typecheck(Value::Int_Kind)) {
+		bool is_nat =
+			left .Int_.type_descriptor_id == Nat_Type::unique_id ||
+			right.Int_.type_descriptor_id == Nat_Type::unique_id;
+		size_t type = is_nat ? Nat_Type::unique_id : Int_Type::unique_id;
+
+		// Add, sub and mul wrap around, done on unsigned to not be UB.
+		std::int64_t  a = left.Int_.x;
+		std::int64_t  b = right.Int_.x;
+		std::uint64_t ua = a;
+		std::uint64_t ub = b;
+
+		switch (op) {
+		case AST::Operator::Plus:  return Int{ (std::int64_t)(ua + ub), type };
+		case AST::Operator::Minus: return Int{ (std::int64_t)(ua - ub), type };
+		case AST::Operator::Star:  return Int{ (std::int64_t)(ua * ub), type };
+		case AST::Operator::Div:
+		case AST::Operator::Mod: {
+			if (!b) {
+				reports("Error integer division by zero.");
+				return nullptr;
+			}
+			if (is_nat) {
+				auto x = op == AST::Operator::Div ? ua / ub : ua % ub;
+				return Int{ (std::int64_t)x, type };
+			}
+			// INT64_MIN / -1 overflows.
+			if (b == -1) return Int{ op == AST::Operator::Div ? (std::int64_t)(0 - ua) : 0, type };
+			return Int{ op == AST::Operator::Div ? a / b : a % b, type };
+		}
+		case AST::Operator::Eq:  return Bool{ a == b };
+		case AST::Operator::Neq: return Bool{ a != b };
+		case AST::Operator::Lt:  return Bool{ is_nat ? ua <  ub : a <  b };
+		case AST::Operator::Leq: return Bool{ is_nat ? ua <= ub : a <= b };
+		case AST::Operator::Gt:  return Bool{ is_nat ? ua >  ub : a >  b };
+		default: break;
+		}
+	} else {
+		long double a = left .typecheck(Value::Int_Kind) ? int_to_real(left .Int_) : left .Real_.x;
+		long double b = right.typecheck(Value::Int_Kind) ? int_to_real(right.Int_) : right.Real_.x;
+
+		switch (op) {
+		case AST::Operator::Plus:  return Real{ a + b };
+		case AST::Operator::Minus: return Real{ a - b };
+		case AST::Operator::Star:  return Real{ a * b };
+		case AST::Operator::Div:   return Real{ a / b };
+		case AST::Operator::Mod:   return Real{ std::fmodl(a, b) };
+		case AST::Operator::Eq:    return Bool{ a == b };
+		case AST::Operator::Neq:   return Bool{ a != b };
+		case AST::Operator::Lt:    return Bool{ a <  b };
+		case AST::Operator::Leq:   return Bool{ a <= b };
+		case AST::Operator::Gt:    return Bool{ a >  b };
+		default: break;
+		}
+	}
+
+	report("Unsupported operation %s", AST::op_to_string(op));
+	return nullptr;
+}
+
+// Converts numbers to the type they are going to be stored in, anything else is returned as is.
+Value AST_Interpreter::convert(const Value& x, size_t type_id) noexcept {
+	bool to_real = type_id == Real_Type::unique_id;
+	if (!to_real && !is_integer(type_id)) return x;
+
+	Value v = x;
+	if (v.typecheck(Value::Identifier_Kind)) {
+		auto from = v.Identifier_.type_descriptor_id;
+		if (from == type_id) return x;
+		if (from != Real_Type::unique_id && !is_integer(from)) return x;
+		v = at(v.Identifier_);
+	}
+
+	if (v.typecheck(Value::Real_Kind)) {
+		if (to_real) return v;
+
+		Int r;
+		r.type_descriptor_id = type_id;
+		if (type_id == Nat_Type::unique_id) r.x = (std::int64_t)(std::uint64_t)v.Real_.x;
+		else                                r.x = (std::int64_t)v.Real_.x;
+		if (type_id == Byte_Type::unique_id) r.x &= 0xff;
+		return r;
+	}
+	if (v.typecheck(Value::Int_Kind)) {
+		if (to_real) return Real{ int_to_real(v.Int_) };
+
+		Int r = v.Int_;
+		r.type_descriptor_id = type_id;
+		if (type_id == Byte_Type::unique_id) r.x &= 0xff;
+		return r;
+	}
+	return x;
+}
+
 Value AST_Interpreter::if_call(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
 	auto& node = nodes[idx].If_;
 
 	auto cond = interpret(nodes, node.condition_idx, file);
 	if (cond.typecheck(Value::Identifier_Kind)) cond = at(cond.cast<Identifier>());
-	if (!cond.typecheck(Value::Bool_Kind)) {
-		println("Expected bool on the if-condition got %s.", cond.name());
+	if (!to_condition(cond)) {
+		report("Expected bool or a number on the if-condition got %s.", cond.name());
 		return nullptr;
 	}
 
@@ -509,8 +539,8 @@ Value AST_Interpreter::for_loop(AST_Nodes nodes, size_t idx, std::string_view fi
 	while (true) {
 		auto cond = interpret(nodes, node.cond_statement_idx, file);
 		if (cond.typecheck(Value::Identifier_Kind)) cond = at(cond.cast<Identifier>());
-		if (!cond.typecheck(Value::Bool_Kind)) {
-			println("Expected bool on the for-condition got %s.", cond.name());
+		if (!to_condition(cond)) {
+			report("Expected bool or a number on the for-condition got %s.", cond.name());
 			return nullptr;
 		}
 
@@ -537,8 +567,8 @@ Value AST_Interpreter::while_loop(AST_Nodes nodes, size_t idx, std::string_view
 	while (true) {
 		auto cond = interpret(nodes, node.cond_statement_idx, file);
 		if (cond.typecheck(Value::Identifier_Kind)) cond = at(cond.cast<Identifier>());
-		if (!cond.typecheck(Value::Bool_Kind)) {
-			println("Expected bool on the while-condition got %s.", cond.name());
+		if (!to_condition(cond)) {
+			report("Expected bool or a number on the while-condition got %s.", cond.name());
 			return nullptr;
 		}
 
@@ -587,7 +617,9 @@ Type AST_Interpreter::function(AST_Nodes nodes, size_t idx, std::string_view fil
 
 	User_Function_Type f;
 	f.start_idx = node.statement_list_idx;
+	f.definition_idx = idx;
 	f.is_method = node.is_method;
+	f.is_pure = is_pure_function(nodes, idx, file);
 
 	for (size_t idx = node.parameter_list_idx; idx; idx = nodes[idx]->next_statement) {
 		auto& param = nodes[idx].Declaration_;
@@ -612,49 +644,141 @@ Type AST_Interpreter::function(AST_Nodes nodes, size_t idx, std::string_view fil
 
 Value AST_Interpreter::function_call(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
 	auto& node = nodes[idx].Function_Call_;
-	thread_local std::vector<Identifier> arguments;
-	arguments.clear();
+
+	size_t argument_base = argument_stack.size();
+	defer { argument_stack.resize(argument_base); };
 
 	for (size_t idx = node.argument_list_idx, i = 0; idx; idx = nodes[idx]->next_statement, i++) {
 		auto& param = nodes[idx].Argument_;
 		auto x = interpret(nodes, param.value_idx, file);
-		arguments.push_back(create_id(x));
+		argument_stack.push_back(create_id(x));
 	}
+	if (failed) return nullptr;
+
+	// Only take the view once every argument is evaluated, nested calls may have grown the stack.
+	std::span<const Identifier> arguments(
+		argument_stack.data() + argument_base, argument_stack.size() - argument_base
+	);
 
 	auto any_id = interpret(nodes, node.identifier_idx, file);
-	auto name = string_from_view(file, nodes[node.identifier_idx].Identifier_.token.lexeme);
+	if (any_id.typecheck(Value::None_Kind)) return nullptr;
 	if (!any_id.typecheck(Value::Identifier_Kind)) {
-		return any_id.cast<Builtin>().f(arguments);
+		return any_id.Builtin_.f(*this, arguments);
 	}
 	auto id = any_id.cast<Identifier>();
+	auto f = &types.at(id.type_descriptor_id).User_Function_Type_;
+
+	// Numbers take the type of the parameter they are bound to, f(1) passes a real to
+	// `f := proc (x : real)`.
+	auto convert_arguments = [&] {
+		for (size_t i = 0; i < arguments.size() && i < f->parameter_type.size(); ++i) {
+			auto v = convert(arguments[i], f->parameter_type[i]);
+			if (!v.typecheck(Value::Identifier_Kind)) argument_stack[argument_base + i] = create_id(v);
+		}
+	};
+	convert_arguments();
+
+	std::uint8_t key[Memo_Cache::Max_Key_Size];
+	size_t key_size = 0;
+	bool memoized = memoize && f->is_pure && memo_key(arguments, key, key_size);
+	size_t memo_id = f->unique_id;
+	if (memoized) {
+		// The first byte tells the kind of the value that was returned.
+		if (auto entry = memo.find(memo_id, key, key_size)) {
+			if (entry->value[0] == Value::Bool_Kind) return Bool{ entry->value[1] != 0 };
+			if (entry->value[0] == Value::Int_Kind) {
+				Int i;
+				i.type_descriptor_id = entry->value[1];
+				memcpy(&i.x, entry->value + 2, sizeof(i.x));
+				return i;
+			}
+
+			Real r;
+			memcpy(&r.x, entry->value + 1, sizeof(r.x));
+			return r;
+		}
+	}
 
 	push_scope();
-	scopes.back().fence = true;
-	defer { pop_scope(); };
+	call_depth++;
 
-	auto f = &types.at(id.type_descriptor_id).User_Function_Type_;
+	// The chain returns what the last call returns, converted to what the first one returns.
+	auto* called = f;
+	size_t old_method_scope = method_scope;
+	defer {
+		pop_scope();
+		call_depth--;
+		method_scope = old_method_scope;
+	};
 
-	if (f->is_method) {
-		assert(id.parent_idx);
-		assert(id.parent_type_descriptor_id);
+	Value v;
+	while (true) {
+		// Every tail call of this chain runs in the same scope, so `return f(...)` loops don't grow
+		// the scopes nor the native stack.
+		auto& scope = scopes.back();
+		scope.fence = true;
+		scope.self_idx = 0;
+		scope.self_type = nullptr;
+		scope.variables.clear();
+		method_scope = 0;
+
+		if (f->is_method) {
+			assert(id.parent_idx);
+			assert(id.parent_type_descriptor_id);
+
+			auto& parent_struct = types.at(id.parent_type_descriptor_id);
+			assert(parent_struct.typecheck(Type::User_Struct_Type_Kind));
+
+			scope.self_idx = id.parent_idx;
+			scope.self_type = &parent_struct.User_Struct_Type_;
+			method_scope = scopes.size() - 1;
+		}
 
-		auto parent_struct = types.at(id.parent_type_descriptor_id);
-		assert(parent_struct.typecheck(Type::User_Struct_Type_Kind));
+		for (size_t i = 0; i < arguments.size(); ++i) {
+			auto name = f->parameter_name[i];
+			new_variable(name, arguments[i]);
+		}
 
-		for (auto& [name, i] : parent_struct.User_Struct_Type_.name_to_idx) {
-			Identifier member;
-			member.memory_idx = parent_struct.User_Struct_Type_.member_offsets[i] + id.parent_idx;
-			member.type_descriptor_id = parent_struct.User_Struct_Type_.member_types[i];
-			new_variable(name, member);
+		if (profiler) {
+			profiler->enter_function(f->definition_idx, f->name);
+			v = interpret(nodes, *f, file);
+			profiler->exit_function();
+		} else {
+			v = interpret(nodes, *f, file);
 		}
-	}
 
-	for (size_t i = 0; i < arguments.size(); ++i) {
-		auto name = f->parameter_name[i];
-		new_variable(name, arguments[i]);
-	}
+		if (!v.typecheck(Value::Return_Call_Kind)) break;
 
-	return interpret(nodes, *f, file);
+		// The tail call's arguments replace ours at the base of the argument stack.
+		auto& tail = v.Return_Call_;
+		argument_stack.erase(
+			argument_stack.begin() + argument_base,
+			argument_stack.begin() + tail.argument_base
+		);
+		arguments = std::span<const Identifier>(
+			argument_stack.data() + argument_base, argument_stack.size() - argument_base
+		);
+		id = tail.callee;
+		f = &types.at(id.type_descriptor_id).User_Function_Type_;
+		convert_arguments();
+	}
+	if (f != called && !called->return_type.empty()) v = convert(v, called->return_type.front());
+
+	// Our result is the one of the last call of the chain, it's fine to remember it for our key.
+	bool memoizable =
+		v.typecheck(Value::Real_Kind) || v.typecheck(Value::Bool_Kind) || v.typecheck(Value::Int_Kind);
+	if (memoized && memoizable) {
+		std::uint8_t value[2 + sizeof(long double)] = { (std::uint8_t)v.kind };
+		if (v.typecheck(Value::Bool_Kind)) value[1] = v.Bool_.x;
+		else if (v.typecheck(Value::Int_Kind)) {
+			// Integer type ids are small enough to fit in the byte.
+			value[1] = (std::uint8_t)v.Int_.type_descriptor_id;
+			memcpy(value + 2, &v.Int_.x, sizeof(v.Int_.x));
+		}
+		else memcpy(value + 1, &v.Real_.x, sizeof(long double));
+		memo.insert(memo_id, key, key_size, value, sizeof(value));
+	}
+	return v;
 }
 
 Value AST_Interpreter::array_access(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
@@ -662,23 +786,24 @@ Value AST_Interpreter::array_access(AST_Nodes nodes, size_t idx, std::string_vie
 
 	auto id = interpret(nodes, node.identifier_array_idx, file);
 	if (!id.typecheck(Value::Identifier_Kind)) {
-		println("Error expected Identifier got %s.", id.name());
+		report("Error expected Identifier got %s.", id.name());
 		return nullptr;
 	}
 	auto type = types.at(id.Identifier_.type_descriptor_id);
 	if (!type.typecheck(Type::Array_View_Type_Kind)) {
-		println("Error expected Array got %s.", type.name());
+		report("Error expected Array got %s.", type.name());
 		return nullptr;
 	}
 
 	auto access_id = interpret(nodes, node.identifier_acess_idx, file);
 	if (access_id.typecheck(Value::Identifier_Kind)) access_id = at(access_id.cast<Identifier>());
-	if (!access_id.typecheck(Value::Real_Kind)) {
-		println("Error expected long double got %s.", access_id.name());
+	if (!access_id.typecheck(Value::Real_Kind) && !access_id.typecheck(Value::Int_Kind)) {
+		report("Error expected a number got %s.", access_id.name());
 		return nullptr;
 	}
 
-	size_t i = (size_t)std::roundl(access_id.cast<Real>().x);
+	size_t i = access_id.typecheck(Value::Int_Kind) ?
+		(size_t)access_id.Int_.x : (size_t)std::roundl(access_id.cast<Real>().x);
 	size_t size = types.at(type.Array_View_Type_.user_type_descriptor_idx).get_size();
 
 	Identifier identifier;
@@ -692,8 +817,41 @@ Value AST_Interpreter::return_call(AST_Nodes nodes, size_t idx, std::string_view
 	auto& node = nodes[idx].Return_Call_;
 
 	Return_Call r;
+
+	auto value_idx = node.return_value_idx;
+	if (call_depth && value_idx && nodes[value_idx].typecheck(AST::Node::Function_Call_Kind)) {
+		auto& call = nodes[value_idx].Function_Call_;
+
+		// Same evaluation order as function_call, arguments first.
+		r.argument_base = argument_stack.size();
+		for (size_t i = call.argument_list_idx; i; i = nodes[i]->next_statement) {
+			auto x = interpret(nodes, nodes[i].Argument_.value_idx, file);
+			argument_stack.push_back(create_id(x));
+		}
+		if (failed) return nullptr;
+
+		auto any_id = interpret(nodes, call.identifier_idx, file);
+		if (any_id.typecheck(Value::None_Kind)) return nullptr;
+		if (any_id.typecheck(Value::Identifier_Kind)) {
+			r.tail_call = true;
+			r.callee = any_id.Identifier_;
+			return r;
+		}
+
+		std::span<const Identifier> arguments(
+			argument_stack.data() + r.argument_base, argument_stack.size() - r.argument_base
+		);
+		auto x = any_id.Builtin_.f(*this, arguments);
+		argument_stack.resize(r.argument_base);
+
+		r.argument_base = 0;
+		r.values.push_back(create_id(x));
+		return r;
+	}
+
 	if (node.return_value_idx) {
 		auto x = interpret(nodes, node.return_value_idx, file);
+		if (failed) return nullptr;
 		r.values.push_back(create_id(x));
 	}
 
@@ -703,8 +861,20 @@ Value AST_Interpreter::return_call(AST_Nodes nodes, size_t idx, std::string_view
 
 Value AST_Interpreter::identifier(AST_Nodes nodes, size_t idx, std::string_view file) noexcept {
 	auto& node = nodes[idx].Identifier_;
+	auto name = string_view_from_view(file, node.token.lexeme);
+
+	if (method_scope) {
+		if (idx >= member_bindings.size()) member_bindings.resize(nodes.size(), 0);
+
+		auto& binding = member_bindings[idx];
+		if (!binding) {
+			auto member = lookup_member(name);
+			binding = member ? member : Not_A_Member;
+		}
+		if (binding != Not_A_Member) return self_member(binding - 1);
+	}
 
-	return lookup(string_view_from_view(file, node.token.lexeme));
+	return lookup(name);
 }
 
 
@@ -742,6 +912,22 @@ Type AST_Interpreter::create_array_type(size_t underlying, size_t size) noexcept
 	return new_array_type;
 }
 
+Type AST_Interpreter::create_signature_type(
+	std::vector<size_t> parameter_types, std::vector<size_t> return_types
+) noexcept {
+	size_t hash = 0;
+	for (auto x : parameter_types) hash = hash_combine(hash, x);
+	hash = hash_combine(hash, Function_Signature::Hash_Return_Separator);
+	for (auto x : return_types) hash = hash_combine(hash, x);
+
+	Function_Signature sig;
+	sig.unique_id = hash;
+	sig.parameter_types = std::move(parameter_types);
+	sig.return_types = std::move(return_types);
+	types[hash] = sig;
+	return types[hash];
+}
+
 Type AST_Interpreter::type_ident(
 	AST_Nodes nodes, size_t idx, std::string_view file
 ) noexcept {
@@ -753,41 +939,32 @@ Type AST_Interpreter::type_ident(
 	if (node.array_to) {
 		auto underlying = type_interpret(nodes, *node.array_to, file);
 		auto size       = interpret(nodes, *node.array_size, file);
-		if (!size.typecheck(Value::Real_Kind)) {
-			printlns("Support only constant time array.");
+		if (!size.typecheck(Value::Real_Kind) && !size.typecheck(Value::Int_Kind)) {
+			reports("Support only constant time array.");
 			return nullptr;
 		}
 
 		return create_array_view_type(
-			underlying.get_unique_id(), (size_t)std::roundl(size.Real_.x)
+			underlying.get_unique_id(),
+			size.typecheck(Value::Int_Kind) ?
+				(size_t)size.Int_.x : (size_t)std::roundl(size.Real_.x)
 		);
 	}
 	if (node.is_proc) {
-		Function_Signature sig;
-		size_t type_hash = 0;
+		std::vector<size_t> parameter_types;
+		std::vector<size_t> return_types;
 		for (
 			size_t idx = node.parameter_type_list_idx;
 			idx;
 			idx = nodes[idx]->next_statement
-		) {
-			auto t = type_ident(nodes, idx, file).get_unique_id();
-			sig.parameter_types.push_back(t);
-			type_hash = hash_combine(type_hash, t);
-		}
-		type_hash = hash_combine(type_hash, Function_Signature::Hash_Return_Separator);
+		) parameter_types.push_back(type_ident(nodes, idx, file).get_unique_id());
 		for (
 			size_t idx = node.return_type_list_idx;
 			idx;
 			idx = nodes[idx]->next_statement
-		) {
-			auto t = type_ident(nodes, idx, file).get_unique_id();
-			sig.return_types.push_back(t);
-			type_hash = hash_combine(type_hash, t);
-		}
-		sig.unique_id = type_hash;
+		) return_types.push_back(type_ident(nodes, idx, file).get_unique_id());
 
-		types[sig.unique_id] = sig;
-		return types[sig.unique_id];
+		return create_signature_type(std::move(parameter_types), std::move(return_types));
 	}
 
 	return type_lookup(string_view_from_view(file, node.identifier.lexeme));
@@ -799,7 +976,7 @@ Value AST_Interpreter::declaration(AST_Nodes nodes, size_t idx, std::string_view
 	auto name = string_view_from_view(file, node.identifier.lexeme);
 
 	if (exist_lookup(name)) {
-		println("Error variable %*.s already assigned.", (int)name.size(), name.data());
+		report("Error variable %*.s already assigned.", (int)name.size(), name.data());
 		return nullptr;
 	}
 
@@ -823,6 +1000,7 @@ Value AST_Interpreter::declaration(AST_Nodes nodes, size_t idx, std::string_view
 				var.Identifier_.type_descriptor_id = t.cast<User_Function_Type>().unique_id;
 
 				write_ptr(t.cast<User_Function_Type>().start_idx, var.Identifier_.memory_idx);
+				types.at(t.User_Function_Type_.unique_id).User_Function_Type_.name = name;
 			}
 
 			if (t.typecheck(Type::User_Struct_Type_Kind)) {
@@ -841,10 +1019,11 @@ Value AST_Interpreter::declaration(AST_Nodes nodes, size_t idx, std::string_view
 
 				// special case for things like `x : int[10] = 5;`
 				if (type.typecheck(Type::Array_View_Type_Kind)) {
+					x = convert(x, type.Array_View_Type_.user_type_descriptor_idx);
 					auto value_type = types.at(get_underlying_type_id(x));
 					auto& underlying = types.at(type.Array_View_Type_.user_type_descriptor_idx);
 					if (underlying.get_unique_id() != value_type.get_unique_id()) {
-						println(
+						report(
 							"Mismatch type in declaration (L %zu) %s != %s.",
 							node.identifier.line,
 							type.name(),
@@ -861,8 +1040,9 @@ Value AST_Interpreter::declaration(AST_Nodes nodes, size_t idx, std::string_view
 						copy(x, v.memory_idx + i * underlying.get_size());
 					var = create_id(v);
 				} else {
+					x = convert(x, type_hint);
 					if (type.get_unique_id() != get_type_id(x)) {
-						println(
+						report(
 							"Mismatch type in declaration (L %zu) %s != %s.",
 							node.identifier.line,
 							type.name(),
@@ -896,10 +1076,14 @@ Value AST_Interpreter::litteral(AST_Nodes nodes, size_t idx, std::string_view fi
 		auto res = std::from_chars(file.data() + view.i, file.data() + view.i + view.size, x);
 		if (res.ec == std::errc::invalid_argument) return nullptr;
 */
-		static std::string temp;
+		thread_local std::string temp;
 		temp.clear();
 		temp.resize(view.size);
 		memcpy(temp.data(), file.data() + view.i, view.size);
+
+		std::int64_t i = 0;
+		if (parse_integer(temp, i)) return Int{ i };
+
 		char* end_ptr;
 		long double x = std::strtold(temp.c_str(), &end_ptr);
 		return Real{ x };
@@ -933,6 +1117,13 @@ void AST_Interpreter::print_value(const Value& value) noexcept {
 		println("%Lf", value.Real_.x);
 		return;
 	}
+	if (value.typecheck(Value::Int_Kind)) {
+		if (value.Int_.type_descriptor_id == Nat_Type::unique_id)
+			println("%llu", (unsigned long long)value.Int_.x);
+		else
+			println("%lld", (long long)value.Int_.x);
+		return;
+	}
 
 	if (value.typecheck(Value::Bool_Kind)) {
 		println("%s", value.Bool_.x ? "true" : "false");
@@ -966,12 +1157,65 @@ void AST_Interpreter::print_value(const Value& value) noexcept {
 Value AST_Interpreter::lookup(std::string_view id) noexcept {
 	for (auto it = std::rbegin(scopes); it != std::rend(scopes); it++) {
 		for (auto& [x, v] : it->variables) if (x == id) return v;
-		if (it->fence) break;
+		if (it->fence) {
+			if (it->self_type) {
+				auto member = it->self_type->name_to_idx.find(id);
+				if (member != it->self_type->name_to_idx.end()) return self_member(member->second);
+			}
+			break;
+		}
 	}
 	for (auto& [x, v] : builtins) if (x == id) return v;
 	return nullptr;
 }
 
+size_t AST_Interpreter::lookup_member(std::string_view id) noexcept {
+	if (!method_scope) return 0;
+
+	// A local or a parameter with the same name shadows the member.
+	for (size_t i = scopes.size() - 1; i >= method_scope; --i)
+		for (auto& [x, v] : scopes[i].variables) if (x == id) return 0;
+
+	auto& self_type = *scopes[method_scope].self_type;
+	auto member = self_type.name_to_idx.find(id);
+	if (member == self_type.name_to_idx.end()) return 0;
+	return member->second + 1;
+}
+
+bool AST_Interpreter::memo_key(
+	std::span<const Identifier> arguments, std::uint8_t* key, size_t& key_size
+) noexcept {
+	key_size = 0;
+	for (auto& x : arguments) {
+		auto& type = types.at(x.type_descriptor_id);
+
+		// A proc argument is only as pure as the proc that is passed.
+		if (type.typecheck(Type::Function_Signature_Kind)) return false;
+		if (type.typecheck(Type::User_Function_Type_Kind) && !type.User_Function_Type_.is_pure)
+			return false;
+
+		size_t size = type.get_size();
+		if (key_size + size > Memo_Cache::Max_Key_Size) return false;
+
+		memcpy(key + key_size, memory.data() + x.memory_idx, size);
+		key_size += size;
+	}
+	return true;
+}
+
+AST_Interpreter::Identifier AST_Interpreter::self_member(size_t member_idx) noexcept {
+	auto& scope = scopes[method_scope];
+
+	Identifier member;
+	member.memory_idx = scope.self_idx + scope.self_type->member_offsets[member_idx];
+	member.type_descriptor_id = scope.self_type->member_types[member_idx];
+
+	// So a method can call another method of the same struct.
+	member.parent_idx = scope.self_idx;
+	member.parent_type_descriptor_id = scope.self_type->unique_id;
+	return member;
+}
+
 bool AST_Interpreter::exist_lookup(std::string_view id) noexcept {
 	// >PERF(Tackwin)
 
@@ -988,70 +1232,102 @@ AST_Interpreter::Value& AST_Interpreter::new_variable(std::string_view id, Value
 void AST_Interpreter::push_scope() noexcept { scopes.emplace_back(); }
 void AST_Interpreter::pop_scope()  noexcept { scopes.pop_back(); }
 
-void AST_Interpreter::push_builtin() noexcept {
-	Builtin print;
-	print.f = [&] (std::vector<Identifier> values) -> Identifier {
-		for (auto& x : values) {
-			auto y = at(x);
-			if (y.typecheck(Value::Identifier_Kind)) y = at(y.cast<Identifier>());
-			if (y.typecheck(Value::Pointer_Kind)) printf("%zu", y.cast<Pointer>().memory_idx);
-			else if (y.typecheck(Value::Real_Kind)) printf("%Lf", y.cast<Real>().x);
-			else if (y.typecheck(Value::String_Kind)) printf("%s", y.String_.x.c_str());
-			else if (y.typecheck(Value::Bool_Kind)) printf("%s", y.Bool_.x ? "true" : "false");
-			else if (y.typecheck(Value::Array_View_Kind)) {
-				auto underlying = types.at(y.Array_View_.type_descriptor_id);
-				if (underlying.typecheck(Type::Byte_Type_Kind)) {
-					std::string str;
-					str.resize(y.Array_View_.length + 1);
-					memcpy(
-						str.data(),
-						memory.data() + read_ptr(y.Array_View_.memory_idx + 1 * sizeof(size_t)),
-						y.Array_View_.length
-					);
-					printf("%s", str.c_str());
-				}
+static Value builtin_print(AST_Interpreter& it, std::span<const Identifier> values) {
+	for (auto& x : values) {
+		auto y = it.at(x);
+		if (y.typecheck(Value::Identifier_Kind)) y = it.at(y.cast<Identifier>());
+		if (y.typecheck(Value::Pointer_Kind)) printf("%zu", y.cast<Pointer>().memory_idx);
+		else if (y.typecheck(Value::Real_Kind)) printf("%Lf", y.cast<Real>().x);
+		else if (y.typecheck(Value::Int_Kind)) {
+			auto type = y.Int_.type_descriptor_id;
+			if      (type == AST_Interpreter::Byte_Type::unique_id) printf("%c", (char)y.Int_.x);
+			else if (type == AST_Interpreter::Nat_Type::unique_id)
+				printf("%llu", (unsigned long long)y.Int_.x);
+			else
+				printf("%lld", (long long)y.Int_.x);
+		}
+		else if (y.typecheck(Value::String_Kind)) printf("%s", y.String_.x.c_str());
+		else if (y.typecheck(Value::Bool_Kind)) printf("%s", y.Bool_.x ? "true" : "false");
+		else if (y.typecheck(Value::Array_View_Kind)) {
+			auto underlying = it.types.at(y.Array_View_.type_descriptor_id);
+			if (underlying.typecheck(Type::Byte_Type_Kind)) {
+				std::string str;
+				str.resize(y.Array_View_.length + 1);
+				memcpy(
+					str.data(),
+					it.memory.data() + it.read_ptr(y.Array_View_.memory_idx + 1 * sizeof(size_t)),
+					y.Array_View_.length
+				);
+				printf("%s", str.c_str());
 			}
-			else printf("Unsupported type to print (%s)", y.name());
-
-			printf(" ");
 		}
-		printf("\n");
+		else printf("Unsupported type to print (%s)", y.name());
 
-		return {};
-	};
-	builtins["print"] = print;
+		printf(" ");
+	}
+	printf("\n");
 
-	Builtin sleep;
-	sleep.f = [&] (std::vector<Identifier> values) -> Identifier {
-		if (values.size() != 1) {
-			println("Sleep expect 1 long double argument got %zu arguments.", values.size());
-			return {};
-		}
-		auto x = at(values.front());
-		if (!x.typecheck(Value::Real_Kind)) {
-			println("Sleep expect 1 long double argument got %s.", x.name());
-			return {};
-		}
+	return Identifier{};
+}
 
-		std::this_thread::sleep_for(
-			std::chrono::nanoseconds((size_t)(1'000'000'000 * x.cast<Real>().x))
-		);
-		return {};
-	};
-	builtins["sleep"] = sleep;
+static Value builtin_sleep(AST_Interpreter& it, std::span<const Identifier> values) {
+	if (values.size() != 1) {
+		println("Sleep expect 1 long double argument got %zu arguments.", values.size());
+		return Identifier{};
+	}
+	auto x = it.convert(values.front(), AST_Interpreter::Real_Type::unique_id);
+	if (x.typecheck(Value::Identifier_Kind)) x = it.at(x.Identifier_);
+	if (!x.typecheck(Value::Real_Kind)) {
+		println("Sleep expect 1 long double argument got %s.", x.name());
+		return Identifier{};
+	}
+
+	std::this_thread::sleep_for(
+		std::chrono::nanoseconds((size_t)(1'000'000'000 * x.cast<Real>().x))
+	);
+	return Identifier{};
+}
 
-	Builtin int_;
-	int_.f = [&] (std::vector<Identifier> values) -> Value {
-		if (values.size() != 1) return nullptr;
+static Value builtin_int(AST_Interpreter& it, std::span<const Identifier> values) {
+	if (values.size() != 1) return nullptr;
 
-		auto v = at(values.front());
-		switch (v.kind) {
-			case Value::Real_Kind: return Real{(long double)(size_t)v.Real_.x};
-			default: return nullptr;
-		}
-	};
-	builtins["int"] = int_;
+	auto v = it.at(values.front());
+	switch (v.kind) {
+		case Value::Real_Kind: return it.convert(v, AST_Interpreter::Int_Type::unique_id);
+		case Value::Int_Kind:  return Int{ v.Int_.x };
+		default: return nullptr;
+	}
+}
+
+static Value builtin_len(AST_Interpreter& it, std::span<const Identifier> values) {
+	if (values.size() != 1) {
+		println("len expect 1 Array argument, got %zu arguments.", values.size());
+		return Identifier{};
+	}
 
+	auto x = it.at(values.front());
+	if (x.typecheck(Value::Identifier_Kind)) x = it.at(x.cast<Identifier>());
+	if (!x.typecheck(Value::Array_View_Kind)) {
+		println("Len expect a array argument, got %s.", x.name());
+		return Identifier{};
+	}
+
+	Int r;
+	r.x = (std::int64_t)x.Array_View_.length;
+	return it.create_id(r);
+}
+
+void AST_Interpreter::register_builtin(std::string_view name, Builtin::Function f) noexcept {
+	Builtin b;
+	b.f = f;
+	builtins[name] = b;
+}
+
+void AST_Interpreter::push_builtin() noexcept {
+	register_builtin("print", builtin_print);
+	register_builtin("sleep", builtin_sleep);
+	register_builtin("int",   builtin_int);
+	register_builtin("len",   builtin_len);
 
 	type_name_to_hash["nat"] = Nat_Type::unique_id;
 	type_name_to_hash["int"] = Int_Type::unique_id;
@@ -1065,31 +1341,16 @@ void AST_Interpreter::push_builtin() noexcept {
 	types[Byte_Type::unique_id] = Byte_Type();
 	types[Nat_Type::unique_id] = Nat_Type();
 	types[Int_Type::unique_id] = Int_Type();
-
-	Builtin len;
-	len.f = [&] (std::vector<Identifier> values) -> Identifier {
-		if (values.size() != 1) {
-			println("len expect 1 Array argument, got %zu arguments.", values.size());
-			return {};
-		}
-
-		auto x = at(values.front());
-		if (x.typecheck(Value::Identifier_Kind)) x = at(x.cast<Identifier>());
-		if (!x.typecheck(Value::Array_View_Kind)) {
-			println("Len expect a array argument, got %s.", x.name());
-			return {};
-		}
-
-		Real r;
-		r.x = x.Array_View_.length;
-		return create_id(r);
-	};
-	builtins["len"] = len;
 }
 
 
+// None for a name that isn't a type, or one that was never defined.
 Type AST_Interpreter::type_lookup(std::string_view id) noexcept {
-	return types.at(type_name_to_hash.at(id));
+	auto hash = type_name_to_hash.find(id);
+	if (hash == std::end(type_name_to_hash)) return nullptr;
+	auto type = types.find(hash->second);
+	if (type == std::end(types)) return nullptr;
+	return type->second;
 }
 
 size_t AST_Interpreter::copy(const Value& from, size_t to) noexcept {
@@ -1113,6 +1374,14 @@ size_t AST_Interpreter::copy(const Value& from, size_t to) noexcept {
 		*reinterpret_cast<long double*>(memory.data() + to) = from.cast<Real>().x;
 		return sizeof(long double);
 	}
+	if (from.typecheck(Value::Int_Kind)) {
+		if (from.Int_.type_descriptor_id == Byte_Type::unique_id) {
+			memory[to] = (std::uint8_t)from.Int_.x;
+			return 1;
+		}
+		memcpy(memory.data() + to, &from.Int_.x, sizeof(std::int64_t));
+		return sizeof(std::int64_t);
+	}
 	if (from.typecheck(Value::Pointer_Kind)) {
 		auto ptr = from.Pointer_.memory_idx;
 		memcpy(memory.data() + to, &ptr, sizeof(size_t));
@@ -1147,6 +1416,19 @@ Value AST_Interpreter::at(Identifier id) noexcept {
 			b.x = memory[id.memory_idx] != 0;
 			return b;
 		}
+		case Type::Int_Type_Kind:
+		case Type::Nat_Type_Kind: {
+			Int i;
+			memcpy(&i.x, memory.data() + id.memory_idx, sizeof(i.x));
+			i.type_descriptor_id = id.type_descriptor_id;
+			return i;
+		}
+		case Type::Byte_Type_Kind: {
+			Int i;
+			i.x = memory[id.memory_idx];
+			i.type_descriptor_id = id.type_descriptor_id;
+			return i;
+		}
 		case Type::Array_View_Type_Kind: {
 			Array_View a;
 			a.memory_idx = id.memory_idx;
@@ -1174,6 +1456,7 @@ Value AST_Interpreter::at(Identifier id) noexcept {
 
 size_t AST_Interpreter::get_underlying_type_id(const Value& x) noexcept {
 	if (x.typecheck(Value::Real_Kind))        return Real_Type::unique_id;
+	if (x.typecheck(Value::Int_Kind))         return x.Int_.type_descriptor_id;
 	if (x.typecheck(Value::Bool_Kind))        return Bool_Type::unique_id;
 	if (x.typecheck(Value::Pointer_Kind))     return x.Pointer_.type_descriptor_id;
 	if (x.typecheck(Value::Identifier_Kind))  return x.Identifier_.type_descriptor_id;
@@ -1182,6 +1465,7 @@ size_t AST_Interpreter::get_underlying_type_id(const Value& x) noexcept {
 }
 size_t AST_Interpreter::get_type_id(const Value& x) noexcept {
 	if (x.typecheck(Value::Real_Kind))        return Real_Type::unique_id;
+	if (x.typecheck(Value::Int_Kind))         return x.Int_.type_descriptor_id;
 	if (x.typecheck(Value::Bool_Kind))        return Bool_Type::unique_id;
 	if (x.typecheck(Value::Pointer_Kind))
 		return hash_combine(x.Pointer_.type_descriptor_id, Pointer_Type::combine_id);
@@ -1202,10 +1486,15 @@ size_t AST_Interpreter::read_ptr(size_t ptr) noexcept {
 
 AST_Interpreter::Identifier AST_Interpreter::create_id(const Value& x) noexcept {
 	Identifier new_ident;
+	if (x.typecheck(Value::None_Kind)) return new_ident;
 	if (x.typecheck(Value::Real_Kind)) {
 		new_ident.type_descriptor_id = Real_Type::unique_id;
 		new_ident.memory_idx = alloc(sizeof(long double));
 	}
+	else if (x.typecheck(Value::Int_Kind)) {
+		new_ident.type_descriptor_id = x.Int_.type_descriptor_id;
+		new_ident.memory_idx = alloc(types.at(new_ident.type_descriptor_id).get_size());
+	}
 	else if (x.typecheck(Value::Bool_Kind)) {
 		new_ident.type_descriptor_id = Bool_Type::unique_id;
 		new_ident.memory_idx = alloc(1);
@@ -1241,6 +1530,7 @@ AST_Interpreter::Identifier AST_Interpreter::create_id(const Value& x) noexcept
 Type AST_Interpreter::type_of(const Value& x) noexcept {
 	     if (x.typecheck(Value::Bool_Kind)) return Bool_Type();
 	else if (x.typecheck(Value::Real_Kind)) return Real_Type();
+	else if (x.typecheck(Value::Int_Kind))  return types.at(x.Int_.type_descriptor_id);
 	else if (x.typecheck(Value::Identifier_Kind))
 		return types.at(x.Identifier_.type_descriptor_id);
 	else if (x.typecheck(Value::Pointer_Kind))
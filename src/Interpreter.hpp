@@ -2,13 +2,15 @@
 #pragma once
 
 #include <any>
+#include <span>
 #include <stack>
 #include <vector>
-#include <functional>
 #include <string_view>
 #include <unordered_map>
 #include "AST.hpp"
 #include "xstd.hpp"
+#include "Memo.hpp"
+#include "Profiler.hpp"
 
 // I guess you can't forward decl nested struct in c++ :)))))
 // struct AST { struct Node; };
@@ -17,6 +19,12 @@ struct AST_Interpreter {
 	struct String { std::string x; };
 	struct Bool   { bool          x = 0; };
 	struct Real   { long double   x = 0; };
+	// Value of an int, a nat or a byte, type_descriptor_id tells which. A nat keeps its bits in x
+	// and a byte is always in [0, 255].
+	struct Int {
+		std::int64_t x = 0;
+		size_t type_descriptor_id = Int_Type::unique_id;
+	};
 	struct Identifier {
 		size_t memory_idx = 0;
 		size_t type_descriptor_id = 0;
@@ -34,14 +42,24 @@ struct AST_Interpreter {
 	};
 	struct Return_Call {
 		std::vector<Identifier> values;
+
+		// `return f(...)` in a function doesn't call f, the caller reuses its frame for it. The
+		// arguments are on the argument stack starting at argument_base.
+		bool tail_call = false;
+		Identifier callee;
+		size_t argument_base = 0;
 	};
 	struct Value;
 	struct Builtin {
-		std::function<Value(std::vector<Identifier>)> f;
+		// Arguments are a view into the interpreter's argument stack, they are only valid for the
+		// duration of the call.
+		using Function = Value(*)(AST_Interpreter& interpreter, std::span<const Identifier> args);
+		Function f = nullptr;
 	};
 
 	#define LIST_LANG_VALUE(X)\
-	X(Identifier) X(Pointer) X(Real) X(Return_Call) X(Bool) X(Builtin) X(Array_View) X(String)
+	X(Identifier) X(Pointer) X(Real) X(Return_Call) X(Bool) X(Builtin) X(Array_View) X(String)\
+	X(Int)
 
 	struct Value { sum_type(Value, LIST_LANG_VALUE); };
 
@@ -80,8 +98,11 @@ struct AST_Interpreter {
 	struct User_Function_Type {
 		size_t unique_id = 0;
 		size_t start_idx = 0;
+		size_t definition_idx = 0;
+		std::string_view name; // empty for procs that are never bound to a name.
 		size_t byte_size = 8;
 		bool is_method = false;
+		bool is_pure = false; // see is_pure_function.
 		std::vector<size_t>           parameter_type;
 		std::vector<std::string_view> parameter_name;
 
@@ -148,12 +169,48 @@ struct AST_Interpreter {
 
 	struct Scope {
 		bool fence = false;
+
+		// Set on the fence scope of a method call. Members are read through the struct layout
+		// instead of being copied in variables on every call.
+		size_t self_idx = 0;
+		const User_Struct_Type* self_type = nullptr;
+
 		std::unordered_map<std::string_view, Value, String_View_Hasher> variables;
 	};
 	std::vector<Scope> scopes;
 
+	// Index in scopes of the innermost call if it is a method, 0 otherwise.
+	size_t method_scope = 0;
+
+	// For identifier nodes in method bodies, what they resolved to the first time: 0 if not yet
+	// resolved, Not_A_Member, or the member index + 1.
+	static constexpr size_t Not_A_Member = SIZE_MAX;
+	std::vector<size_t> member_bindings;
+
 	std::unordered_map<std::string_view, Builtin, String_View_Hasher> builtins;
 
+	// Arguments of every call currently being evaluated, each function_call only owns the slice
+	// starting at the size it saw on entry so nested calls like f(g(x), y) can't clobber it.
+	static constexpr size_t Argument_Stack_Reserve = 4096;
+	std::vector<Identifier> argument_stack;
+
+	// Number of user function calls being evaluated, a return outside of them can't be a tail call.
+	size_t call_depth = 0;
+
+	// Set it to profile every evaluated node and user function call, null means no profiling.
+	AST_Profiler* profiler = nullptr;
+
+	// Results of pure procs, looked up before running their body again.
+	bool memoize = true;
+	Memo_Cache memo;
+
+	// How many more nodes interpret can go through, it returns nothing once it's out. Errors set
+	// failed, and aren't printed when quiet. The compiler evaluating a constant uses them to give
+	// up on what takes too long or goes wrong, the program computes it when it runs instead.
+	size_t steps_left = SIZE_MAX;
+	bool quiet = false;
+	bool failed = false;
+
 	using AST_Nodes = const std::vector<AST::Node>&;
 
 	Value litteral     (AST_Nodes nodes, size_t idx, std::string_view file) noexcept;
@@ -178,16 +235,31 @@ struct AST_Interpreter {
 
 	Type  type_interpret(AST_Nodes nodes, size_t idx, std::string_view file) noexcept;
 	Value      interpret(AST_Nodes nodes, size_t idx, std::string_view file) noexcept;
+	Value       dispatch(AST_Nodes nodes, size_t idx, std::string_view file) noexcept;
 	Value      interpret(
 		AST_Nodes nodes, const User_Function_Type& f, std::string_view file
 	) noexcept;
 
+	Value arithmetic(AST::Operator op, Value left, Value right) noexcept;
+	Value convert(const Value& x, size_t type_id) noexcept;
+	static bool is_integer(size_t type_id) noexcept;
+	// True if the number litteral is an integer that fits in an int.
+	static bool parse_integer(std::string_view litteral, std::int64_t& x) noexcept;
+
 	Type  create_pointer_type(size_t underlying) noexcept;
 	Type  create_array_type(size_t underlying, size_t size) noexcept;
 	Type  create_array_view_type(size_t underlying, size_t size) noexcept;
+	Type  create_signature_type(
+		std::vector<size_t> parameter_types, std::vector<size_t> return_types
+	) noexcept;
 	Type  type_of(const Value& value) noexcept;
 	Type  type_lookup(std::string_view id) noexcept;
 	Value lookup(std::string_view id) noexcept;
+	size_t lookup_member(std::string_view id) noexcept;
+	Identifier self_member(size_t member_idx) noexcept;
+	bool memo_key(
+		std::span<const Identifier> arguments, std::uint8_t* key, size_t& key_size
+	) noexcept;
 	bool  exist_lookup(std::string_view id) noexcept;
 	Value& new_variable(std::string_view id, Value v) noexcept;
 
@@ -205,9 +277,16 @@ struct AST_Interpreter {
 	void print_value(const Value& value) noexcept;
 
 	void push_builtin() noexcept;
+	// name needs to outlive the interpreter, a string litteral is fine.
+	void register_builtin(std::string_view name, Builtin::Function f) noexcept;
 
 	size_t get_type_id(const Value& x) noexcept;
 	size_t get_underlying_type_id(const Value& x) noexcept;
 
-	AST_Interpreter() noexcept { memory.push_back(0); push_builtin(); push_scope(); }
+	AST_Interpreter() noexcept {
+		memory.push_back(0);
+		argument_stack.reserve(Argument_Stack_Reserve);
+		push_builtin();
+		push_scope();
+	}
 };
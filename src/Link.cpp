@@ -0,0 +1,184 @@
+#include "Bytecode.hpp"
+
+#include <unordered_map>
+
+extern size_t alloc_constant(Program& prog, const std::uint8_t* data, size_t n) noexcept;
+
+// The builtin type a type expression names, 0 for anything else.
+static size_t builtin_type(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	std::string_view file,
+	const AST_Interpreter& interpreter
+) noexcept {
+	if (!idx || !nodes[idx].typecheck(AST::Node::Type_Identifier_Kind)) return 0;
+
+	auto& node = nodes[idx].Type_Identifier_;
+	if (node.pointer_to || node.array_to || node.is_proc) return 0;
+
+	auto it = interpreter.type_name_to_hash.find(string_view_from_view(file, node.identifier.lexeme));
+	return it == std::end(interpreter.type_name_to_hash) ? 0 : it->second;
+}
+
+extern std::vector<Extern_Proc> exports_of(
+	const std::vector<AST::Node>& nodes, std::string_view file
+) noexcept {
+	// Only knows the builtin types.
+	AST_Interpreter interpreter;
+
+	// The last declaration of a name is the one the file sees, it's not exported if it can't be.
+	std::vector<Extern_Proc> res;
+	std::unordered_map<std::string_view, size_t> positions;
+	for (size_t idx = 1; idx < nodes.size(); ++idx) {
+		if (nodes[idx]->depth != 0 || !nodes[idx].typecheck(AST::Node::Declaration_Kind)) continue;
+
+		auto& node = nodes[idx].Declaration_;
+		auto name = string_view_from_view(file, node.identifier.lexeme);
+		auto [it, inserted] = positions.emplace(name, res.size());
+		if (inserted) res.emplace_back();
+		auto& proc = res[it->second];
+		proc = {};
+
+		auto value = node.value_expression_idx;
+		if (!value || !nodes[value].typecheck(AST::Node::Function_Definition_Kind)) continue;
+		auto& f = nodes[value].Function_Definition_;
+		if (f.is_method) continue;
+
+		bool builtin = true;
+		for (size_t i = f.parameter_list_idx; i && builtin; i = nodes[i]->next_statement) {
+			auto t = builtin_type(nodes, nodes[i].Declaration_.type_expression_idx, file, interpreter);
+			proc.parameter_types.push_back(t);
+			builtin = t != 0;
+		}
+		for (size_t i = f.return_list_idx; i && builtin; i = nodes[i]->next_statement) {
+			auto t = builtin_type(nodes, nodes[i].Return_Parameter_.type_identifier, file, interpreter);
+			proc.return_types.push_back(t);
+			builtin = t != 0;
+		}
+		if (builtin) proc.name = name;
+	}
+
+	std::erase_if(res, [] (auto& x) { return x.name.empty(); });
+	return res;
+}
+
+// It can't run, it exits right away.
+static Program failed(Program& program) noexcept {
+	program.code.push_back(IS::Exit());
+	program.locs.emplace_back();
+	program.encode();
+	return std::move(program);
+}
+
+// The top level code of every object goes first in their order, then Exit, then the functions of
+// every object in their order too. An object's top level ends where the next one's starts, it
+// doesn't need to jump to it. Its variables are all dead by then: the next one can reuse their
+// memory, and the top level offsets stay as they are.
+extern Program link(const std::vector<Object>& objects) noexcept {
+	Program program;
+
+	for (auto& x : objects) program.ok &= x.ok;
+	if (!program.ok) return failed(program);
+
+	struct Placement {
+		size_t top_level = 0;
+		size_t functions = 0;
+		size_t first_function = 0;
+		size_t data = 0;
+	};
+	std::vector<Placement> placements(objects.size());
+
+	size_t ip = 0;
+	for (size_t k = 0; k < objects.size(); ++k) {
+		placements[k].top_level = ip;
+		ip += objects[k].top_level_size();
+	}
+	size_t exit_ip = ip++;
+	size_t n_functions = 0;
+	for (size_t k = 0; k < objects.size(); ++k) {
+		placements[k].functions = ip;
+		placements[k].first_function = n_functions;
+		ip += objects[k].code.size() - objects[k].top_level_size();
+		n_functions += objects[k].functions.size();
+	}
+
+	// Where each function of every object ends up.
+	std::vector<size_t> addresses;
+	for (size_t k = 0; k < objects.size(); ++k) for (auto x : objects[k].functions)
+		addresses.push_back(placements[k].functions + x - objects[k].top_level_size());
+
+	std::unordered_map<std::string_view, size_t> exported;
+	for (size_t k = 0; k < objects.size(); ++k) for (auto& x : objects[k].exports)
+		exported.emplace(x.proc.name, placements[k].first_function + x.function);
+
+	std::vector<std::vector<size_t>> imports(objects.size());
+	for (size_t k = 0; k < objects.size(); ++k) for (auto& x : objects[k].imports) {
+		// An object never imports what it declares, the first export is another object's.
+		auto it = exported.find(x.name);
+		if (it == std::end(exported)) {
+			println("Can't find the proc %s to link.", x.name.c_str());
+			program.ok = false;
+			imports[k].push_back(0);
+			continue;
+		}
+		imports[k].push_back(it->second);
+	}
+	if (!program.ok) return failed(program);
+
+	program.code.resize(ip);
+	program.locs.resize(ip);
+	for (size_t k = 0; k < objects.size(); ++k) {
+		auto& object = objects[k];
+		auto& place = placements[k];
+
+		program.data.insert(std::end(program.data), std::begin(object.data), std::end(object.data));
+		place.data = program.data.size() - object.data.size();
+
+		auto at = [&] (size_t i) {
+			if (i < object.top_level_size()) return place.top_level + i;
+			return place.functions + i - object.top_level_size();
+		};
+		for (size_t i = 0; i < object.code.size(); ++i) {
+			program.code[at(i)] = object.code[i];
+			program.locs[at(i)] = object.locs[i];
+		}
+
+		for (auto& r : object.relocations) {
+			auto& x = program.code[at(r.ip)];
+			switch (x.kind) {
+			case IS::Instruction::Call_Kind:
+				x.Call_.f_idx = addresses[place.first_function + x.Call_.f_idx];
+				break;
+			case IS::Instruction::Tail_Call_Kind:
+				x.Tail_Call_.f_idx = addresses[place.first_function + x.Tail_Call_.f_idx];
+				break;
+			case IS::Instruction::Memo_Lookup_Kind:
+				x.Memo_Lookup_.function_id += (std::uint32_t)place.first_function;
+				break;
+			case IS::Instruction::Memo_Store_Kind:
+				x.Memo_Store_.function_id += (std::uint32_t)place.first_function;
+				break;
+			case IS::Instruction::Constant_Kind: x.Constant_.ptr += place.data; break;
+			case IS::Instruction::Constantf_Kind:
+				if (r.kind == Object::Relocation::Import) x.Constantf_.ptr = imports[k][x.Constantf_.ptr];
+				else                                      x.Constantf_.ptr += place.first_function;
+				break;
+			default: break;
+			}
+		}
+
+		for (size_t i = 0; i < object.functions.size(); ++i)
+			if (object.pure_functions[i]) program.pure_addresses.insert(at(object.functions[i]));
+	}
+	program.code[exit_ip] = IS::Exit();
+
+	// A proc value is the code address of the function, read from a constant.
+	for (std::uint64_t x : addresses) program.function_constants.push_back(
+		alloc_constant(program, (const std::uint8_t*)&x, sizeof(x))
+	);
+	for (auto& x : program.code) if (x.kind == IS::Instruction::Constantf_Kind)
+		x = IS::Constant{ program.function_constants[x.Constantf_.ptr], 8 };
+
+	program.encode();
+	return program;
+}
@@ -5,6 +5,8 @@
 #include "AST.hpp"
 #include "Interpreter.hpp"
 #include "Bytecode.hpp"
+#include "Register.hpp"
+#include "Profiler.hpp"
 
 void interpret(std::string file) noexcept {
 	auto tokens = tokenize(file);
@@ -23,25 +25,222 @@ void interpret(std::string file) noexcept {
 	AST_Interpreter ast_interpreter;
 	ast_interpreter.scopes.reserve(100000);
 
-	for (size_t i = 1; i < exprs.nodes.size(); ++i) if (exprs.nodes[i]->depth == 0)
+	for (size_t i = 1; i < exprs.nodes.size(); ++i) if (exprs.nodes[i]->depth == 0) {
 		ast_interpreter.print_value(ast_interpreter.interpret(exprs.nodes, i, file));
+		// An error ends the program, like it does in the VM.
+		if (ast_interpreter.failed) break;
+	}
+}
+
+void profile(std::string file, std::string folded_path) noexcept {
+	auto tokens = tokenize(file);
+	auto exprs = parse(tokens, file);
+
+	AST_Profiler profiler;
+	profiler.begin(exprs.nodes);
+
+	AST_Interpreter ast_interpreter;
+	ast_interpreter.scopes.reserve(100000);
+	ast_interpreter.profiler = &profiler;
+
+	for (size_t i = 1; i < exprs.nodes.size(); ++i) if (exprs.nodes[i]->depth == 0)
+		ast_interpreter.interpret(exprs.nodes, i, file);
+
+	printlns("");
+	profiler.report(exprs.nodes, file);
+
+	if (profiler.write_folded(folded_path.c_str(), exprs.nodes))
+		println("\nFolded stacks written to %s", folded_path.c_str());
+	else
+		println("\nCouldn't write folded stacks to %s", folded_path.c_str());
 }
 
-void compile(std::string file) noexcept {
+void compile(std::string file, bool optimize, size_t inline_budget, size_t threads) noexcept {
 	auto tokens = tokenize(file);
 	auto exprs = parse(tokens, file);
-	// >TODO(Tackwin): We want to add a step here. The type checker, this step will
-	// auto deduce type where necessary, type check expression and fill the ast with
-	// final type information. >Type
 
-	// So here we assume that the AST is fully typed.
-	auto prog = compile(exprs.nodes, file);
+	// The type checker runs first, it reports its errors and the program is not run then.
+	auto prog = compile(exprs.nodes, file, inline_budget, threads);
+	if (!prog.ok) return;
+	if (optimize) {
+		size_t before = prog.code.size();
+		size_t data_before = prog.data.size();
+		peephole(prog);
+		println(
+			"Peephole: %zu instructions, %zu after. Constants: %zu bytes, %zu after.",
+			before,
+			prog.code.size(),
+			data_before,
+			prog.data.size()
+		);
+	}
 	prog.debug();
 	
 	Bytecode_VM vm;
 	vm.execute(prog);
 }
 
+// Compiles the program once for all, the .winc can then be run as is.
+void save(
+	std::string file, bool optimize, size_t inline_budget, size_t threads, const char* path
+) noexcept {
+	auto tokens = tokenize(file);
+	auto exprs = parse(tokens, file);
+
+	auto prog = compile(exprs.nodes, file, inline_budget, threads);
+	if (!prog.ok) return;
+	if (optimize) peephole(prog);
+
+	if (save_program(prog, path)) println("Saved %s.", path);
+}
+
+// Every file is compiled on its own to an object, a file can call the top level procs of the
+// others. They are linked in one program running the top level of each file in order.
+void link_files(
+	const std::vector<const char*>& paths, bool optimize, size_t inline_budget, size_t threads
+) noexcept {
+	std::vector<std::string> files;
+	std::vector<AST> asts;
+	std::vector<std::vector<Extern_Proc>> exports;
+	for (auto path : paths) {
+		files.push_back(read_whole_text(path));
+		auto tokens = tokenize(files.back());
+		asts.push_back(parse(tokens, files.back()));
+		exports.push_back(exports_of(asts.back().nodes, files.back()));
+	}
+
+	std::vector<Object> objects;
+	for (size_t i = 0; i < paths.size(); ++i) {
+		std::vector<Extern_Proc> imports;
+		for (size_t j = 0; j < paths.size(); ++j) if (j != i)
+			imports.insert(std::end(imports), std::begin(exports[j]), std::end(exports[j]));
+
+		objects.push_back(compile_object(asts[i].nodes, files[i], imports, inline_budget, threads));
+		if (!objects.back().ok) {
+			println("%s doesn't compile.", paths[i]);
+			continue;
+		}
+		println(
+			"%s: %zu instructions, %zu exports, %zu imports.",
+			paths[i],
+			objects.back().code.size(),
+			objects.back().exports.size(),
+			objects.back().imports.size()
+		);
+	}
+
+	auto prog = link(objects);
+	if (!prog.ok) return;
+	if (optimize) peephole(prog);
+
+	Bytecode_VM vm;
+	vm.execute(prog);
+}
+
+void run_compiled(const char* path) noexcept {
+	Program prog;
+	auto t1 = seconds();
+	if (!load_program(prog, path)) return;
+	println("Loaded in %f seconds.", seconds() - t1);
+
+	Bytecode_VM vm;
+	vm.execute(prog);
+}
+
+// Runs the compiled program counting the opcodes, pairs and triples it goes through.
+void count(std::string file, bool optimize, size_t inline_budget, size_t threads) noexcept {
+	auto tokens = tokenize(file);
+	auto exprs = parse(tokens, file);
+
+	auto prog = compile(exprs.nodes, file, inline_budget, threads);
+	if (!prog.ok) return;
+	if (optimize) peephole(prog);
+
+	Opcode_Profiler profiler;
+	Bytecode_VM vm;
+	vm.profiler = &profiler;
+	vm.execute(prog);
+
+	printlns("");
+	profiler.report();
+	profiler.report_lines(prog.line_table, file);
+}
+
+void run_registers(std::string file, bool ssa) noexcept {
+	auto tokens = tokenize(file);
+	auto exprs = parse(tokens, file);
+
+	auto prog = compile_registers(exprs.nodes, file);
+	if (!prog.ok) return;
+	if (ssa) {
+		size_t before = prog.code.size();
+		optimize_ssa(prog);
+		println("SSA: %zu instructions, %zu after.", before, prog.code.size());
+	}
+	prog.debug();
+
+	Register_VM vm;
+	vm.execute(prog);
+}
+
+// Runs the program on both VMs and compares how many instructions they dispatch and how many
+// bytes they move doing it.
+void bench(
+	std::string file, bool optimize, bool ssa, size_t inline_budget, size_t threads
+) noexcept {
+	auto tokens = tokenize(file);
+	auto exprs = parse(tokens, file);
+
+	auto stack_prog = compile(exprs.nodes, file, inline_budget, threads);
+	if (!stack_prog.ok) return;
+	if (optimize) peephole(stack_prog);
+	auto register_prog = compile_registers(exprs.nodes, file);
+	if (!register_prog.ok) return;
+	if (ssa) optimize_ssa(register_prog);
+
+	struct Result {
+		std::uint64_t instructions = 0;
+		std::uint64_t traffic = 0;
+		double seconds = 0;
+	};
+
+	auto run = [&] (auto& vm, const auto& prog) {
+		Result res;
+
+		auto t1 = seconds();
+		vm.execute(prog);
+		res.seconds = seconds() - t1;
+
+		Opcode_Profiler profiler;
+		vm.profiler = &profiler;
+		vm.execute(prog);
+
+		res.instructions = profiler.total;
+		for (size_t i = 0; i < profiler.ip_counts.size(); ++i)
+			res.traffic += profiler.ip_counts[i] * memory_traffic(prog, i);
+		return res;
+	};
+
+	Bytecode_VM stack_vm;
+	Register_VM register_vm;
+	auto stack    = run(stack_vm, stack_prog);
+	auto registers = run(register_vm, register_prog);
+
+	printlns("");
+	printlns("                     stack VM    register VM");
+	println(
+		"instructions %14llu %14llu",
+		(unsigned long long)stack.instructions,
+		(unsigned long long)registers.instructions
+	);
+	println(
+		"bytes moved  %14llu %14llu",
+		(unsigned long long)stack.traffic,
+		(unsigned long long)registers.traffic
+	);
+	println("ms           %14.3f %14.3f", stack.seconds * 1000, registers.seconds * 1000);
+}
+
 int main(int argc, char** argv) noexcept {
 	auto t1 = seconds();
 	defer {
@@ -56,6 +255,13 @@ int main(int argc, char** argv) noexcept {
 
 	auto path = argv[1];
 
+	std::string_view extension = ".winc";
+	std::string_view path_view = path;
+	if (path_view.size() > extension.size() && path_view.ends_with(extension)) {
+		run_compiled(path);
+		return 0;
+	}
+
 	printf("Reading at %s\n", path);
 
 	auto file = read_whole_text(path);
@@ -67,8 +273,40 @@ int main(int argc, char** argv) noexcept {
 		return 0;
 	}
 	auto mode = argv[2];
-	if (strcmp(mode, "compile") == 0)   compile(std::move(file));
+
+	// -O0 turns the bytecode optimizations off, -O2 runs the SSA optimizer of the register VM.
+	// -inline=n inlines the procs of at most n instructions in the bytecode, 0 for none.
+	// -j=n compiles the procs on n threads, by default one per core.
+	bool optimize = true;
+	bool ssa = false;
+	size_t inline_budget = Program::Default_Inline_Budget;
+	size_t threads = 0;
+	for (int i = 3; i < argc; ++i) {
+		if (strcmp(argv[i], "-O0") == 0) optimize = false;
+		if (strcmp(argv[i], "-O2") == 0) ssa = true;
+		if (strncmp(argv[i], "-inline=", 8) == 0) inline_budget = strtoull(argv[i] + 8, nullptr, 10);
+		if (strncmp(argv[i], "-j=", 3) == 0) threads = strtoull(argv[i] + 3, nullptr, 10);
+	}
+	if (!optimize) inline_budget = 0;
+
+	if (strcmp(mode, "compile") == 0)   compile(std::move(file), optimize, inline_budget, threads);
 	if (strcmp(mode, "interpret") == 0) interpret(std::move(file));
+	if (strcmp(mode, "count") == 0)     count(std::move(file), optimize, inline_budget, threads);
+	if (strcmp(mode, "register") == 0)  run_registers(std::move(file), ssa);
+	if (strcmp(mode, "bench") == 0)     bench(std::move(file), optimize, ssa, inline_budget, threads);
+	if (strcmp(mode, "link") == 0) {
+		std::vector<const char*> paths = { path };
+		for (int i = 3; i < argc; ++i) if (argv[i][0] != '-') paths.push_back(argv[i]);
+		link_files(paths, optimize, inline_budget, threads);
+	}
+	if (strcmp(mode, "save") == 0) {
+		std::string winc_path = argc > 3 && argv[3][0] != '-' ? argv[3] : std::string(path) + "c";
+		save(std::move(file), optimize, inline_budget, threads, winc_path.c_str());
+	}
+	if (strcmp(mode, "profile") == 0) {
+		std::string folded_path = argc > 3 ? argv[3] : std::string(path) + ".folded";
+		profile(std::move(file), std::move(folded_path));
+	}
 
 	return 0;
 }
@@ -0,0 +1,70 @@
+#include "Memo.hpp"
+
+#include "xstd.hpp"
+
+static size_t hash_key(size_t function_id, const std::uint8_t* key, size_t key_size) noexcept {
+	// FNV-1a, seeded with the function so f(1) and g(1) don't land on the same slot.
+	size_t h = 14695981039346656037ull ^ function_id;
+	for (size_t i = 0; i < key_size; ++i) {
+		h ^= key[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+Memo_Cache::Memo_Cache(size_t capacity) noexcept {
+	this->capacity = 1;
+	while (this->capacity < capacity) this->capacity <<= 1;
+}
+
+const Memo_Cache::Entry* Memo_Cache::find(
+	size_t function_id, const std::uint8_t* key, size_t key_size
+) noexcept {
+	if (entries.empty()) {
+		misses++;
+		return nullptr;
+	}
+
+	auto h = hash_key(function_id, key, key_size);
+	auto& e = entries[h & (entries.size() - 1)];
+
+	if (
+		e.function_id == function_id &&
+		e.hash == h &&
+		e.key_size == key_size &&
+		memcmp(e.key, key, key_size) == 0
+	) {
+		hits++;
+		return &e;
+	}
+
+	misses++;
+	return nullptr;
+}
+
+void Memo_Cache::insert(
+	size_t function_id,
+	const std::uint8_t* key,
+	size_t key_size,
+	const std::uint8_t* value,
+	size_t value_size
+) noexcept {
+	if (!function_id || !fits(key_size, value_size)) return;
+	if (entries.empty()) entries.resize(capacity);
+
+	auto h = hash_key(function_id, key, key_size);
+	auto& e = entries[h & (entries.size() - 1)];
+
+	e.function_id = function_id;
+	e.hash = h;
+	e.key_size = (std::uint8_t)key_size;
+	e.value_size = (std::uint8_t)value_size;
+	memcpy(e.key, key, key_size);
+	memcpy(e.value, value, value_size);
+}
+
+void Memo_Cache::clear() noexcept {
+	entries.clear();
+	hits = 0;
+	misses = 0;
+}
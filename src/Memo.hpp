@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed size cache of pure proc results, keyed on the function and the raw bytes of its
+// arguments. It's direct mapped, a new entry simply evicts whatever was in its slot so the
+// memory used never grows past what was asked at construction.
+struct Memo_Cache {
+	static constexpr size_t Default_Capacity = 1 << 12;
+	static constexpr size_t Max_Key_Size     = 64;
+	static constexpr size_t Max_Value_Size   = 24;
+
+	struct Entry {
+		size_t function_id = 0; // 0 means the slot is empty.
+		size_t hash = 0;
+		std::uint8_t key_size = 0;
+		std::uint8_t value_size = 0;
+		std::uint8_t key[Max_Key_Size];
+		std::uint8_t value[Max_Value_Size];
+	};
+
+	// Only allocated on the first insert, most programs never call a pure proc.
+	size_t capacity = 0;
+	std::vector<Entry> entries;
+
+	size_t hits   = 0;
+	size_t misses = 0;
+
+	// capacity is rounded up to a power of two.
+	Memo_Cache(size_t capacity = Default_Capacity) noexcept;
+
+	static bool fits(size_t key_size, size_t value_size) noexcept {
+		return key_size <= Max_Key_Size && value_size <= Max_Value_Size;
+	}
+
+	// Returns the entry holding the cached result or nullptr.
+	const Entry* find(
+		size_t function_id, const std::uint8_t* key, size_t key_size
+	) noexcept;
+	void insert(
+		size_t function_id,
+		const std::uint8_t* key,
+		size_t key_size,
+		const std::uint8_t* value,
+		size_t value_size
+	) noexcept;
+
+	void clear() noexcept;
+};
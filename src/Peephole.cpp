@@ -0,0 +1,436 @@
+#include "Bytecode.hpp"
+
+#include <algorithm>
+
+// The passes never erase anything themselves, they turn what they remove into None, which the VM
+// already runs as a no-op, and compact() drops them at the end of each round. That way jumps keep
+// their meaning while the passes run: a jump landing on a removed instruction lands on the next
+// one that's left, and that's what compact() makes it do.
+//
+// Removing or fusing a sequence is only valid if nothing jumps in the middle of it, incoming
+// counts the jumps (and entry points) landing on each instruction for that.
+struct Peephole {
+	Program& program;
+	std::vector<IS::Instruction>& code;
+	std::vector<size_t> incoming;
+
+	Peephole(Program& program) noexcept : program(program), code(program.code) {}
+
+	// Where a relative jump keeps its offset, nullptr for everything else.
+	static int* jump_dt(IS::Instruction& x) noexcept {
+		switch (x.kind) {
+		case IS::Instruction::Jmp_Rel_Kind:        return &x.Jmp_Rel_.dt_ip;
+		case IS::Instruction::If_Jmp_Rel_Kind:     return &x.If_Jmp_Rel_.dt_ip;
+		case IS::Instruction::If_Not_Jmp_Rel_Kind: return &x.If_Not_Jmp_Rel_.dt_ip;
+		#define X(k) case IS::Instruction::Jmp_Unless_##k##_Kind: return &x.Jmp_Unless_##k##_.dt_ip;
+		IS_COMPARISON_LIST(X)
+		#undef X
+		default: return nullptr;
+		}
+	}
+	static bool is_jump(const IS::Instruction& x) noexcept {
+		return jump_dt(const_cast<IS::Instruction&>(x));
+	}
+
+	size_t target(size_t i) const noexcept {
+		auto* dt = jump_dt(code[i]);
+		return dt ? i + *dt : i + 1;
+	}
+	static void set_dt(IS::Instruction& x, int dt) noexcept {
+		if (auto* p = jump_dt(x)) *p = dt;
+	}
+	void set_target(size_t i, size_t t) noexcept {
+		set_dt(code[i], (int)t - (int)i);
+	}
+
+	size_t function_address(size_t cst) const noexcept {
+		std::uint64_t address;
+		memcpy(&address, program.data.data() + cst, sizeof(address));
+		return address;
+	}
+
+	// The top level code, every function and every direct call target.
+	std::vector<size_t> entries() const noexcept {
+		std::vector<size_t> res = { 0 };
+		for (auto cst : program.function_constants) res.push_back(function_address(cst));
+		for (auto& x : code) {
+			if (x.typecheck(IS::Instruction::Call_Kind))      res.push_back(x.Call_.f_idx);
+			if (x.typecheck(IS::Instruction::Tail_Call_Kind)) res.push_back(x.Tail_Call_.f_idx);
+		}
+		return res;
+	}
+
+	void count_incoming() noexcept {
+		incoming.assign(code.size() + 1, 0);
+		for (auto x : entries()) incoming[x]++;
+		for (size_t i = 0; i < code.size(); ++i) if (is_jump(code[i])) incoming[target(i)]++;
+	}
+
+	// A jump to a Jmp_Rel goes straight where that one goes.
+	bool thread_jumps() noexcept {
+		bool changed = false;
+		for (size_t i = 0; i < code.size(); ++i) if (is_jump(code[i])) {
+			size_t t = target(i);
+			// Bounded so a loop of jumps doesn't hang us.
+			for (size_t hops = 0; hops < code.size(); ++hops) {
+				if (t >= code.size() || !code[t].typecheck(IS::Instruction::Jmp_Rel_Kind)) break;
+				if (target(t) == t) break;
+				t = target(t);
+			}
+			if (t != target(i)) {
+				set_target(i, t);
+				changed = true;
+			}
+		}
+		return changed;
+	}
+
+	bool is_pop_cond(size_t i) const noexcept {
+		return i < code.size() && code[i].typecheck(IS::Instruction::Pop_Kind) && code[i].Pop_.n == sizeof(IS::Real);
+	}
+	bool is_kind(size_t i, IS::Instruction::Kind kind) const noexcept {
+		return i < code.size() && code[i].kind == kind;
+	}
+
+	// See if_call and for_loop, both branch on a condition they pop in each branch:
+	//   if:  If_Jmp_Rel 2, Jmp_Rel else, Pop c ... else: Pop c
+	//   for: If_Jmp_Rel 3, Pop c, Jmp_Rel out, Pop c
+	// c is the size of a real, what conditions are.
+	// Both become an If_Not_Jmp_Rel that does the popping, to out or past the Pop of the else.
+	// That Pop is then never reached and goes with remove_unreachable.
+	bool fold_branches() noexcept {
+		count_incoming();
+
+		bool changed = false;
+		for (size_t i = 0; i < code.size(); ++i) {
+			if (!code[i].typecheck(IS::Instruction::If_Jmp_Rel_Kind)) continue;
+			auto dt = code[i].If_Jmp_Rel_.dt_ip;
+
+			if (
+				dt == 2 &&
+				is_kind(i + 1, IS::Instruction::Jmp_Rel_Kind) &&
+				is_pop_cond(i + 2) &&
+				incoming[i + 1] == 0 &&
+				incoming[i + 2] == 1
+			) {
+				// Only the jump gets to the Pop of the else, the true branch jumps over it.
+				size_t t = target(i + 1);
+				if (!is_pop_cond(t) || incoming[t] != 1 || !is_kind(t - 1, IS::Instruction::Jmp_Rel_Kind))
+					continue;
+				t++;
+				code[i] = IS::If_Not_Jmp_Rel{ (int)t - (int)i };
+				code[i + 1] = {};
+				code[i + 2] = {};
+				changed = true;
+				continue;
+			}
+
+			if (
+				dt == 3 &&
+				is_pop_cond(i + 1) &&
+				is_kind(i + 2, IS::Instruction::Jmp_Rel_Kind) &&
+				is_pop_cond(i + 3) &&
+				incoming[i + 1] == 0 &&
+				incoming[i + 2] == 0 &&
+				incoming[i + 3] == 1
+			) {
+				size_t t = target(i + 2);
+				code[i] = IS::If_Not_Jmp_Rel{ (int)t - (int)i };
+				code[i + 1] = {};
+				code[i + 2] = {};
+				code[i + 3] = {};
+				changed = true;
+				continue;
+			}
+		}
+		return changed;
+	}
+
+	// Push n, Pop n and Stack_Load p n, Save p n do nothing, nor does loading a value only to pop it
+	// like an expression statement does. Stack_Load p 8, Inc, Save p 8 is an Inc_At p.
+	bool fold_sequences() noexcept {
+		count_incoming();
+
+		bool changed = false;
+		for (size_t i = 0; i + 1 < code.size(); ++i) {
+			auto& a = code[i];
+			auto& b = code[i + 1];
+			if (incoming[i + 1]) continue;
+
+			if (
+				a.typecheck(IS::Instruction::Push_Kind) &&
+				b.typecheck(IS::Instruction::Pop_Kind) &&
+				a.Push_.n == b.Pop_.n
+			) {
+				a = {};
+				b = {};
+				changed = true;
+				continue;
+			}
+
+			bool popped =
+				b.typecheck(IS::Instruction::Pop_Kind) && (
+					(a.typecheck(IS::Instruction::Stack_Load_Kind) && a.Stack_Load_.n == b.Pop_.n) ||
+					(a.typecheck(IS::Instruction::Constant_Kind)   && a.Constant_.n   == b.Pop_.n)
+				);
+			if (popped) {
+				a = {};
+				b = {};
+				changed = true;
+				continue;
+			}
+
+			if (!a.typecheck(IS::Instruction::Stack_Load_Kind)) continue;
+			auto& load = a.Stack_Load_;
+
+			if (
+				b.typecheck(IS::Instruction::Save_Kind) &&
+				b.Save_.memory_ptr == load.memory_ptr &&
+				b.Save_.n == load.n
+			) {
+				a = {};
+				b = {};
+				changed = true;
+				continue;
+			}
+
+			if (
+				(b.typecheck(IS::Instruction::Inc_Kind) || b.typecheck(IS::Instruction::Inc_I_Kind)) &&
+				load.n == 8 &&
+				is_kind(i + 2, IS::Instruction::Save_Kind) &&
+				code[i + 2].Save_.memory_ptr == load.memory_ptr &&
+				code[i + 2].Save_.n == 8 &&
+				!incoming[i + 2]
+			) {
+				if (b.typecheck(IS::Instruction::Inc_I_Kind)) a = IS::Inc_I_At{ load.memory_ptr };
+				else                                          a = IS::Inc_At{ load.memory_ptr };
+				b = {};
+				code[i + 2] = {};
+				changed = true;
+				continue;
+			}
+		}
+		return changed;
+	}
+
+	// Runs last, the other passes don't know the superinstructions.
+	//   Eq, If_Not_Jmp_Rel                -> Jmp_Unless_Eq, same for every comparison
+	//   Stack_Load p 8, Stack_Load q 8, Op -> Load_Load_Op p q, for Add, Sub and Mul
+	//   Stack_Load p 8, Stack_Load q 8     -> Load_Load p q
+	void select_superinstructions() noexcept {
+		count_incoming();
+
+		for (size_t i = 0; i + 1 < code.size(); ++i) {
+			auto& a = code[i];
+			auto& b = code[i + 1];
+			if (incoming[i + 1]) continue;
+
+			if (b.typecheck(IS::Instruction::If_Not_Jmp_Rel_Kind)) {
+				// The jump moves back by one to stay relative to where it now is.
+				int dt = b.If_Not_Jmp_Rel_.dt_ip + 1;
+				bool fused = true;
+				switch (a.kind) {
+				#define X(k) case IS::Instruction::k##_Kind: a = IS::Jmp_Unless_##k{ dt }; break;
+				IS_COMPARISON_LIST(X)
+				#undef X
+				default: fused = false; break;
+				}
+				if (fused) b = {};
+				continue;
+			}
+
+			bool load_load =
+				a.typecheck(IS::Instruction::Stack_Load_Kind) &&
+				b.typecheck(IS::Instruction::Stack_Load_Kind) &&
+				a.Stack_Load_.n == 8 &&
+				b.Stack_Load_.n == 8;
+			if (!load_load) continue;
+
+			size_t p = a.Stack_Load_.memory_ptr;
+			size_t q = b.Stack_Load_.memory_ptr;
+			b = {};
+			a = IS::Load_Load{ p, q };
+			if (i + 2 >= code.size() || incoming[i + 2]) continue;
+
+			auto& op = code[i + 2];
+			bool fused = true;
+			switch (op.kind) {
+			#define X(k) case IS::Instruction::k##_Kind: a = IS::Load_Load_##k{ p, q }; break;
+			IS_LOAD_LOAD_LIST(X)
+			#undef X
+			default: fused = false; break;
+			}
+			if (fused) op = {};
+		}
+	}
+
+	bool remove_unreachable() noexcept {
+		std::vector<bool> reached(code.size(), false);
+		std::vector<size_t> open = entries();
+
+		while (!open.empty()) {
+			auto i = open.back();
+			open.pop_back();
+			if (i >= code.size() || reached[i]) continue;
+			reached[i] = true;
+
+			auto& x = code[i];
+			if (is_jump(x)) open.push_back(target(i));
+
+			bool falls_through =
+				x.kind != IS::Instruction::Jmp_Rel_Kind &&
+				x.kind != IS::Instruction::Ret_Kind &&
+				x.kind != IS::Instruction::Tail_Call_At_Kind &&
+				x.kind != IS::Instruction::Tail_Call_Kind &&
+				x.kind != IS::Instruction::Exit_Kind;
+			if (falls_through) open.push_back(i + 1);
+		}
+
+		bool changed = false;
+		for (size_t i = 0; i < code.size(); ++i) if (!reached[i] && code[i].kind) {
+			code[i] = {};
+			changed = true;
+		}
+		return changed;
+	}
+
+	// Drops the Nones and moves everything that refers to a code index.
+	void compact() noexcept {
+		// Where each instruction ends up, a None ends up where the next instruction left does.
+		std::vector<size_t> new_idx(code.size() + 1);
+		size_t n = 0;
+		for (size_t i = 0; i < code.size(); ++i) {
+			new_idx[i] = n;
+			if (code[i].kind) n++;
+		}
+		new_idx[code.size()] = n;
+		if (n == code.size()) return;
+
+		for (size_t i = 0; i < code.size(); ++i) {
+			auto& x = code[i];
+			if (is_jump(x)) set_dt(x, (int)new_idx[target(i)] - (int)new_idx[i]);
+			if (x.typecheck(IS::Instruction::Call_Kind)) x.Call_.f_idx = new_idx[x.Call_.f_idx];
+			if (x.typecheck(IS::Instruction::Tail_Call_Kind))
+				x.Tail_Call_.f_idx = new_idx[x.Tail_Call_.f_idx];
+		}
+
+		for (auto cst : program.function_constants) {
+			std::uint64_t address = new_idx[function_address(cst)];
+			memcpy(program.data.data() + cst, &address, sizeof(address));
+		}
+
+		std::unordered_set<size_t> pure_addresses;
+		for (auto x : program.pure_addresses) pure_addresses.insert(new_idx[x]);
+		program.pure_addresses = std::move(pure_addresses);
+
+		std::unordered_map<size_t, std::string> annotations;
+		for (auto& [i, x] : program.annotations) if (code[i].kind) annotations[new_idx[i]] = x;
+		program.annotations = std::move(annotations);
+
+		std::vector<IS::Instruction> res;
+		std::vector<AST::Source_Code_Loc> locs;
+		res.reserve(n);
+		locs.reserve(n);
+		for (size_t i = 0; i < code.size(); ++i) if (code[i].kind) {
+			res.push_back(code[i]);
+			locs.push_back(program.locs[i]);
+		}
+		code = std::move(res);
+		program.locs = std::move(locs);
+	}
+
+	// Every litteral has its own constant in data as it's compiled, the same 0 or 1 is in there
+	// hundreds of times. They are interned by value: each Constant loading the same bytes reads
+	// the same one. Proc addresses are their own kind and never shared, compact() rewrites them.
+	//
+	// Each is aligned on its size up to 16 bytes, and the hottest go first so the ones loops load
+	// share a few cache lines. How hot is the number of loads weighted by how many loops they
+	// are in, a backward jump being a loop over what it jumps back over.
+	void pool_constants() noexcept {
+		std::vector<int> depth(code.size() + 1, 0);
+		for (size_t i = 0; i < code.size(); ++i) {
+			size_t t = target(i);
+			if (!is_jump(code[i]) || t > i) continue;
+			depth[t]++;
+			depth[i + 1]--;
+		}
+		for (size_t i = 1; i < code.size(); ++i) depth[i] += depth[i - 1];
+
+		struct Entry {
+			size_t offset = 0;
+			size_t n = 0;
+			size_t heat = 0;
+		};
+		std::vector<Entry> entries;
+		std::unordered_map<size_t, size_t> procs;
+		std::unordered_map<std::string_view, size_t> values;
+
+		for (auto cst : program.function_constants) {
+			procs[cst] = entries.size();
+			entries.push_back({ cst, sizeof(std::uint64_t) });
+		}
+
+		// Which entry each Constant loads.
+		std::vector<size_t> loads(code.size(), SIZE_MAX);
+		for (size_t i = 0; i < code.size(); ++i) {
+			if (!code[i].typecheck(IS::Instruction::Constant_Kind)) continue;
+			auto& x = code[i].Constant_;
+
+			size_t e;
+			if (auto it = procs.find(x.ptr); it != std::end(procs)) e = it->second;
+			else {
+				std::string_view bytes((const char*)program.data.data() + x.ptr, x.n);
+				auto [it2, inserted] = values.emplace(bytes, entries.size());
+				if (inserted) entries.push_back({ x.ptr, x.n });
+				e = it2->second;
+			}
+			entries[e].heat += (size_t)1 << (3 * std::min(depth[i], 6));
+			loads[i] = e;
+		}
+
+		// Stable, the same program always gives the same pool.
+		std::vector<size_t> order(entries.size());
+		for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+		std::stable_sort(std::begin(order), std::end(order), [&] (size_t a, size_t b) {
+			return entries[a].heat > entries[b].heat;
+		});
+
+		std::vector<std::uint8_t> data;
+		std::vector<size_t> offsets(entries.size());
+		for (auto e : order) {
+			size_t align = 1;
+			while (align < entries[e].n && align < 16) align *= 2;
+			data.resize((data.size() + align - 1) / align * align);
+
+			offsets[e] = data.size();
+			auto* from = program.data.data() + entries[e].offset;
+			data.insert(std::end(data), from, from + entries[e].n);
+		}
+
+		for (size_t i = 0; i < code.size(); ++i)
+			if (loads[i] != SIZE_MAX) code[i].Constant_.ptr = offsets[loads[i]];
+		for (auto& cst : program.function_constants) cst = offsets[procs[cst]];
+		program.data = std::move(data);
+	}
+};
+
+void peephole(Program& program) noexcept {
+	Peephole p(program);
+
+	// Each pass can open up work for the others, a threaded jump can make a Pop unreachable that
+	// was in the middle of a sequence and so on. It settles in a few rounds.
+	for (bool changed = true; changed;) {
+		changed = false;
+		changed |= p.thread_jumps();
+		changed |= p.fold_branches();
+		changed |= p.fold_sequences();
+		changed |= p.remove_unreachable();
+		p.compact();
+	}
+
+	p.select_superinstructions();
+	p.compact();
+	p.pool_constants();
+
+	program.encode();
+}
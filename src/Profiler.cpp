@@ -0,0 +1,336 @@
+#include "Profiler.hpp"
+#include "Bytecode.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+static std::uint64_t now_ns() noexcept {
+	auto epoch = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(epoch).count();
+}
+
+void AST_Profiler::begin(const std::vector<AST::Node>& nodes) noexcept {
+	node_stats.clear();
+	node_stats.resize(nodes.size());
+	line_stats.clear();
+	function_stats.clear();
+	function_names.clear();
+
+	frames.clear();
+	frames.emplace_back();
+	current_frame = 0;
+
+	node_timers.clear();
+	function_timers.clear();
+}
+
+void AST_Profiler::enter_node(size_t idx, size_t line) noexcept {
+	Timer t;
+	t.idx = idx;
+	t.line = line;
+	t.start_ns = now_ns();
+	node_timers.push_back(t);
+}
+
+void AST_Profiler::exit_node() noexcept {
+	auto t = node_timers.back();
+	node_timers.pop_back();
+
+	std::uint64_t inclusive = now_ns() - t.start_ns;
+	std::uint64_t exclusive = inclusive - std::min(inclusive, t.children_ns);
+
+	if (t.idx >= node_stats.size()) node_stats.resize(t.idx + 1);
+	auto& stat = node_stats[t.idx];
+	stat.count++;
+	stat.inclusive_ns += inclusive;
+	stat.exclusive_ns += exclusive;
+
+	// A line's inclusive time only counts the outermost node on it, otherwise `a + b * c` would
+	// count the same nanoseconds three times.
+	auto& line = line_stats[t.line];
+	line.count++;
+	line.exclusive_ns += exclusive;
+	if (node_timers.empty() || node_timers.back().line != t.line) line.inclusive_ns += inclusive;
+
+	if (!node_timers.empty()) node_timers.back().children_ns += inclusive;
+}
+
+void AST_Profiler::enter_function(size_t definition_idx, std::string_view name) noexcept {
+	auto& children = frames[current_frame].children;
+	auto it = children.find(definition_idx);
+	size_t frame_idx = 0;
+	if (it == children.end()) {
+		frame_idx = frames.size();
+		children[definition_idx] = frame_idx;
+
+		Frame f;
+		f.parent = current_frame;
+		f.definition_idx = definition_idx;
+		frames.push_back(std::move(f));
+	} else {
+		frame_idx = it->second;
+	}
+	current_frame = frame_idx;
+
+	if (!name.empty()) function_names[definition_idx] = name;
+
+	Timer t;
+	t.idx = definition_idx;
+	t.start_ns = now_ns();
+	function_timers.push_back(t);
+}
+
+void AST_Profiler::exit_function() noexcept {
+	auto t = function_timers.back();
+	function_timers.pop_back();
+
+	std::uint64_t inclusive = now_ns() - t.start_ns;
+	std::uint64_t exclusive = inclusive - std::min(inclusive, t.children_ns);
+
+	// Recursive calls would add the same time once per level to the inclusive total, only the
+	// outermost activation of a function contributes to it.
+	bool recursive = false;
+	for (auto& x : function_timers) recursive |= x.idx == t.idx;
+
+	auto& stat = function_stats[t.idx];
+	stat.count++;
+	if (!recursive) stat.inclusive_ns += inclusive;
+	stat.exclusive_ns += exclusive;
+
+	frames[current_frame].exclusive_ns += exclusive;
+	current_frame = frames[current_frame].parent;
+
+	if (!function_timers.empty()) function_timers.back().children_ns += inclusive;
+}
+
+static std::string frame_label(
+	const AST_Profiler& profiler, const std::vector<AST::Node>& nodes, size_t definition_idx
+) noexcept {
+	std::string res = "<proc>";
+	auto it = profiler.function_names.find(definition_idx);
+	if (it != profiler.function_names.end()) res = std::string(it->second);
+	if (definition_idx < nodes.size())
+		res += ":" + std::to_string(nodes[definition_idx]->loc.line + 1);
+	return res;
+}
+
+bool AST_Profiler::write_folded(
+	const char* path, const std::vector<AST::Node>& nodes
+) const noexcept {
+	FILE* out = fopen(path, "w");
+	if (!out) return false;
+	defer { fclose(out); };
+
+	// Whatever the nodes measured that no function claimed is the script's own top level.
+	std::uint64_t script_ns = 0;
+	for (auto& x : line_stats) script_ns += x.second.exclusive_ns;
+	for (size_t i = 1; i < frames.size(); ++i)
+		script_ns -= std::min(script_ns, frames[i].exclusive_ns);
+	if (script_ns) fprintf(out, "<script> %llu\n", (unsigned long long)script_ns);
+
+	std::vector<size_t> path_idx;
+	for (size_t i = 1; i < frames.size(); ++i) {
+		if (!frames[i].exclusive_ns) continue;
+
+		path_idx.clear();
+		for (size_t f = i; f; f = frames[f].parent) path_idx.push_back(f);
+
+		std::string line = "<script>";
+		for (auto it = path_idx.rbegin(); it != path_idx.rend(); ++it)
+			line += ";" + frame_label(*this, nodes, frames[*it].definition_idx);
+
+		fprintf(out, "%s %llu\n", line.c_str(), (unsigned long long)frames[i].exclusive_ns);
+	}
+
+	return true;
+}
+
+// The text of each line of the file, without its indentation.
+struct Source_Lines {
+	std::string_view file;
+	std::vector<size_t> starts = { 0 };
+
+	Source_Lines(std::string_view file) noexcept : file(file) {
+		for (size_t i = 0; i < file.size(); ++i) if (file[i] == '\n') starts.push_back(i + 1);
+	}
+
+	std::string_view operator()(size_t line) const noexcept {
+		if (line >= starts.size()) return {};
+		size_t start = starts[line];
+		size_t end = line + 1 < starts.size() ? starts[line + 1] - 1 : file.size();
+		while (start < end && (file[start] == '\t' || file[start] == ' ')) start++;
+		return file.substr(start, end - start);
+	}
+};
+
+void AST_Profiler::report(
+	const std::vector<AST::Node>& nodes, std::string_view file, size_t max_lines
+) const noexcept {
+	Source_Lines source_line(file);
+
+	std::vector<std::pair<size_t, Stat>> lines(line_stats.begin(), line_stats.end());
+	std::sort(std::begin(lines), std::end(lines), [] (auto& a, auto& b) {
+		return a.second.exclusive_ns > b.second.exclusive_ns;
+	});
+
+	printlns("Hot lines (sorted by exclusive time)");
+	printlns("  line        count     incl ms     excl ms  source");
+	for (size_t i = 0; i < lines.size() && i < max_lines; ++i) {
+		auto& [line, stat] = lines[i];
+		auto src = source_line(line);
+		println(
+			"%6zu %12zu %11.3f %11.3f  %.*s",
+			line + 1,
+			stat.count,
+			stat.inclusive_ns / 1'000'000.0,
+			stat.exclusive_ns / 1'000'000.0,
+			(int)std::min<size_t>(src.size(), 60),
+			src.data()
+		);
+	}
+
+	// Within the lines, the nodes the time goes to, where they start and the source they span.
+	std::vector<size_t> hot_nodes;
+	for (size_t i = 0; i < node_stats.size() && i < nodes.size(); ++i)
+		if (node_stats[i].count) hot_nodes.push_back(i);
+	std::sort(std::begin(hot_nodes), std::end(hot_nodes), [&] (size_t a, size_t b) {
+		return node_stats[a].exclusive_ns > node_stats[b].exclusive_ns;
+	});
+
+	printlns("");
+	printlns("Hot nodes (sorted by exclusive time)");
+	printlns("  line:col       count     incl ms     excl ms  node                  source");
+	for (size_t i = 0; i < hot_nodes.size() && i < max_lines; ++i) {
+		auto idx = hot_nodes[i];
+		auto& stat = node_stats[idx];
+		auto& loc = nodes[idx]->loc;
+
+		size_t start = loc.line < source_line.starts.size() ? source_line.starts[loc.line] : 0;
+		size_t col = loc.offset >= start ? loc.offset - start + 1 : 0;
+		auto src = loc.offset < file.size() ? file.substr(loc.offset, loc.length) : std::string_view{};
+		src = src.substr(0, std::min(src.find('\n'), (size_t)40));
+
+		println(
+			"%6zu:%-4zu %11zu %11.3f %11.3f  %-20s  %.*s",
+			loc.line + 1,
+			col,
+			stat.count,
+			stat.inclusive_ns / 1'000'000.0,
+			stat.exclusive_ns / 1'000'000.0,
+			nodes[idx].name(),
+			(int)src.size(),
+			src.data()
+		);
+	}
+
+	std::vector<std::pair<size_t, Stat>> functions(function_stats.begin(), function_stats.end());
+	std::sort(std::begin(functions), std::end(functions), [] (auto& a, auto& b) {
+		return a.second.inclusive_ns > b.second.inclusive_ns;
+	});
+
+	printlns("");
+	printlns("Functions (sorted by inclusive time)");
+	printlns("  function                  calls     incl ms     excl ms");
+	for (auto& [idx, stat] : functions) {
+		println(
+			"  %-20s %10zu %11.3f %11.3f",
+			frame_label(*this, nodes, idx).c_str(),
+			stat.count,
+			stat.inclusive_ns / 1'000'000.0,
+			stat.exclusive_ns / 1'000'000.0
+		);
+	}
+}
+
+void Opcode_Profiler::record(size_t ip, std::uint8_t opcode) noexcept {
+	if (pairs.empty()) pairs.resize(1 << 16);
+
+	total++;
+	counts[opcode]++;
+
+	if (ip >= ip_counts.size()) ip_counts.resize(ip + 1);
+	ip_counts[ip]++;
+
+	// A sequence broken by a jump or a call can't be fused, start over.
+	if (ip != last_ip + 1) window_size = 0;
+	last_ip = ip;
+
+	window = (window << 8) | opcode;
+	window_size++;
+
+	if (window_size >= 2) pairs[window & 0xFFFF]++;
+	if (window_size >= 3) triples[window & 0xFFFFFF]++;
+}
+
+static const char* bytecode_opcode_name(std::uint8_t opcode) noexcept {
+	IS::Instruction x;
+	x.kind = (IS::Instruction::Kind)opcode;
+	return x.name();
+}
+
+void Opcode_Profiler::report(size_t max_lines) const noexcept {
+	auto percent = [&] (std::uint64_t n) { return total ? 100.0 * n / total : 0.0; };
+	auto name = opcode_name ? opcode_name : bytecode_opcode_name;
+
+	std::vector<std::pair<std::uint32_t, std::uint64_t>> sorted;
+	auto print_top = [&] (size_t width) {
+		std::sort(std::begin(sorted), std::end(sorted), [] (auto& a, auto& b) {
+			return a.second > b.second;
+		});
+		for (size_t i = 0; i < sorted.size() && i < max_lines; ++i) {
+			auto [key, n] = sorted[i];
+
+			std::string names;
+			for (size_t j = width; j > 0; --j) {
+				if (!names.empty()) names += ", ";
+				names += name((key >> (8 * (j - 1))) & 0xFF);
+			}
+			println("  %12llu %6.2f%%  %s", (unsigned long long)n, percent(n), names.c_str());
+		}
+	};
+
+	println("%llu instructions run", (unsigned long long)total);
+
+	printlns("Opcodes");
+	sorted.clear();
+	for (size_t i = 0; i < 256; ++i) if (counts[i]) sorted.push_back({ (std::uint32_t)i, counts[i] });
+	print_top(1);
+
+	printlns("Pairs");
+	sorted.clear();
+	for (size_t i = 0; i < pairs.size(); ++i) if (pairs[i]) sorted.push_back({ (std::uint32_t)i, pairs[i] });
+	print_top(2);
+
+	printlns("Triples");
+	sorted.assign(std::begin(triples), std::end(triples));
+	print_top(3);
+}
+
+void Opcode_Profiler::report_lines(
+	const Line_Table& table, std::string_view file, size_t max_lines
+) const noexcept {
+	Source_Lines source_line(file);
+
+	std::unordered_map<size_t, std::uint64_t> line_counts;
+	for (size_t ip = 0; ip < ip_counts.size(); ++ip)
+		if (ip_counts[ip]) line_counts[table.find(ip).line] += ip_counts[ip];
+
+	std::vector<std::pair<size_t, std::uint64_t>> lines(line_counts.begin(), line_counts.end());
+	std::sort(std::begin(lines), std::end(lines), [] (auto& a, auto& b) {
+		return a.second > b.second;
+	});
+
+	printlns("Hot lines (sorted by instructions run)");
+	printlns("  line  instructions  source");
+	for (size_t i = 0; i < lines.size() && i < max_lines; ++i) {
+		auto [line, n] = lines[i];
+		auto src = source_line(line);
+		println(
+			"%6zu %13llu  %.*s",
+			line + 1,
+			(unsigned long long)n,
+			(int)std::min<size_t>(src.size(), 60),
+			src.data()
+		);
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+#include "AST.hpp"
+#include "xstd.hpp"
+
+// Opt-in source level profiler for the AST_Interpreter. The interpreter only holds a pointer to
+// it, so when nobody attached one the cost is a null check per evaluated node.
+struct AST_Profiler {
+	struct Stat {
+		size_t count = 0;
+		std::uint64_t inclusive_ns = 0;
+		std::uint64_t exclusive_ns = 0;
+	};
+
+	// A node in the call tree, one per distinct call stack. frames[0] is the top level script.
+	struct Frame {
+		size_t parent = 0;
+		size_t definition_idx = 0;
+		std::uint64_t exclusive_ns = 0;
+		std::unordered_map<size_t, size_t> children;
+	};
+
+	struct Timer {
+		size_t idx = 0;
+		size_t line = 0;
+		std::uint64_t start_ns = 0;
+		std::uint64_t children_ns = 0;
+	};
+
+	std::vector<Stat> node_stats; // indexed by AST node idx.
+	std::unordered_map<size_t, Stat> line_stats;
+	std::unordered_map<size_t, Stat> function_stats; // keyed by Function_Definition node idx.
+	std::unordered_map<size_t, std::string_view> function_names;
+
+	std::vector<Frame> frames;
+	size_t current_frame = 0;
+
+	std::vector<Timer> node_timers;
+	std::vector<Timer> function_timers;
+
+	void begin(const std::vector<AST::Node>& nodes) noexcept;
+
+	void enter_node(size_t idx, size_t line) noexcept;
+	void exit_node() noexcept;
+
+	void enter_function(size_t definition_idx, std::string_view name) noexcept;
+	void exit_function() noexcept;
+
+	// One line per call stack, "<script>;main:1;is_prime:2 <exclusive ns>", ready for
+	// flamegraph.pl or speedscope.
+	bool write_folded(const char* path, const std::vector<AST::Node>& nodes) const noexcept;
+	void report(
+		const std::vector<AST::Node>& nodes, std::string_view file, size_t max_lines = 20
+	) const noexcept;
+};
+
+struct Line_Table;
+
+// Opt-in opcode counter for the Bytecode_VM, the same way the AST_Profiler is for the
+// interpreter. Besides the count of each opcode it counts the pairs and triples that run one
+// after the other without a jump in between, these are the sequences worth a superinstruction.
+struct Opcode_Profiler {
+	std::uint64_t counts[256] = {};
+	std::vector<std::uint64_t> ip_counts;
+	std::vector<std::uint64_t> pairs; // indexed by first << 8 | second.
+	std::unordered_map<std::uint32_t, std::uint64_t> triples;
+	std::uint64_t total = 0;
+
+	size_t last_ip = SIZE_MAX;
+	std::uint32_t window = 0; // The last opcodes run, newest in the low byte.
+	size_t window_size = 0;
+
+	// The opcode names of the bytecode VM by default.
+	const char* (*opcode_name)(std::uint8_t opcode) = nullptr;
+
+	void record(size_t ip, std::uint8_t opcode) noexcept;
+	void report(size_t max_lines = 20) const noexcept;
+	// The instructions run per source line, the ips are mapped back to lines with the table.
+	void report_lines(
+		const Line_Table& table, std::string_view file, size_t max_lines = 10
+	) const noexcept;
+};
@@ -0,0 +1,1052 @@
+#include "Register.hpp"
+#include "xstd.hpp"
+
+#include <cmath>
+#include <thread>
+
+#define decl(name) static size_t name(\
+const std::vector<AST::Node>& nodes,\
+size_t idx,\
+Register_Program& program,\
+std::string_view file,\
+[[maybe_unused]] RI::Reg dst\
+) noexcept
+
+static constexpr size_t Real_Id = AST_Interpreter::Real_Type::unique_id;
+static constexpr size_t Int_Id  = AST_Interpreter::Int_Type::unique_id;
+static constexpr size_t Nat_Id  = AST_Interpreter::Nat_Type::unique_id;
+static constexpr size_t Byte_Id = AST_Interpreter::Byte_Type::unique_id;
+static constexpr size_t Bool_Id = AST_Interpreter::Bool_Type::unique_id;
+
+RI::Reg Register_Program::alloc_register() noexcept {
+	auto r = next_register++;
+	frame_size = std::max<size_t>(frame_size, next_register);
+	return r;
+}
+
+std::vector<RI::Instruction>& Register_Program::current_code() noexcept {
+	return functions[current_function].code;
+}
+
+void Register_Program::emit(RI::Instruction x) noexcept {
+	current_code().push_back(x);
+}
+
+static size_t unsupported(
+	const std::vector<AST::Node>& nodes, size_t idx, Register_Program& program, const char* what
+) noexcept {
+	if (program.ok)
+		println("Line %zu: %s is not supported by the register VM.", nodes[idx]->loc.line + 1, what);
+	program.ok = false;
+	return 0;
+}
+
+static bool is_integer(size_t type_id) noexcept {
+	return type_id == Int_Id || type_id == Nat_Id || type_id == Byte_Id;
+}
+
+static bool is_value_type(Register_Program& program, size_t type_id) noexcept {
+	if (type_id == Real_Id || type_id == Bool_Id || is_integer(type_id)) return true;
+	if (!program.interpreter.types.count(type_id)) return false;
+
+	auto& type = program.interpreter.types.at(type_id);
+	return
+		type.kind == AST_Interpreter::Type::User_Function_Type_Kind ||
+		type.kind == AST_Interpreter::Type::Function_Signature_Kind;
+}
+
+static std::uint32_t alloc_constant(Register_Program& program, RI::Register x) noexcept {
+	program.constants.push_back(x);
+	return program.constants.size() - 1;
+}
+
+// Writes a converted to the type `to` in dst, dst can be a. Returns the type dst ends up with,
+// anything that isn't a number is only moved.
+static size_t convert(
+	Register_Program& program, RI::Reg dst, RI::Reg a, size_t from, size_t to
+) noexcept {
+	bool from_number = from == Real_Id || is_integer(from);
+	bool to_number   = to   == Real_Id || is_integer(to);
+	if (from == to || !from_number || !to_number) {
+		if (dst != a) program.emit(RI::Move{ dst, a });
+		return from;
+	}
+
+	// An integer litteral just loaded and converted in place becomes a real litteral. Only in
+	// place, a variable's register could be the one that was loaded.
+	auto& code = program.current_code();
+	bool constant = !code.empty() && code.back().typecheck(RI::Instruction::Constant_Kind);
+	if (to == Real_Id && dst == a && constant && code.back().Constant_.dst == a) {
+		auto& x = program.constants[code.back().Constant_.idx];
+		x.r = from == Nat_Id ? (long double)x.u : (long double)x.i;
+		return to;
+	}
+
+	if (to == Real_Id) {
+		if (from == Nat_Id) program.emit(RI::U2R{ dst, a });
+		else                program.emit(RI::I2R{ dst, a });
+		return to;
+	}
+	if (from == Real_Id) {
+		if (to == Nat_Id) program.emit(RI::R2U{ dst, a });
+		else              program.emit(RI::R2I{ dst, a });
+		a = dst;
+	}
+	if (to == Byte_Id)  program.emit(RI::I2B{ dst, a });
+	else if (dst != a) program.emit(RI::Move{ dst, a });
+	return to;
+}
+
+static void set_jump(RI::Instruction& x, int dt) noexcept {
+	switch (x.kind) {
+	case RI::Instruction::Jmp_Kind:        x.Jmp_.dt_ip = dt; break;
+	case RI::Instruction::Jmp_Unless_Kind: x.Jmp_Unless_.dt_ip = dt; break;
+	#define X(k) case RI::Instruction::Jmp_Unless_##k##_Kind: x.Jmp_Unless_##k##_.dt_ip = dt; break;
+	RI_COMPARISON_LIST(X)
+	#undef X
+	default: break;
+	}
+}
+
+// Makes the jump at from land on the next instruction emitted.
+static void patch_jump(Register_Program& program, size_t from) noexcept {
+	auto& code = program.current_code();
+	set_jump(code[from], (int)code.size() - (int)from);
+}
+
+decl(expression   );
+decl(identifier   );
+decl(declaration  );
+decl(litteral     );
+decl(list_op      );
+decl(unary_op     );
+decl(group_stat   );
+decl(if_call      );
+decl(for_loop     );
+decl(function_call);
+decl(return_call  );
+
+static void statement(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file
+) noexcept {
+	// Whatever the statement used is free after it, except for the register a declaration takes.
+	auto old_register = program.next_register;
+	expression(nodes, idx, program, file, RI::No_Register);
+	program.next_register = old_register;
+	if (nodes[idx].typecheck(AST::Node::Declaration_Kind)) program.next_register++;
+}
+
+decl(expression) {
+	auto& node = nodes[idx];
+
+	// Those don't give a value, or only write it when somebody wants it.
+	bool may_discard =
+		node.kind == AST::Node::Function_Call_Kind ||
+		node.kind == AST::Node::If_Kind ||
+		node.kind == AST::Node::For_Kind ||
+		node.kind == AST::Node::Return_Call_Kind ||
+		node.kind == AST::Node::Declaration_Kind ||
+		node.kind == AST::Node::Group_Statement_Kind ||
+		(node.kind == AST::Node::Operation_List_Kind && node.Operation_List_.op == AST::Operator::Assign) ||
+		(node.kind == AST::Node::Unary_Operation_Kind && node.Unary_Operation_.op == AST::Operator::Inc);
+	if (dst == RI::No_Register && !may_discard) dst = program.alloc_register();
+
+	switch (node.kind) {
+	case AST::Node::Identifier_Kind:       return identifier   (nodes, idx, program, file, dst);
+	case AST::Node::Litteral_Kind:         return litteral     (nodes, idx, program, file, dst);
+	case AST::Node::Operation_List_Kind:   return list_op      (nodes, idx, program, file, dst);
+	case AST::Node::Unary_Operation_Kind:  return unary_op     (nodes, idx, program, file, dst);
+	case AST::Node::Group_Statement_Kind:  return group_stat   (nodes, idx, program, file, dst);
+	case AST::Node::If_Kind:               return if_call      (nodes, idx, program, file, dst);
+	case AST::Node::For_Kind:              return for_loop     (nodes, idx, program, file, dst);
+	case AST::Node::Function_Call_Kind:    return function_call(nodes, idx, program, file, dst);
+	case AST::Node::Return_Call_Kind:      return return_call  (nodes, idx, program, file, dst);
+	case AST::Node::Declaration_Kind:      return declaration  (nodes, idx, program, file, dst);
+	case AST::Node::Group_Expression_Kind:
+		return expression(nodes, node.Group_Expression_.inner_idx, program, file, dst);
+	default: return unsupported(nodes, idx, program, node.name());
+	}
+}
+
+static bool is_variable(const std::vector<AST::Node>& nodes, size_t idx) noexcept {
+	while (nodes[idx].typecheck(AST::Node::Group_Expression_Kind))
+		idx = nodes[idx].Group_Expression_.inner_idx;
+	return nodes[idx].typecheck(AST::Node::Identifier_Kind);
+}
+
+// Whether idx reads nothing but variables and litterals, see list_op.
+static bool is_leaf(const std::vector<AST::Node>& nodes, size_t idx) noexcept {
+	while (nodes[idx].typecheck(AST::Node::Group_Expression_Kind))
+		idx = nodes[idx].Group_Expression_.inner_idx;
+	return
+		nodes[idx].typecheck(AST::Node::Identifier_Kind) ||
+		nodes[idx].typecheck(AST::Node::Litteral_Kind);
+}
+
+// The register holding the value of idx. A variable is read from its own register, the others
+// are computed in a new one.
+static size_t operand(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file,
+	RI::Reg& r
+) noexcept {
+	while (nodes[idx].typecheck(AST::Node::Group_Expression_Kind))
+		idx = nodes[idx].Group_Expression_.inner_idx;
+
+	if (nodes[idx].typecheck(AST::Node::Identifier_Kind)) {
+		auto& node = nodes[idx].Identifier_;
+		auto id = program.interpreter.lookup(string_view_from_view(file, node.token.lexeme));
+		if (!id.typecheck(AST_Interpreter::Value::Identifier_Kind))
+			return unsupported(nodes, idx, program, "This identifier");
+
+		r = id.Identifier_.memory_idx;
+		return id.Identifier_.type_descriptor_id;
+	}
+
+	r = program.alloc_register();
+	return expression(nodes, idx, program, file, r);
+}
+
+// Evaluates idx in dst as the type `to`, without a copy when it's a variable.
+static size_t expression_as(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file,
+	RI::Reg dst,
+	size_t to
+) noexcept {
+	if (is_variable(nodes, idx)) {
+		RI::Reg a = 0;
+		size_t type = operand(nodes, idx, program, file, a);
+		return convert(program, dst, a, type, to);
+	}
+	size_t type = expression(nodes, idx, program, file, dst);
+	return convert(program, dst, dst, type, to);
+}
+
+decl(identifier) {
+	RI::Reg r = 0;
+	auto type = operand(nodes, idx, program, file, r);
+	if (dst != r) program.emit(RI::Move{ dst, r });
+	return type;
+}
+
+decl(litteral) {
+	auto& node = nodes[idx].Litteral_;
+	auto view = string_view_from_view(file, node.token.lexeme);
+
+	RI::Register x = {};
+	size_t type = 0;
+	if (node.token.type == Token::Type::Number) {
+		std::int64_t i = 0;
+		if (AST_Interpreter::parse_integer(view, i)) {
+			x.i = i;
+			type = Int_Id;
+		} else {
+			x.r = std::strtold(std::string(view).c_str(), nullptr);
+			type = Real_Id;
+		}
+	} else if (node.token.type == Token::Type::True) {
+		x.r = 1;
+		type = Bool_Id;
+	} else if (node.token.type == Token::Type::False) {
+		x.r = 0;
+		type = Bool_Id;
+	} else {
+		return unsupported(nodes, idx, program, "This litteral");
+	}
+
+	program.emit(RI::Constant{ dst, alloc_constant(program, x) });
+	return type;
+}
+
+static bool is_comparison(AST::Operator op) noexcept {
+	return
+		op == AST::Operator::Eq || op == AST::Operator::Neq ||
+		op == AST::Operator::Lt || op == AST::Operator::Leq ||
+		op == AST::Operator::Gt;
+}
+
+// Both sides of a binary operation in registers, promoted to reals unless both are integers.
+struct Binary_Operands {
+	RI::Reg a = 0;
+	RI::Reg b = 0;
+	bool integer = false;
+	bool nat = false;
+	size_t type = 0;
+};
+static Binary_Operands binary_operands(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file
+) noexcept {
+	auto& node = nodes[idx].Operation_List_;
+
+	Binary_Operands res;
+	size_t left  = operand(nodes, node.left_idx, program, file, res.a);
+	size_t right = operand(nodes, node.rest_idx, program, file, res.b);
+	if (left  == Byte_Id) left  = Int_Id;
+	if (right == Byte_Id) right = Int_Id;
+
+	if (is_integer(left) && is_integer(right)) {
+		res.integer = true;
+		res.nat = left == Nat_Id || right == Nat_Id;
+		res.type = res.nat ? Nat_Id : Int_Id;
+		return res;
+	}
+
+	// Variables are converted in a new register, anything else in place.
+	if (is_integer(left)) {
+		auto t = is_variable(nodes, node.left_idx) ? program.alloc_register() : res.a;
+		convert(program, t, res.a, left, Real_Id);
+		res.a = t;
+	}
+	if (is_integer(right)) {
+		auto t = is_variable(nodes, node.rest_idx) ? program.alloc_register() : res.b;
+		convert(program, t, res.b, right, Real_Id);
+		res.b = t;
+	}
+	res.type = Real_Id;
+	return res;
+}
+
+static RI::Instruction binary_instruction(
+	AST::Operator op, const Binary_Operands& x, RI::Reg dst
+) noexcept {
+	auto [a, b, integer, nat, type] = x;
+	if (integer) switch (op) {
+	case AST::Operator::Plus:  return RI::Add_I{ dst, a, b };
+	case AST::Operator::Minus: return RI::Sub_I{ dst, a, b };
+	case AST::Operator::Star:  return RI::Mul_I{ dst, a, b };
+	case AST::Operator::Div:   return nat ? RI::Instruction(RI::Div_U{ dst, a, b }) : RI::Div_I{ dst, a, b };
+	case AST::Operator::Mod:   return nat ? RI::Instruction(RI::Mod_U{ dst, a, b }) : RI::Mod_I{ dst, a, b };
+	case AST::Operator::Eq:    return RI::Eq_I{ dst, a, b };
+	case AST::Operator::Neq:   return RI::Neq_I{ dst, a, b };
+	case AST::Operator::Lt:    return nat ? RI::Instruction(RI::Lt_U{ dst, a, b }) : RI::Lt_I{ dst, a, b };
+	case AST::Operator::Leq:   return nat ? RI::Instruction(RI::Leq_U{ dst, a, b }) : RI::Leq_I{ dst, a, b };
+	case AST::Operator::Gt:    return nat ? RI::Instruction(RI::Gt_U{ dst, a, b }) : RI::Gt_I{ dst, a, b };
+	default: return {};
+	}
+	switch (op) {
+	case AST::Operator::Plus:  return RI::Add{ dst, a, b };
+	case AST::Operator::Minus: return RI::Sub{ dst, a, b };
+	case AST::Operator::Star:  return RI::Mul{ dst, a, b };
+	case AST::Operator::Div:   return RI::Div{ dst, a, b };
+	case AST::Operator::Mod:   return RI::Mod{ dst, a, b };
+	case AST::Operator::Eq:    return RI::Eq{ dst, a, b };
+	case AST::Operator::Neq:   return RI::Neq{ dst, a, b };
+	case AST::Operator::Lt:    return RI::Lt{ dst, a, b };
+	case AST::Operator::Leq:   return RI::Leq{ dst, a, b };
+	case AST::Operator::Gt:    return RI::Gt{ dst, a, b };
+	default: return {};
+	}
+}
+
+// The comparison turned into a jump taken when it doesn't hold.
+static RI::Instruction branch_instruction(AST::Operator op, const Binary_Operands& x) noexcept {
+	auto [a, b, integer, nat, type] = x;
+	if (integer) switch (op) {
+	case AST::Operator::Eq:  return RI::Jmp_Unless_Eq_I{ a, b };
+	case AST::Operator::Neq: return RI::Jmp_Unless_Neq_I{ a, b };
+	case AST::Operator::Lt:
+		return nat ? RI::Instruction(RI::Jmp_Unless_Lt_U{ a, b }) : RI::Jmp_Unless_Lt_I{ a, b };
+	case AST::Operator::Leq:
+		return nat ? RI::Instruction(RI::Jmp_Unless_Leq_U{ a, b }) : RI::Jmp_Unless_Leq_I{ a, b };
+	case AST::Operator::Gt:
+		return nat ? RI::Instruction(RI::Jmp_Unless_Gt_U{ a, b }) : RI::Jmp_Unless_Gt_I{ a, b };
+	default: return {};
+	}
+	switch (op) {
+	case AST::Operator::Eq:  return RI::Jmp_Unless_Eq{ a, b };
+	case AST::Operator::Neq: return RI::Jmp_Unless_Neq{ a, b };
+	case AST::Operator::Lt:  return RI::Jmp_Unless_Lt{ a, b };
+	case AST::Operator::Leq: return RI::Jmp_Unless_Leq{ a, b };
+	case AST::Operator::Gt:  return RI::Jmp_Unless_Gt{ a, b };
+	default: return {};
+	}
+}
+
+decl(list_op) {
+	auto& node = nodes[idx].Operation_List_;
+
+	if (node.op == AST::Operator::Assign) {
+		if (!nodes[node.left_idx].typecheck(AST::Node::Identifier_Kind))
+			return unsupported(nodes, idx, program, "Assigning to anything but a variable");
+
+		RI::Reg var = 0;
+		size_t var_type = operand(nodes, node.left_idx, program, file, var);
+
+		// a = b + c can write a directly, the only instruction writing it comes after all the
+		// reads. Something longer like a = (a + b) * a would see a already overwritten.
+		auto& rest = nodes[node.rest_idx];
+		bool direct =
+			is_leaf(nodes, node.rest_idx) || (
+				rest.typecheck(AST::Node::Operation_List_Kind) &&
+				rest.Operation_List_.op != AST::Operator::Assign &&
+				rest.Operation_List_.op != AST::Operator::As &&
+				is_leaf(nodes, rest.Operation_List_.left_idx) &&
+				is_leaf(nodes, rest.Operation_List_.rest_idx)
+			);
+
+		RI::Reg value = direct ? var : program.alloc_register();
+		size_t value_type = expression(nodes, node.rest_idx, program, file, value);
+		convert(program, var, value, value_type, var_type);
+
+		if (dst != RI::No_Register) program.emit(RI::Move{ dst, var });
+		return var_type;
+	}
+	if (node.op == AST::Operator::As) {
+		RI::Reg a = 0;
+		size_t from = operand(nodes, node.left_idx, program, file, a);
+		auto to = program.interpreter.type_interpret(nodes, node.rest_idx, file).get_unique_id();
+		if (!is_value_type(program, from) || !is_value_type(program, to))
+			return unsupported(nodes, idx, program, "This cast");
+		return convert(program, dst, a, from, to);
+	}
+
+	auto x = binary_operands(nodes, idx, program, file);
+	auto inst = binary_instruction(node.op, x, dst);
+	if (!inst.kind) return unsupported(nodes, idx, program, AST::op_to_string(node.op));
+
+	program.emit(inst);
+	return is_comparison(node.op) ? Real_Id : x.type;
+}
+
+decl(unary_op) {
+	auto& node = nodes[idx].Unary_Operation_;
+
+	RI::Reg a = 0;
+	switch (node.op) {
+	case AST::Operator::Minus: {
+		size_t type = operand(nodes, node.right_idx, program, file, a);
+		if (is_integer(type)) {
+			program.emit(RI::Neg_I{ dst, a });
+			return Int_Id;
+		}
+		program.emit(RI::Neg{ dst, a });
+		return Real_Id;
+	}
+	case AST::Operator::Not: {
+		// Not works on reals, like Jmp_Unless an integer is converted first.
+		size_t type = operand(nodes, node.right_idx, program, file, a);
+		if (is_integer(type)) {
+			auto t = program.alloc_register();
+			convert(program, t, a, type, Real_Id);
+			a = t;
+		}
+		program.emit(RI::Not{ dst, a });
+		return Bool_Id;
+	}
+	case AST::Operator::Inc: {
+		if (!nodes[node.right_idx].typecheck(AST::Node::Identifier_Kind))
+			return unsupported(nodes, idx, program, "Incrementing anything but a variable");
+
+		size_t type = operand(nodes, node.right_idx, program, file, a);
+		if (is_integer(type)) program.emit(RI::Inc_I{ a });
+		else                  program.emit(RI::Inc{ a });
+		return AST_Interpreter::Void_Type::unique_id;
+	}
+	default:
+		return unsupported(nodes, idx, program, AST::op_to_string(node.op));
+	}
+}
+
+decl(group_stat) {
+	auto& node = nodes[idx].Group_Statement_;
+
+	auto old_register = program.next_register;
+	program.interpreter.push_scope();
+	defer {
+		program.interpreter.pop_scope();
+		program.next_register = old_register;
+	};
+
+	for (size_t i = node.inner_idx; i && program.ok; i = nodes[i]->next_statement)
+		statement(nodes, i, program, file);
+	return 0;
+}
+
+// Emits a jump taken when the condition is false and returns where it is to patch it. A
+// comparison is fused with the jump.
+static size_t branch_unless(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file
+) noexcept {
+	while (nodes[idx].typecheck(AST::Node::Group_Expression_Kind))
+		idx = nodes[idx].Group_Expression_.inner_idx;
+
+	auto& node = nodes[idx];
+	if (node.typecheck(AST::Node::Operation_List_Kind) && is_comparison(node.Operation_List_.op)) {
+		auto x = binary_operands(nodes, idx, program, file);
+		program.emit(branch_instruction(node.Operation_List_.op, x));
+		return program.current_code().size() - 1;
+	}
+
+	RI::Reg a = 0;
+	size_t type = operand(nodes, idx, program, file, a);
+	if (is_integer(type)) {
+		auto t = program.alloc_register();
+		convert(program, t, a, type, Real_Id);
+		a = t;
+	}
+	program.emit(RI::Jmp_Unless{ a });
+	return program.current_code().size() - 1;
+}
+
+decl(if_call) {
+	auto& node = nodes[idx].If_;
+
+	auto old_register = program.next_register;
+	auto jmp_else = branch_unless(nodes, node.condition_idx, program, file);
+	program.next_register = old_register;
+
+	statement(nodes, node.if_statement_idx, program, file);
+
+	if (!node.else_statement_idx) {
+		patch_jump(program, jmp_else);
+		return 0;
+	}
+
+	auto jmp_out = program.current_code().size();
+	program.emit(RI::Jmp{});
+	patch_jump(program, jmp_else);
+
+	statement(nodes, node.else_statement_idx, program, file);
+	patch_jump(program, jmp_out);
+	return 0;
+}
+
+decl(for_loop) {
+	auto& node = nodes[idx].For_;
+
+	auto old_register = program.next_register;
+	program.interpreter.push_scope();
+	defer {
+		program.interpreter.pop_scope();
+		program.next_register = old_register;
+	};
+
+	if (node.init_statement_idx) statement(nodes, node.init_statement_idx, program, file);
+
+	size_t top = program.current_code().size();
+	auto loop_register = program.next_register;
+	auto jmp_out = branch_unless(nodes, node.cond_statement_idx, program, file);
+	program.next_register = loop_register;
+
+	statement(nodes, node.loop_statement_idx, program, file);
+	if (node.next_statement_idx) statement(nodes, node.next_statement_idx, program, file);
+
+	program.emit(RI::Jmp{ (int)top - (int)program.current_code().size() });
+	patch_jump(program, jmp_out);
+	return 0;
+}
+
+decl(return_call) {
+	auto& node = nodes[idx].Return_Call_;
+
+	if (!node.return_value_idx) {
+		program.emit(RI::Ret_Void{});
+		return 0;
+	}
+	if (nodes[node.return_value_idx]->next_statement)
+		return unsupported(nodes, idx, program, "Returning several values");
+
+	RI::Reg a = 0;
+	size_t type = operand(nodes, node.return_value_idx, program, file, a);
+	if (program.current_return_type && type != program.current_return_type) {
+		// Converting in place is fine unless it's a variable.
+		auto t = is_variable(nodes, node.return_value_idx) ? program.alloc_register() : a;
+		convert(program, t, a, type, program.current_return_type);
+		a = t;
+	}
+	program.emit(RI::Ret{ a });
+	return 0;
+}
+
+decl(function_call) {
+	auto& node = nodes[idx].Function_Call_;
+
+	if (!nodes[node.identifier_idx].typecheck(AST::Node::Identifier_Kind))
+		return unsupported(nodes, idx, program, "Calling anything but a name");
+
+	auto name = string_view_from_view(file, nodes[node.identifier_idx].Identifier_.token.lexeme);
+	size_t first_arg = node.argument_list_idx ? nodes[node.argument_list_idx].Argument_.value_idx : 0;
+
+	if (name == "print" || name == "sleep" || name == "int") {
+		if (!first_arg) return unsupported(nodes, idx, program, "This call");
+
+		RI::Reg a = 0;
+		size_t type = operand(nodes, first_arg, program, file, a);
+
+		if (name == "int") {
+			if (dst == RI::No_Register) return 0;
+			return convert(program, dst, a, type, Int_Id);
+		}
+		if (name == "sleep") {
+			auto t = program.alloc_register();
+			convert(program, t, a, type, Real_Id);
+			program.emit(RI::Sleep{ t });
+			return 0;
+		}
+
+		if      (type == Byte_Id)                    program.emit(RI::Print_Byte{ a });
+		else if (type == Int_Id)                     program.emit(RI::Print_Int{ a });
+		else if (type == Nat_Id)                     program.emit(RI::Print_Nat{ a });
+		else if (type == Real_Id || type == Bool_Id) program.emit(RI::Print{ a });
+		else return unsupported(nodes, idx, program, "Printing this type");
+		return 0;
+	}
+
+	auto id = program.interpreter.lookup(name);
+	if (!id.typecheck(AST_Interpreter::Value::Identifier_Kind))
+		return unsupported(nodes, idx, program, "This call");
+	auto it = program.interpreter.types.find(id.Identifier_.type_descriptor_id);
+	if (it == std::end(program.interpreter.types))
+		return unsupported(nodes, idx, program, "This call");
+	auto& type = it->second;
+
+	const std::vector<size_t>* parameter_types = nullptr;
+	const std::vector<size_t>* return_types = nullptr;
+	if (type.kind == AST_Interpreter::Type::User_Function_Type_Kind) {
+		parameter_types = &type.User_Function_Type_.parameter_type;
+		return_types    = &type.User_Function_Type_.return_type;
+	} else if (type.kind == AST_Interpreter::Type::Function_Signature_Kind) {
+		parameter_types = &type.Function_Signature_.parameter_types;
+		return_types    = &type.Function_Signature_.return_types;
+	} else {
+		return unsupported(nodes, idx, program, "Calling something that isn't a proc");
+	}
+
+	// A variable that doesn't need a conversion is passed from its own register.
+	std::vector<RI::Reg> arguments;
+	size_t arg_idx = 0;
+	for (size_t i = node.argument_list_idx; i; i = nodes[i]->next_statement, arg_idx++) {
+		size_t value = nodes[i].Argument_.value_idx;
+		size_t to = arg_idx < parameter_types->size() ? (*parameter_types)[arg_idx] : 0;
+
+		RI::Reg r = 0;
+		size_t arg_type = 0;
+		if (is_variable(nodes, value)) arg_type = operand(nodes, value, program, file, r);
+		if (!is_variable(nodes, value) || (to && arg_type != to)) {
+			r = program.alloc_register();
+			arg_type = expression_as(nodes, value, program, file, r, to);
+		}
+		if (!is_value_type(program, arg_type))
+			return unsupported(nodes, idx, program, "Passing this type");
+
+		arguments.push_back(r);
+	}
+
+	RI::Call call;
+	call.dst = dst;
+	call.callee = (RI::Reg)id.Identifier_.memory_idx;
+	call.arguments = (std::uint32_t)program.arguments.size();
+	call.n = (std::uint32_t)arguments.size();
+	program.arguments.insert(std::end(program.arguments), std::begin(arguments), std::end(arguments));
+	program.emit(call);
+
+	if (return_types->empty()) return 0;
+	return return_types->front();
+}
+
+static void compile_function(
+	const std::vector<AST::Node>& nodes,
+	size_t idx,
+	Register_Program& program,
+	std::string_view file,
+	size_t f_idx
+) noexcept {
+	auto& node = nodes[idx].Function_Definition_;
+	if (node.is_method) {
+		unsupported(nodes, idx, program, "A method");
+		return;
+	}
+
+	auto old_function = program.current_function;
+	auto old_register = program.next_register;
+	auto old_return_type = program.current_return_type;
+	program.interpreter.push_scope();
+	program.interpreter.scopes.back().fence = true;
+	defer {
+		program.interpreter.pop_scope();
+		program.current_function = old_function;
+		program.next_register = old_register;
+		program.current_return_type = old_return_type;
+	};
+
+	program.current_function = f_idx;
+	program.next_register = 0;
+
+	for (size_t i = node.parameter_list_idx; i; i = nodes[i]->next_statement) {
+		auto& param = nodes[i].Declaration_;
+
+		AST_Interpreter::Identifier id;
+		id.memory_idx = program.alloc_register();
+		program.functions[f_idx].parameters++;
+		id.type_descriptor_id =
+			program.interpreter.type_interpret(nodes, param.type_expression_idx, file).get_unique_id();
+		if (!is_value_type(program, id.type_descriptor_id)) {
+			unsupported(nodes, i, program, "A parameter of this type");
+			return;
+		}
+
+		program.interpreter.new_variable(string_view_from_view(file, param.identifier.lexeme), id);
+	}
+
+	program.current_return_type = 0;
+	if (node.return_list_idx) {
+		auto& ret = nodes[node.return_list_idx].Return_Parameter_;
+		program.current_return_type =
+			program.interpreter.type_interpret(nodes, ret.type_identifier, file).get_unique_id();
+	}
+
+	for (size_t i = node.statement_list_idx; i && program.ok; i = nodes[i]->next_statement)
+		statement(nodes, i, program, file);
+
+	program.emit(RI::Ret_Void{});
+}
+
+decl(declaration) {
+	auto& node = nodes[idx].Declaration_;
+	auto name = string_view_from_view(file, node.identifier.lexeme);
+
+	// First so that it's the one statement keeps.
+	AST_Interpreter::Identifier id;
+	id.memory_idx = program.alloc_register();
+	RI::Reg r = id.memory_idx;
+
+	auto value = node.value_expression_idx;
+	if (value && nodes[value].typecheck(AST::Node::Function_Definition_Kind)) {
+		auto t = program.interpreter.type_interpret(nodes, value, file);
+		id.type_descriptor_id = t.get_unique_id();
+		program.interpreter.new_variable(name, id);
+
+		size_t f_idx = program.functions.size();
+		program.functions.emplace_back();
+		program.emit(RI::Function{ r, (std::uint32_t)f_idx });
+		compile_function(nodes, value, program, file, f_idx);
+		return 0;
+	}
+	if (value && nodes[value].typecheck(AST::Node::Struct_Definition_Kind))
+		return unsupported(nodes, idx, program, "A struct");
+
+	size_t declared = 0;
+	if (node.type_expression_idx)
+		declared = program.interpreter.type_interpret(nodes, node.type_expression_idx, file).get_unique_id();
+
+	if (value) {
+		id.type_descriptor_id = expression_as(nodes, value, program, file, r, declared);
+	} else {
+		program.emit(RI::Constant{ r, alloc_constant(program, {}) });
+		id.type_descriptor_id = declared;
+	}
+
+	if (!is_value_type(program, id.type_descriptor_id))
+		return unsupported(nodes, idx, program, "A variable of this type");
+
+	program.interpreter.new_variable(name, id);
+	return 0;
+}
+
+extern Register_Program compile_registers(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file
+) noexcept {
+	Register_Program program;
+	program.functions.emplace_back();
+
+	// What comes after something unsupported could depend on it, nothing more is lowered.
+	for (size_t idx = 1; idx < nodes.size() && program.ok; ++idx) if (nodes[idx]->depth == 0)
+		statement(nodes, idx, program, file);
+
+	program.emit(RI::Exit{});
+	program.link();
+	return program;
+}
+
+void Register_Program::link() noexcept {
+	code.clear();
+	for (auto& f : functions) {
+		f.address = code.size();
+		code.insert(std::end(code), std::begin(f.code), std::end(f.code));
+	}
+
+	for (auto& x : code) if (x.typecheck(RI::Instruction::Function_Kind))
+		x.Function_.f_idx = functions[x.Function_.f_idx].address;
+}
+
+extern size_t memory_traffic(const Register_Program& program, size_t ip) noexcept {
+	switch (program.code[ip].kind) {
+	#define X(x) case RI::Instruction::x##_Kind:
+	RI_BINARY_LIST(X)
+	#undef X
+		return 24;
+	#define X(x) case RI::Instruction::x##_Kind:
+	RI_UNARY_LIST(X)
+	#undef X
+	#define X(x) case RI::Instruction::Jmp_Unless_##x##_Kind:
+	RI_COMPARISON_LIST(X)
+	#undef X
+	case RI::Instruction::Constant_Kind:
+	case RI::Instruction::Move_Kind:
+	case RI::Instruction::Inc_Kind:
+	case RI::Instruction::Inc_I_Kind:
+	case RI::Instruction::Ret_Kind:
+		return 16;
+	case RI::Instruction::Function_Kind:
+	case RI::Instruction::Jmp_Unless_Kind:
+	case RI::Instruction::Print_Kind:
+	case RI::Instruction::Print_Int_Kind:
+	case RI::Instruction::Print_Nat_Kind:
+	case RI::Instruction::Print_Byte_Kind:
+	case RI::Instruction::Sleep_Kind:
+		return 8;
+	// The arguments are copied to the new frame.
+	case RI::Instruction::Call_Kind:
+		return 8 + 16 * program.code[ip].Call_.n;
+	default:
+		return 0;
+	}
+}
+
+void Register_Program::debug() const noexcept {
+	for (size_t i = 0; i < code.size(); ++i) {
+		printf(">% 5d ", (int)i);
+		code[i].debug(*this);
+		printf("\n");
+	}
+}
+
+void RI::Instruction::debug(const Register_Program& program) const noexcept {
+	printf("%-16s", name());
+	switch (kind) {
+	case Constant_Kind: {
+		auto& x = program.constants[Constant_.idx];
+		printf(": r%u, const:[%u](%Lf, %lld)", Constant_.dst, Constant_.idx, x.r, (long long)x.i);
+		break;
+	}
+	case Function_Kind: printf(": r%u, f:[%u]", Function_.dst, Function_.f_idx); break;
+	case Move_Kind:     printf(": r%u, r%u", Move_.dst, Move_.a); break;
+	#define X(x) case x##_Kind: printf(": r%u, r%u, r%u", x##_.dst, x##_.a, x##_.b); break;
+	RI_BINARY_LIST(X)
+	#undef X
+	#define X(x) case x##_Kind: printf(": r%u, r%u", x##_.dst, x##_.a); break;
+	RI_UNARY_LIST(X)
+	#undef X
+	#define X(x) case Jmp_Unless_##x##_Kind:\
+		printf(": r%u, r%u, %d", Jmp_Unless_##x##_.a, Jmp_Unless_##x##_.b, Jmp_Unless_##x##_.dt_ip);\
+		break;
+	RI_COMPARISON_LIST(X)
+	#undef X
+	case Jmp_Kind:        printf(": %d", Jmp_.dt_ip); break;
+	case Jmp_Unless_Kind: printf(": r%u, %d", Jmp_Unless_.a, Jmp_Unless_.dt_ip); break;
+	case Inc_Kind:        printf(": r%u", Inc_.a); break;
+	case Inc_I_Kind:      printf(": r%u", Inc_I_.a); break;
+	case Call_Kind:
+		printf(": r%u, r%u, (", Call_.dst, Call_.callee);
+		for (size_t i = 0; i < Call_.n; ++i)
+			printf("%sr%u", i ? ", " : "", program.arguments[Call_.arguments + i]);
+		printf(")");
+		break;
+	case Ret_Kind:        printf(": r%u", Ret_.a); break;
+	case Print_Kind:      printf(": r%u", Print_.a); break;
+	case Print_Int_Kind:  printf(": r%u", Print_Int_.a); break;
+	case Print_Nat_Kind:  printf(": r%u", Print_Nat_.a); break;
+	case Print_Byte_Kind: printf(": r%u", Print_Byte_.a); break;
+	case Sleep_Kind:      printf(": r%u", Sleep_.a); break;
+	default: break;
+	}
+}
+
+static const char* register_opcode_name(std::uint8_t opcode) noexcept {
+	RI::Instruction x;
+	x.kind = (RI::Instruction::Kind)opcode;
+	return x.name();
+}
+
+void Register_VM::execute(const Register_Program& program) noexcept {
+	frames.clear();
+	frames.push_back({});
+	if (profiler) profiler->opcode_name = register_opcode_name;
+
+	registers.clear();
+	registers.resize(program.frame_size * 64 + 64);
+
+	const RI::Instruction* code = program.code.data();
+	const size_t code_size = program.code.size();
+	const RI::Register* constants = program.constants.data();
+
+	size_t base = 0;
+	RI::Register* r = registers.data();
+
+	for (size_t ip = 0; ip < code_size; ++ip) {
+		auto& x = code[ip];
+		if (profiler) profiler->record(ip, (std::uint8_t)x.kind);
+
+		#define REAL_OP(k, op) case RI::Instruction::k##_Kind: \
+			r[x.k##_.dst].r = r[x.k##_.a].r op r[x.k##_.b].r; \
+			break;
+		#define REAL_CMP(k, op) case RI::Instruction::k##_Kind: \
+			r[x.k##_.dst].r = r[x.k##_.a].r op r[x.k##_.b].r ? 1 : 0; \
+			break;
+		// Add, sub and mul are done on unsigned so overflows wrap around instead of being UB.
+		#define INT_OP(k, op) case RI::Instruction::k##_Kind: \
+			r[x.k##_.dst].u = r[x.k##_.a].u op r[x.k##_.b].u; \
+			break;
+		#define INT_CMP(k, f, op) case RI::Instruction::k##_Kind: \
+			r[x.k##_.dst].r = r[x.k##_.a].f op r[x.k##_.b].f ? 1 : 0; \
+			break;
+		// INT64_MIN / -1 overflows, x / -1 and x % -1 are given by minus_one instead.
+		#define INT_DIV(k, f, op, minus_one) case RI::Instruction::k##_Kind: { \
+			auto a = r[x.k##_.a].f; \
+			auto b = r[x.k##_.b].f; \
+			if (b == 0) { \
+				printlns("Integer division by zero."); \
+				ip = code_size; \
+				break; \
+			} \
+			if (std::is_signed_v<decltype(b)> && b == (decltype(b))-1) \
+				r[x.k##_.dst].f = minus_one; \
+			else \
+				r[x.k##_.dst].f = a op b; \
+			break; \
+		}
+		#define JMP_UNLESS(k, f, op) case RI::Instruction::Jmp_Unless_##k##_Kind: \
+			if (!(r[x.Jmp_Unless_##k##_.a].f op r[x.Jmp_Unless_##k##_.b].f)) \
+				ip += x.Jmp_Unless_##k##_.dt_ip - 1; \
+			break;
+
+		switch (x.kind) {
+		case RI::Instruction::Constant_Kind: r[x.Constant_.dst] = constants[x.Constant_.idx]; break;
+		case RI::Instruction::Function_Kind: r[x.Function_.dst].u = x.Function_.f_idx; break;
+		case RI::Instruction::Move_Kind:     r[x.Move_.dst] = r[x.Move_.a]; break;
+
+		REAL_OP(Add, +);
+		REAL_OP(Sub, -);
+		REAL_OP(Mul, *);
+		REAL_OP(Div, /);
+		case RI::Instruction::Mod_Kind:
+			r[x.Mod_.dst].r = std::fmodl(r[x.Mod_.a].r, r[x.Mod_.b].r);
+			break;
+		REAL_CMP(Eq, ==);
+		REAL_CMP(Neq, !=);
+		REAL_CMP(Lt, <);
+		REAL_CMP(Leq, <=);
+		REAL_CMP(Gt, >);
+
+		INT_OP(Add_I, +);
+		INT_OP(Sub_I, -);
+		INT_OP(Mul_I, *);
+		INT_DIV(Div_I, i, /, (std::int64_t)(0 - (std::uint64_t)a));
+		INT_DIV(Mod_I, i, %, 0);
+		INT_DIV(Div_U, u, /, a / b);
+		INT_DIV(Mod_U, u, %, a % b);
+		INT_CMP(Eq_I, i, ==);
+		INT_CMP(Neq_I, i, !=);
+		INT_CMP(Lt_I, i, <);
+		INT_CMP(Leq_I, i, <=);
+		INT_CMP(Gt_I, i, >);
+		INT_CMP(Lt_U, u, <);
+		INT_CMP(Leq_U, u, <=);
+		INT_CMP(Gt_U, u, >);
+
+		case RI::Instruction::Neg_Kind:   r[x.Neg_.dst].r = -r[x.Neg_.a].r; break;
+		case RI::Instruction::Neg_I_Kind: r[x.Neg_I_.dst].u = 0 - r[x.Neg_I_.a].u; break;
+		case RI::Instruction::Not_Kind:   r[x.Not_.dst].r = r[x.Not_.a].r == 0 ? 1 : 0; break;
+		case RI::Instruction::I2R_Kind:   r[x.I2R_.dst].r = (long double)r[x.I2R_.a].i; break;
+		case RI::Instruction::U2R_Kind:   r[x.U2R_.dst].r = (long double)r[x.U2R_.a].u; break;
+		case RI::Instruction::R2I_Kind:   r[x.R2I_.dst].i = (std::int64_t)r[x.R2I_.a].r; break;
+		case RI::Instruction::R2U_Kind:   r[x.R2U_.dst].u = (std::uint64_t)r[x.R2U_.a].r; break;
+		case RI::Instruction::I2B_Kind:   r[x.I2B_.dst].u = r[x.I2B_.a].u & 0xFF; break;
+
+		JMP_UNLESS(Eq, r, ==);
+		JMP_UNLESS(Neq, r, !=);
+		JMP_UNLESS(Lt, r, <);
+		JMP_UNLESS(Leq, r, <=);
+		JMP_UNLESS(Gt, r, >);
+		JMP_UNLESS(Eq_I, i, ==);
+		JMP_UNLESS(Neq_I, i, !=);
+		JMP_UNLESS(Lt_I, i, <);
+		JMP_UNLESS(Leq_I, i, <=);
+		JMP_UNLESS(Gt_I, i, >);
+		JMP_UNLESS(Lt_U, u, <);
+		JMP_UNLESS(Leq_U, u, <=);
+		JMP_UNLESS(Gt_U, u, >);
+
+		case RI::Instruction::Jmp_Kind: ip += x.Jmp_.dt_ip - 1; break;
+		case RI::Instruction::Jmp_Unless_Kind:
+			if (r[x.Jmp_Unless_.a].r == 0) ip += x.Jmp_Unless_.dt_ip - 1;
+			break;
+		case RI::Instruction::Inc_Kind:   r[x.Inc_.a].r += 1; break;
+		case RI::Instruction::Inc_I_Kind: r[x.Inc_I_.a].u += 1; break;
+
+		case RI::Instruction::Call_Kind: {
+			size_t address = r[x.Call_.callee].u;
+			size_t new_base = base + program.frame_size;
+			if (new_base + program.frame_size > registers.size())
+				registers.resize(2 * (new_base + program.frame_size));
+
+			// The resize may have moved the registers.
+			r = registers.data() + base;
+			const RI::Reg* arguments = program.arguments.data() + x.Call_.arguments;
+			for (size_t i = 0; i < x.Call_.n; ++i) r[program.frame_size + i] = r[arguments[i]];
+
+			frames.push_back({ ip + 1, new_base, x.Call_.dst });
+			base = new_base;
+			r = registers.data() + base;
+			ip = address - 1;
+			break;
+		}
+		case RI::Instruction::Ret_Kind:
+		case RI::Instruction::Ret_Void_Kind: {
+			// Returning from the top level ends the program.
+			if (frames.size() == 1) {
+				ip = code_size;
+				break;
+			}
+
+			RI::Register value = {};
+			if (x.kind == RI::Instruction::Ret_Kind) value = r[x.Ret_.a];
+
+			auto frame = frames.back();
+			frames.pop_back();
+			base = frames.back().base;
+			r = registers.data() + base;
+
+			if (x.kind == RI::Instruction::Ret_Kind && frame.dst != RI::No_Register)
+				r[frame.dst] = value;
+			ip = frame.return_ip - 1;
+			break;
+		}
+		case RI::Instruction::Exit_Kind: ip = code_size; break;
+
+		case RI::Instruction::Print_Kind:
+			printf("[%zu] %Lf\n", ip, r[x.Print_.a].r);
+			break;
+		case RI::Instruction::Print_Int_Kind:
+			printf("[%zu] %lld\n", ip, (long long)r[x.Print_Int_.a].i);
+			break;
+		case RI::Instruction::Print_Nat_Kind:
+			printf("[%zu] %llu\n", ip, (unsigned long long)r[x.Print_Nat_.a].u);
+			break;
+		case RI::Instruction::Print_Byte_Kind:
+			printf("%c", (char)r[x.Print_Byte_.a].u);
+			break;
+		case RI::Instruction::Sleep_Kind:
+			std::this_thread::sleep_for(
+				std::chrono::nanoseconds((long long)(1'000'000'000 * r[x.Sleep_.a].r))
+			);
+			break;
+		default: assert("Not supported"); break;
+		}
+	}
+}
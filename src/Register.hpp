@@ -0,0 +1,194 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "xstd.hpp"
+#include "Interpreter.hpp"
+#include "Profiler.hpp"
+
+// A second backend next to the stack VM. Instructions name their operands directly as registers
+// of the current frame instead of going through a stack, a + b is one Add{ dst, a, b } reading
+// the registers of a and b where the stack VM loads both, adds and saves.
+//
+// It only knows about values that fit in a register: reals, ints, nats, bytes, bools and procs.
+// Structs, pointers, arrays and strings are reported as not supported when lowering.
+struct Register_Program;
+namespace RI {
+	using Reg = std::uint32_t;
+	static constexpr Reg No_Register = UINT32_MAX;
+
+	union Register {
+		long double r;
+		std::int64_t i;
+		std::uint64_t u;
+	};
+
+	// dst = constants[idx]
+	struct Constant {
+		Reg dst = 0;
+		std::uint32_t idx = 0;
+	};
+	// dst = the code address of functions[f_idx], resolved when linking.
+	struct Function {
+		Reg dst = 0;
+		std::uint32_t f_idx = 0;
+	};
+	struct Move {
+		Reg dst = 0;
+		Reg a = 0;
+	};
+
+	// dst = a op b, comparisons give a real 0 or 1 like in the stack VM.
+	#define RI_BINARY_LIST(X)\
+	X(Add) X(Sub) X(Mul) X(Div) X(Mod) X(Eq) X(Neq) X(Lt) X(Leq) X(Gt)\
+	X(Add_I) X(Sub_I) X(Mul_I) X(Div_I) X(Mod_I) X(Div_U) X(Mod_U)\
+	X(Eq_I) X(Neq_I) X(Lt_I) X(Leq_I) X(Gt_I) X(Lt_U) X(Leq_U) X(Gt_U)
+
+	#define X(x) struct x { Reg dst = 0; Reg a = 0; Reg b = 0; };
+	RI_BINARY_LIST(X)
+	#undef X
+
+	// dst = op a. I2R converts an int to a real, U2R a nat, R2I and R2U the other way, and I2B
+	// truncates to a byte. Bytes are kept as ints in the registers.
+	#define RI_UNARY_LIST(X) X(Neg) X(Neg_I) X(Not) X(I2R) X(U2R) X(R2I) X(R2U) X(I2B)
+
+	#define X(x) struct x { Reg dst = 0; Reg a = 0; };
+	RI_UNARY_LIST(X)
+	#undef X
+
+	// Jumps by dt_ip unless the comparison of a and b holds.
+	#define RI_COMPARISON_LIST(X)\
+	X(Eq) X(Neq) X(Lt) X(Leq) X(Gt) X(Eq_I) X(Neq_I) X(Lt_I) X(Leq_I) X(Gt_I) X(Lt_U) X(Leq_U) X(Gt_U)
+
+	#define X(x) struct Jmp_Unless_##x { Reg a = 0; Reg b = 0; int dt_ip = 0; };
+	RI_COMPARISON_LIST(X)
+	#undef X
+
+	struct Jmp {
+		int dt_ip = 0;
+	};
+	// Jumps unless the real in a isn't 0.
+	struct Jmp_Unless {
+		Reg a = 0;
+		int dt_ip = 0;
+	};
+	struct Inc {
+		Reg a = 0;
+	};
+	struct Inc_I {
+		Reg a = 0;
+	};
+
+	// Calls the proc in callee. The n registers listed from Register_Program::arguments[arguments]
+	// are copied to the first registers of the new frame, which starts after the current one.
+	// The value returned goes in dst.
+	struct Call {
+		Reg dst = 0;
+		Reg callee = 0;
+		std::uint32_t arguments = 0;
+		std::uint32_t n = 0;
+	};
+	struct Ret {
+		Reg a = 0;
+	};
+	struct Ret_Void {};
+	struct Exit {};
+
+	struct Print {
+		Reg a = 0;
+	};
+	struct Print_Int {
+		Reg a = 0;
+	};
+	struct Print_Nat {
+		Reg a = 0;
+	};
+	struct Print_Byte {
+		Reg a = 0;
+	};
+	struct Sleep {
+		Reg a = 0;
+	};
+
+	#define RI_LIST(X)\
+	X(Constant) X(Function) X(Move) RI_BINARY_LIST(X) RI_UNARY_LIST(X)\
+	X(Jmp_Unless_Eq) X(Jmp_Unless_Neq) X(Jmp_Unless_Lt) X(Jmp_Unless_Leq) X(Jmp_Unless_Gt)\
+	X(Jmp_Unless_Eq_I) X(Jmp_Unless_Neq_I) X(Jmp_Unless_Lt_I) X(Jmp_Unless_Leq_I)\
+	X(Jmp_Unless_Gt_I) X(Jmp_Unless_Lt_U) X(Jmp_Unless_Leq_U) X(Jmp_Unless_Gt_U)\
+	X(Jmp) X(Jmp_Unless) X(Inc) X(Inc_I) X(Call) X(Ret) X(Ret_Void) X(Exit)\
+	X(Print) X(Print_Int) X(Print_Nat) X(Print_Byte) X(Sleep)
+
+	struct Instruction {
+		sum_type(Instruction, RI_LIST);
+
+		void debug(const Register_Program& program) const noexcept;
+	};
+};
+
+struct Register_Program {
+	struct Function {
+		std::vector<RI::Instruction> code;
+		size_t address = 0;
+		// The parameters are the first registers of the frame.
+		size_t parameters = 0;
+	};
+
+	// After linking, every function one after the other with the top level code first.
+	std::vector<RI::Instruction> code;
+	std::vector<RI::Register> constants;
+	// The argument registers of every call, see RI::Call.
+	std::vector<RI::Reg> arguments;
+
+	// functions[0] is the top level code.
+	std::vector<Function> functions;
+	// The most registers any frame uses, every frame is given that many.
+	size_t frame_size = 0;
+
+	// Cleared when the lowering meets something it doesn't support, the program can't run then.
+	bool ok = true;
+
+	size_t current_function = 0;
+	size_t current_return_type = 0;
+	RI::Reg next_register = 0;
+
+	AST_Interpreter interpreter;
+
+	RI::Reg alloc_register() noexcept;
+	void emit(RI::Instruction x) noexcept;
+	std::vector<RI::Instruction>& current_code() noexcept;
+	// Puts the functions one after the other in code and resolves the Function instructions.
+	void link() noexcept;
+
+	void debug() const noexcept;
+};
+
+extern Register_Program compile_registers(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file
+) noexcept;
+
+// The -O2 optimizer, see SSA.cpp. Each function is rewritten in SSA form, optimized with constant
+// folding, value numbering, loop invariant code motion and dead code elimination, then its values
+// are colored back onto registers and the program linked again.
+extern void optimize_ssa(Register_Program& program) noexcept;
+
+// Bytes of operands an instruction reads and writes, values counted as 8 bytes. It's an estimate
+// of the memory traffic to compare with the stack VM, see the bench mode.
+extern size_t memory_traffic(const Register_Program& program, size_t ip) noexcept;
+
+struct Register_VM {
+	std::vector<RI::Register> registers;
+
+	struct Frame {
+		size_t return_ip = 0;
+		size_t base = 0;
+		RI::Reg dst = RI::No_Register;
+	};
+	std::vector<Frame> frames;
+
+	// Counts the opcodes run when set, see Opcode_Profiler.
+	Opcode_Profiler* profiler = nullptr;
+
+	void execute(const Register_Program& program) noexcept;
+};
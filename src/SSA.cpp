@@ -0,0 +1,1259 @@
+#include "Register.hpp"
+#include "xstd.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+// The middle end of the register backend. Each function is cut into basic blocks and put in SSA
+// form: every value is defined once, so while the passes run the register fields of the
+// instructions hold value ids instead of registers. Moves disappear when renaming, a use of their
+// dst reads the source value directly.
+//
+// The passes:
+//  - fold, constant folding and propagation. Branches on constants become jumps and what they
+//    leave unreachable is dropped.
+//  - gvn, a value computed again where its first computation dominates reuses that one.
+//  - licm, what a loop computes the same way on every iteration moves to its preheader.
+//  - dce, removes what no side effect depends on.
+//
+// To get out of SSA each phi gets fresh copies in its predecessors (Sreedhar's method I) so all
+// of them can share one register, then the copies that don't interfere are coalesced and the
+// values colored greedily. The parameters keep the first registers, the caller copies them there.
+
+using I = RI::Instruction;
+using RI::Reg;
+using RI::No_Register;
+
+static constexpr size_t None = SIZE_MAX;
+
+namespace {
+	struct Inst {
+		I x;
+		// The value it defines, the dst fields of x are only written back when emitting.
+		Reg def = No_Register;
+		// The arguments of a call.
+		std::vector<Reg> arguments;
+	};
+
+	struct Phi {
+		Reg def = No_Register;
+		// Indexed like the preds of the block.
+		std::vector<Reg> operands;
+		// The register it merges, only used while building.
+		Reg reg = No_Register;
+	};
+
+	struct Block {
+		std::vector<Phi> phis;
+		// Always ends with a terminator: Jmp, a conditional jump, Ret, Ret_Void or Exit.
+		std::vector<Inst> code;
+		std::vector<size_t> preds;
+		// A conditional jump falls through to succs[0] when its condition holds and goes to
+		// succs[1] otherwise.
+		std::vector<size_t> succs;
+		bool dead = false;
+	};
+
+	struct Bits {
+		std::vector<std::uint64_t> words;
+
+		void resize(size_t n) noexcept { words.assign((n + 63) / 64, 0); }
+		bool test(size_t i) const noexcept { return words[i / 64] >> (i % 64) & 1; }
+		void set(size_t i) noexcept { words[i / 64] |= (std::uint64_t)1 << (i % 64); }
+		void reset(size_t i) noexcept { words[i / 64] &= ~((std::uint64_t)1 << (i % 64)); }
+
+		template<typename F>
+		void for_each(F&& f) const noexcept {
+			for (size_t i = 0; i < words.size(); ++i)
+				for (auto w = words[i]; w; w &= w - 1) f(i * 64 + __builtin_ctzll(w));
+		}
+	};
+}
+
+static Inst instruction(I x, Reg def = No_Register) noexcept {
+	Inst inst;
+	inst.x = x;
+	inst.def = def;
+	return inst;
+}
+
+static bool is_conditional(const I& x) noexcept {
+	switch (x.kind) {
+	#define X(k) case I::Jmp_Unless_##k##_Kind:
+	RI_COMPARISON_LIST(X)
+	#undef X
+	case I::Jmp_Unless_Kind:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool is_terminator(const I& x) noexcept {
+	return
+		is_conditional(x) ||
+		x.kind == I::Jmp_Kind ||
+		x.kind == I::Ret_Kind ||
+		x.kind == I::Ret_Void_Kind ||
+		x.kind == I::Exit_Kind;
+}
+
+static int* jump_dt(I& x) noexcept {
+	switch (x.kind) {
+	case I::Jmp_Kind:        return &x.Jmp_.dt_ip;
+	case I::Jmp_Unless_Kind: return &x.Jmp_Unless_.dt_ip;
+	#define X(k) case I::Jmp_Unless_##k##_Kind: return &x.Jmp_Unless_##k##_.dt_ip;
+	RI_COMPARISON_LIST(X)
+	#undef X
+	default: return nullptr;
+	}
+}
+
+static bool is_binary(I::Kind kind) noexcept {
+	switch (kind) {
+	#define X(k) case I::k##_Kind:
+	RI_BINARY_LIST(X)
+	#undef X
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool is_unary(I::Kind kind) noexcept {
+	switch (kind) {
+	#define X(k) case I::k##_Kind:
+	RI_UNARY_LIST(X)
+	#undef X
+	case I::Inc_Kind:
+	case I::Inc_I_Kind:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Computes a value from its operands and nothing else, it can be moved, merged or dropped.
+static bool is_pure(const I& x) noexcept {
+	return
+		x.kind == I::Constant_Kind ||
+		x.kind == I::Function_Kind ||
+		x.kind == I::Move_Kind ||
+		is_binary(x.kind) ||
+		is_unary(x.kind);
+}
+
+// The integer divisions stop the program on a division by zero.
+static bool can_trap(I::Kind kind) noexcept {
+	return kind == I::Div_I_Kind || kind == I::Mod_I_Kind || kind == I::Div_U_Kind || kind == I::Mod_U_Kind;
+}
+
+static bool is_commutative(I::Kind kind) noexcept {
+	switch (kind) {
+	case I::Add_Kind: case I::Mul_Kind: case I::Eq_Kind: case I::Neq_Kind:
+	case I::Add_I_Kind: case I::Mul_I_Kind: case I::Eq_I_Kind: case I::Neq_I_Kind:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Where an instruction writes its result, nullptr when it has no dst. Inc and Inc_I write the
+// register they read.
+static Reg* dst_field(I& x) noexcept {
+	switch (x.kind) {
+	case I::Constant_Kind: return &x.Constant_.dst;
+	case I::Function_Kind: return &x.Function_.dst;
+	case I::Move_Kind:     return &x.Move_.dst;
+	case I::Call_Kind:     return &x.Call_.dst;
+	#define X(k) case I::k##_Kind: return &x.k##_.dst;
+	RI_BINARY_LIST(X)
+	RI_UNARY_LIST(X)
+	#undef X
+	default: return nullptr;
+	}
+}
+
+// The operands of the arithmetic and of the conditional jumps, b is No_Register for one operand.
+static void operands(I& x, Reg*& a, Reg*& b) noexcept {
+	a = nullptr;
+	b = nullptr;
+	switch (x.kind) {
+	#define X(k) case I::k##_Kind: a = &x.k##_.a; b = &x.k##_.b; break;
+	RI_BINARY_LIST(X)
+	#undef X
+	#define X(k) case I::k##_Kind: a = &x.k##_.a; break;
+	RI_UNARY_LIST(X)
+	#undef X
+	#define X(k) case I::Jmp_Unless_##k##_Kind: a = &x.Jmp_Unless_##k##_.a; b = &x.Jmp_Unless_##k##_.b; break;
+	RI_COMPARISON_LIST(X)
+	#undef X
+	case I::Jmp_Unless_Kind: a = &x.Jmp_Unless_.a; break;
+	case I::Inc_Kind:        a = &x.Inc_.a; break;
+	case I::Inc_I_Kind:      a = &x.Inc_I_.a; break;
+	default: break;
+	}
+}
+
+template<typename F>
+static void for_each_use(Inst& inst, F&& f) noexcept {
+	auto& x = inst.x;
+	Reg* a;
+	Reg* b;
+	operands(x, a, b);
+	if (a) f(*a);
+	if (b) f(*b);
+
+	switch (x.kind) {
+	case I::Move_Kind: f(x.Move_.a); break;
+	case I::Call_Kind:
+		f(x.Call_.callee);
+		for (auto& r : inst.arguments) f(r);
+		break;
+	case I::Ret_Kind:        f(x.Ret_.a); break;
+	case I::Print_Kind:      f(x.Print_.a); break;
+	case I::Print_Int_Kind:  f(x.Print_Int_.a); break;
+	case I::Print_Nat_Kind:  f(x.Print_Nat_.a); break;
+	case I::Print_Byte_Kind: f(x.Print_Byte_.a); break;
+	case I::Sleep_Kind:      f(x.Sleep_.a); break;
+	default: break;
+	}
+}
+
+// Does what Register_VM::execute does, false for a division by zero which has to happen at run
+// time to be reported.
+static bool evaluate(I::Kind kind, RI::Register a, RI::Register b, RI::Register& res) noexcept {
+	memset(&res, 0, sizeof(res));
+	switch (kind) {
+	case I::Add_Kind: res.r = a.r + b.r; return true;
+	case I::Sub_Kind: res.r = a.r - b.r; return true;
+	case I::Mul_Kind: res.r = a.r * b.r; return true;
+	case I::Div_Kind: res.r = a.r / b.r; return true;
+	case I::Mod_Kind: res.r = std::fmodl(a.r, b.r); return true;
+	case I::Eq_Kind:  res.r = a.r == b.r ? 1 : 0; return true;
+	case I::Neq_Kind: res.r = a.r != b.r ? 1 : 0; return true;
+	case I::Lt_Kind:  res.r = a.r < b.r ? 1 : 0; return true;
+	case I::Leq_Kind: res.r = a.r <= b.r ? 1 : 0; return true;
+	case I::Gt_Kind:  res.r = a.r > b.r ? 1 : 0; return true;
+
+	case I::Add_I_Kind: res.u = a.u + b.u; return true;
+	case I::Sub_I_Kind: res.u = a.u - b.u; return true;
+	case I::Mul_I_Kind: res.u = a.u * b.u; return true;
+	case I::Div_I_Kind:
+		if (b.i == 0) return false;
+		res.i = b.i == -1 ? (std::int64_t)(0 - a.u) : a.i / b.i;
+		return true;
+	case I::Mod_I_Kind:
+		if (b.i == 0) return false;
+		res.i = b.i == -1 ? 0 : a.i % b.i;
+		return true;
+	case I::Div_U_Kind:
+		if (b.u == 0) return false;
+		res.u = a.u / b.u;
+		return true;
+	case I::Mod_U_Kind:
+		if (b.u == 0) return false;
+		res.u = a.u % b.u;
+		return true;
+	case I::Eq_I_Kind:  res.r = a.i == b.i ? 1 : 0; return true;
+	case I::Neq_I_Kind: res.r = a.i != b.i ? 1 : 0; return true;
+	case I::Lt_I_Kind:  res.r = a.i < b.i ? 1 : 0; return true;
+	case I::Leq_I_Kind: res.r = a.i <= b.i ? 1 : 0; return true;
+	case I::Gt_I_Kind:  res.r = a.i > b.i ? 1 : 0; return true;
+	case I::Lt_U_Kind:  res.r = a.u < b.u ? 1 : 0; return true;
+	case I::Leq_U_Kind: res.r = a.u <= b.u ? 1 : 0; return true;
+	case I::Gt_U_Kind:  res.r = a.u > b.u ? 1 : 0; return true;
+
+	case I::Neg_Kind:   res.r = -a.r; return true;
+	case I::Neg_I_Kind: res.u = 0 - a.u; return true;
+	case I::Not_Kind:   res.r = a.r == 0 ? 1 : 0; return true;
+	case I::I2R_Kind:   res.r = (long double)a.i; return true;
+	case I::U2R_Kind:   res.r = (long double)a.u; return true;
+	case I::R2I_Kind:   res.i = (std::int64_t)a.r; return true;
+	case I::R2U_Kind:   res.u = (std::uint64_t)a.r; return true;
+	case I::I2B_Kind:   res.u = a.u & 0xFF; return true;
+	case I::Inc_Kind:   res = a; res.r += 1; return true;
+	case I::Inc_I_Kind: res = a; res.u += 1; return true;
+	default: return false;
+	}
+}
+
+// Whether a conditional jump falls through.
+static bool holds(I::Kind kind, RI::Register a, RI::Register b) noexcept {
+	switch (kind) {
+	case I::Jmp_Unless_Kind:       return a.r != 0;
+	case I::Jmp_Unless_Eq_Kind:    return a.r == b.r;
+	case I::Jmp_Unless_Neq_Kind:   return a.r != b.r;
+	case I::Jmp_Unless_Lt_Kind:    return a.r < b.r;
+	case I::Jmp_Unless_Leq_Kind:   return a.r <= b.r;
+	case I::Jmp_Unless_Gt_Kind:    return a.r > b.r;
+	case I::Jmp_Unless_Eq_I_Kind:  return a.i == b.i;
+	case I::Jmp_Unless_Neq_I_Kind: return a.i != b.i;
+	case I::Jmp_Unless_Lt_I_Kind:  return a.i < b.i;
+	case I::Jmp_Unless_Leq_I_Kind: return a.i <= b.i;
+	case I::Jmp_Unless_Gt_I_Kind:  return a.i > b.i;
+	case I::Jmp_Unless_Lt_U_Kind:  return a.u < b.u;
+	case I::Jmp_Unless_Leq_U_Kind: return a.u <= b.u;
+	case I::Jmp_Unless_Gt_U_Kind:  return a.u > b.u;
+	default: return true;
+	}
+}
+
+struct SSA_Function {
+	Register_Program& program;
+	std::vector<Block> blocks;
+	// The blocks after these were made by the passes.
+	size_t original_blocks = 0;
+	size_t parameters = 0;
+
+	// A pass that finds a value is the same as another sets replaced[v], rewrite() then makes the
+	// uses read the other one.
+	std::vector<Reg> replaced;
+	std::vector<Reg> parameter_values;
+	// What a register holds before it's written, anything goes.
+	Reg undefined = No_Register;
+
+	// Filled by analyze().
+	std::vector<size_t> rpo;
+	std::vector<size_t> rpo_idx;
+	std::vector<size_t> idom;
+	std::vector<std::vector<size_t>> children;
+	std::vector<size_t> dom_in;
+	std::vector<size_t> dom_out;
+	struct Loop {
+		size_t header = 0;
+		std::vector<bool> body;
+		size_t size = 0;
+	};
+	std::vector<Loop> loops;
+	std::vector<size_t> loop_depth;
+
+	// Filled by index_values(). The parameters and the undefined value are defined in the entry
+	// block with idx None.
+	struct Def {
+		size_t block = None;
+		size_t idx = None;
+		bool phi = false;
+	};
+	std::vector<Def> defs;
+
+	// Filled out of SSA.
+	std::vector<Reg> parent;
+	std::vector<Reg> color;
+
+	SSA_Function(Register_Program& program) noexcept : program(program) {}
+
+	Reg new_value() noexcept {
+		replaced.push_back(replaced.size());
+		return replaced.size() - 1;
+	}
+	Reg resolve(Reg v) const noexcept {
+		while (v != No_Register && replaced[v] != v) v = replaced[v];
+		return v;
+	}
+
+	void remove_pred(size_t b, size_t pred) noexcept {
+		auto& block = blocks[b];
+		for (size_t k = 0; k < block.preds.size(); ++k) if (block.preds[k] == pred) {
+			block.preds.erase(std::begin(block.preds) + k);
+			for (auto& phi : block.phis) phi.operands.erase(std::begin(phi.operands) + k);
+			return;
+		}
+	}
+
+	size_t intersect(size_t a, size_t b) const noexcept {
+		while (a != b) {
+			while (rpo_idx[a] > rpo_idx[b]) a = idom[a];
+			while (rpo_idx[b] > rpo_idx[a]) b = idom[b];
+		}
+		return a;
+	}
+	bool dominates(size_t a, size_t b) const noexcept {
+		return dom_in[a] <= dom_in[b] && dom_out[b] <= dom_out[a];
+	}
+
+	// Drops the blocks the entry doesn't reach and works out the dominator tree and the loops.
+	void analyze() noexcept {
+		size_t n = blocks.size();
+
+		std::vector<bool> seen(n, false);
+		std::vector<size_t> post;
+		std::vector<std::pair<size_t, size_t>> stack = { { 0, 0 } };
+		seen[0] = true;
+		while (!stack.empty()) {
+			auto [b, i] = stack.back();
+			if (i < blocks[b].succs.size()) {
+				stack.back().second++;
+				size_t s = blocks[b].succs[i];
+				if (!seen[s]) {
+					seen[s] = true;
+					stack.push_back({ s, 0 });
+				}
+			} else {
+				post.push_back(b);
+				stack.pop_back();
+			}
+		}
+
+		for (size_t b = 0; b < n; ++b) if (!seen[b] && !blocks[b].dead) {
+			for (auto s : blocks[b].succs) remove_pred(s, b);
+			blocks[b] = {};
+			blocks[b].dead = true;
+		}
+
+		rpo.assign(std::rbegin(post), std::rend(post));
+		rpo_idx.assign(n, None);
+		for (size_t i = 0; i < rpo.size(); ++i) rpo_idx[rpo[i]] = i;
+
+		// Cooper, Harvey and Kennedy's iterative dominators.
+		idom.assign(n, None);
+		idom[0] = 0;
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (size_t i = 1; i < rpo.size(); ++i) {
+				size_t b = rpo[i];
+				size_t d = None;
+				for (auto p : blocks[b].preds) if (idom[p] != None) d = d == None ? p : intersect(p, d);
+				if (d != idom[b]) {
+					idom[b] = d;
+					changed = true;
+				}
+			}
+		}
+
+		children.assign(n, {});
+		for (size_t i = 1; i < rpo.size(); ++i) children[idom[rpo[i]]].push_back(rpo[i]);
+
+		dom_in.assign(n, 0);
+		dom_out.assign(n, 0);
+		size_t clock = 0;
+		auto number = [&] (auto& self, size_t b) -> void {
+			dom_in[b] = clock++;
+			for (auto c : children[b]) self(self, c);
+			dom_out[b] = clock++;
+		};
+		number(number, 0);
+
+		// A back edge goes to a block dominating its source, the loop is what reaches the source
+		// without going through the header.
+		loops.clear();
+		loop_depth.assign(n, 0);
+		for (auto b : rpo) for (auto h : blocks[b].succs) if (dominates(h, b)) {
+			size_t l = 0;
+			while (l < loops.size() && loops[l].header != h) l++;
+			if (l == loops.size()) {
+				loops.emplace_back();
+				loops[l].header = h;
+				loops[l].body.assign(n, false);
+				loops[l].body[h] = true;
+			}
+
+			std::vector<size_t> work = { b };
+			while (!work.empty()) {
+				size_t x = work.back();
+				work.pop_back();
+				if (loops[l].body[x]) continue;
+				loops[l].body[x] = true;
+				for (auto p : blocks[x].preds) work.push_back(p);
+			}
+		}
+		for (auto& loop : loops) for (auto b : rpo) if (loop.body[b]) {
+			loop.size++;
+			loop_depth[b]++;
+		}
+	}
+
+	void build(
+		const std::vector<I>& function,
+		const std::vector<Reg>& arguments,
+		size_t parameter_count,
+		bool top_level
+	) noexcept {
+		parameters = parameter_count;
+
+		std::vector<Inst> code;
+		for (auto& x : function) {
+			auto inst = instruction(x);
+			if (auto* dst = dst_field(inst.x)) inst.def = *dst;
+			if (x.kind == I::Inc_Kind)   inst.def = x.Inc_.a;
+			if (x.kind == I::Inc_I_Kind) inst.def = x.Inc_I_.a;
+			if (x.kind == I::Call_Kind) {
+				auto first = std::begin(arguments) + x.Call_.arguments;
+				inst.arguments.assign(first, first + x.Call_.n);
+			}
+			code.push_back(inst);
+		}
+		// Running off the end returns.
+		code.push_back(instruction(top_level ? I(RI::Exit{}) : I(RI::Ret_Void{})));
+
+		size_t n = code.size();
+		std::vector<bool> leader(n + 1, false);
+		leader[0] = true;
+		for (size_t i = 0; i < n; ++i) {
+			if (is_terminator(code[i].x)) leader[i + 1] = true;
+			if (auto* dt = jump_dt(code[i].x)) leader[i + *dt] = true;
+		}
+
+		// Block 0 is an empty entry so nothing jumps back to the start of the function.
+		blocks.clear();
+		blocks.emplace_back();
+		std::vector<size_t> block_at(n + 1, None);
+		for (size_t i = 0; i < n; ++i) if (leader[i]) {
+			block_at[i] = blocks.size();
+			blocks.emplace_back();
+		}
+		blocks[0].code.push_back(instruction(RI::Jmp{}));
+		blocks[0].succs = { 1 };
+
+		size_t current = 0;
+		for (size_t i = 0; i < n; ++i) {
+			if (leader[i]) current = block_at[i];
+			auto& block = blocks[current];
+			block.code.push_back(code[i]);
+
+			auto& x = block.code.back().x;
+			if (x.kind == I::Jmp_Kind) {
+				block.succs = { block_at[i + x.Jmp_.dt_ip] };
+			} else if (is_conditional(x)) {
+				size_t fall = block_at[i + 1];
+				size_t target = block_at[i + *jump_dt(x)];
+				if (fall == target) {
+					x = RI::Jmp{};
+					block.succs = { fall };
+				} else {
+					block.succs = { fall, target };
+				}
+			} else if (!is_terminator(x) && leader[i + 1]) {
+				block.code.push_back(instruction(RI::Jmp{}));
+				block.succs = { block_at[i + 1] };
+			}
+		}
+		for (size_t b = 0; b < blocks.size(); ++b) for (auto s : blocks[b].succs) blocks[s].preds.push_back(b);
+		original_blocks = blocks.size();
+
+		analyze();
+
+		size_t registers = parameters;
+		for (auto b : rpo) for (auto& inst : blocks[b].code) {
+			if (inst.def != No_Register) registers = std::max<size_t>(registers, inst.def + 1);
+			for_each_use(inst, [&] (Reg& r) { registers = std::max<size_t>(registers, r + 1); });
+		}
+
+		// Phis go on the iterated dominance frontier of the blocks writing each register, the
+		// entry writes all of them.
+		std::vector<std::vector<size_t>> frontier(blocks.size());
+		for (auto b : rpo) if (blocks[b].preds.size() > 1) for (auto p : blocks[b].preds)
+			for (size_t runner = p; runner != idom[b]; runner = idom[runner]) {
+				auto& f = frontier[runner];
+				if (std::find(std::begin(f), std::end(f), b) == std::end(f)) f.push_back(b);
+			}
+
+		std::vector<std::vector<size_t>> writes(registers, std::vector<size_t>{ 0 });
+		for (auto b : rpo) for (auto& inst : blocks[b].code) if (inst.def != No_Register)
+			writes[inst.def].push_back(b);
+
+		std::vector<size_t> has_phi(blocks.size(), None);
+		std::vector<size_t> queued(blocks.size(), None);
+		for (Reg r = 0; r < registers; ++r) {
+			auto work = writes[r];
+			for (auto b : work) queued[b] = r;
+			while (!work.empty()) {
+				size_t b = work.back();
+				work.pop_back();
+				for (auto d : frontier[b]) if (has_phi[d] != r) {
+					has_phi[d] = r;
+					Phi phi;
+					phi.reg = r;
+					phi.operands.assign(blocks[d].preds.size(), No_Register);
+					blocks[d].phis.push_back(phi);
+					if (queued[d] != r) {
+						queued[d] = r;
+						work.push_back(d);
+					}
+				}
+			}
+		}
+
+		undefined = new_value();
+		std::vector<std::vector<Reg>> stacks(registers);
+		for (Reg r = 0; r < registers; ++r) {
+			if (r < parameters) parameter_values.push_back(new_value());
+			stacks[r].push_back(r < parameters ? parameter_values[r] : undefined);
+		}
+		rename(0, stacks);
+	}
+
+	void rename(size_t b, std::vector<std::vector<Reg>>& stacks) noexcept {
+		std::vector<Reg> pushed;
+		for (auto& phi : blocks[b].phis) {
+			phi.def = new_value();
+			stacks[phi.reg].push_back(phi.def);
+			pushed.push_back(phi.reg);
+		}
+
+		std::vector<Inst> code;
+		for (auto& inst : blocks[b].code) {
+			for_each_use(inst, [&] (Reg& r) { r = stacks[r].back(); });
+			if (inst.x.kind == I::Move_Kind) {
+				stacks[inst.def].push_back(inst.x.Move_.a);
+				pushed.push_back(inst.def);
+				continue;
+			}
+			if (inst.def != No_Register) {
+				Reg r = inst.def;
+				inst.def = new_value();
+				stacks[r].push_back(inst.def);
+				pushed.push_back(r);
+			}
+			code.push_back(std::move(inst));
+		}
+		blocks[b].code = std::move(code);
+
+		for (auto s : blocks[b].succs) {
+			auto& succ = blocks[s];
+			size_t k = std::find(std::begin(succ.preds), std::end(succ.preds), b) - std::begin(succ.preds);
+			for (auto& phi : succ.phis) phi.operands[k] = stacks[phi.reg].back();
+		}
+
+		for (auto c : children[b]) rename(c, stacks);
+		for (auto r : pushed) stacks[r].pop_back();
+	}
+
+	void index_values() noexcept {
+		defs.assign(replaced.size(), {});
+		defs[undefined] = { 0, None, false };
+		for (auto v : parameter_values) defs[v] = { 0, None, false };
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+			for (size_t i = 0; i < block.phis.size(); ++i) defs[block.phis[i].def] = { b, i, true };
+			for (size_t i = 0; i < block.code.size(); ++i) if (block.code[i].def != No_Register)
+				defs[block.code[i].def] = { b, i, false };
+		}
+	}
+
+	const RI::Register* constant(Reg v) const noexcept {
+		if (v == No_Register) return nullptr;
+		auto& d = defs[v];
+		if (d.block == None || d.idx == None || d.phi) return nullptr;
+		auto& x = blocks[d.block].code[d.idx].x;
+		if (!x.typecheck(I::Constant_Kind)) return nullptr;
+		return &program.constants[x.Constant_.idx];
+	}
+
+	// Dividing by it can't stop the program.
+	bool safe_divisor(Inst& inst) const noexcept {
+		if (!can_trap(inst.x.kind)) return true;
+		Reg* a;
+		Reg* b;
+		operands(inst.x, a, b);
+		auto* c = constant(*b);
+		return c && c->u != 0;
+	}
+
+	void rewrite() noexcept {
+		for (auto b : rpo) {
+			for (auto& phi : blocks[b].phis) for (auto& r : phi.operands) r = resolve(r);
+			for (auto& inst : blocks[b].code) for_each_use(inst, [&] (Reg& r) { r = resolve(r); });
+		}
+	}
+
+	// Drops the instructions turned into None and the phis without a def.
+	void compact() noexcept {
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+			std::erase_if(block.code, [] (const Inst& x) { return x.x.kind == I::None_Kind; });
+			std::erase_if(block.phis, [] (const Phi& x) { return x.def == No_Register; });
+		}
+	}
+
+	bool fold() noexcept {
+		bool changed = false;
+		bool cfg_changed = false;
+		index_values();
+
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+
+			for (auto& phi : block.phis) {
+				// A phi merging one value is that value. The undefined operands can be anything,
+				// so they can be that value too as long as it's defined before the phi.
+				Reg same = No_Register;
+				bool unique = true;
+				bool skipped = false;
+				for (auto& r : phi.operands) {
+					r = resolve(r);
+					if (r == phi.def) continue;
+					if (r == undefined) {
+						skipped = true;
+						continue;
+					}
+					if (same == No_Register) same = r;
+					else if (same != r) unique = false;
+				}
+				if (!unique) continue;
+				if (same == No_Register) same = undefined;
+				if (skipped && same != undefined && !dominates(defs[same].block, b)) continue;
+
+				replaced[phi.def] = same;
+				phi.def = No_Register;
+				changed = true;
+			}
+
+			for (auto& inst : block.code) {
+				for_each_use(inst, [&] (Reg& r) { r = resolve(r); });
+				auto& x = inst.x;
+
+				Reg* a;
+				Reg* c;
+				operands(x, a, c);
+				if (!a) continue;
+				auto* ca = constant(*a);
+				auto* cc = c ? constant(*c) : nullptr;
+				if (!ca || (c && !cc)) {
+					// x + 0, x - 0 and x * 1 on integers. On reals -0 + 0 is 0 so they stay.
+					Reg same = No_Register;
+					auto is = [] (const RI::Register* k, std::uint64_t v) { return k && k->u == v; };
+					if (x.kind == I::Add_I_Kind) same = is(cc, 0) ? *a : is(ca, 0) ? *c : No_Register;
+					if (x.kind == I::Sub_I_Kind) same = is(cc, 0) ? *a : No_Register;
+					if (x.kind == I::Mul_I_Kind) same = is(cc, 1) ? *a : is(ca, 1) ? *c : No_Register;
+					if (same != No_Register) {
+						replaced[inst.def] = same;
+						x.kind = I::None_Kind;
+						changed = true;
+					}
+					continue;
+				}
+
+				RI::Register zero;
+				memset(&zero, 0, sizeof(zero));
+				if (is_conditional(x)) {
+					bool taken = holds(x.kind, *ca, cc ? *cc : zero);
+					size_t keep = block.succs[taken ? 0 : 1];
+					size_t drop = block.succs[taken ? 1 : 0];
+					remove_pred(drop, b);
+					block.succs = { keep };
+					x = RI::Jmp{};
+					cfg_changed = true;
+					continue;
+				}
+
+				RI::Register res;
+				if (!evaluate(x.kind, *ca, cc ? *cc : zero, res)) continue;
+				program.constants.push_back(res);
+				x = RI::Constant{ 0, (std::uint32_t)program.constants.size() - 1 };
+				changed = true;
+			}
+		}
+
+		compact();
+		rewrite();
+		if (cfg_changed) analyze();
+		return changed || cfg_changed;
+	}
+
+	using Key = std::tuple<int, Reg, Reg, std::uint64_t, std::uint64_t>;
+
+	Key key(I& x) const noexcept {
+		std::uint64_t bits[2] = {};
+		if (x.kind == I::Constant_Kind) {
+			auto& c = program.constants[x.Constant_.idx];
+			memcpy(bits, &c, std::min(sizeof(c), sizeof(bits)));
+			return { x.kind, 0, 0, bits[0], bits[1] };
+		}
+		if (x.kind == I::Function_Kind) return { x.kind, 0, 0, x.Function_.f_idx, 0 };
+
+		Reg* a;
+		Reg* b;
+		operands(x, a, b);
+		Reg ra = *a;
+		Reg rb = b ? *b : No_Register;
+		if (is_commutative(x.kind) && rb < ra) std::swap(ra, rb);
+		return { x.kind, ra, rb, 0, 0 };
+	}
+
+	bool gvn() noexcept {
+		bool changed = false;
+		std::map<Key, Reg> available;
+
+		auto visit = [&] (auto& self, size_t b) -> void {
+			std::vector<Key> added;
+			for (auto& inst : blocks[b].code) {
+				for_each_use(inst, [&] (Reg& r) { r = resolve(r); });
+				if (!is_pure(inst.x)) continue;
+
+				auto k = key(inst.x);
+				auto it = available.find(k);
+				if (it != std::end(available)) {
+					replaced[inst.def] = it->second;
+					inst.x.kind = I::None_Kind;
+					changed = true;
+				} else {
+					available.emplace(k, inst.def);
+					added.push_back(k);
+				}
+			}
+			for (auto c : children[b]) self(self, c);
+			for (auto& k : added) available.erase(k);
+		};
+		visit(visit, 0);
+
+		compact();
+		rewrite();
+		return changed;
+	}
+
+	// The block before the header that every iteration starts from, None when there isn't one.
+	size_t preheader(const Loop& loop) const noexcept {
+		size_t res = None;
+		for (auto p : blocks[loop.header].preds) if (!loop.body[p]) {
+			if (res != None) return None;
+			res = p;
+		}
+		if (res == None || blocks[res].succs.size() != 1) return None;
+		return res;
+	}
+
+	void make_preheader(const Loop& loop) noexcept {
+		size_t h = loop.header;
+		size_t p = blocks.size();
+		blocks.emplace_back();
+
+		auto& header = blocks[h];
+		auto& pre = blocks[p];
+		pre.code.push_back(instruction(RI::Jmp{}));
+		pre.succs = { h };
+
+		std::vector<size_t> inside;
+		for (size_t k = 0; k < header.preds.size(); ++k) {
+			if (loop.body[header.preds[k]]) inside.push_back(k);
+			else pre.preds.push_back(header.preds[k]);
+		}
+
+		// The header's phis take what comes from outside the loop through a phi of the preheader.
+		for (auto& phi : header.phis) {
+			Phi outer;
+			for (size_t k = 0; k < header.preds.size(); ++k) if (!loop.body[header.preds[k]])
+				outer.operands.push_back(phi.operands[k]);
+
+			std::vector<Reg> operands;
+			for (auto k : inside) operands.push_back(phi.operands[k]);
+			if (outer.operands.size() == 1) {
+				operands.push_back(outer.operands[0]);
+			} else {
+				outer.def = new_value();
+				operands.push_back(outer.def);
+				pre.phis.push_back(outer);
+			}
+			phi.operands = operands;
+		}
+
+		for (auto o : pre.preds) for (auto& s : blocks[o].succs) if (s == h) s = p;
+		std::vector<size_t> preds;
+		for (auto k : inside) preds.push_back(header.preds[k]);
+		preds.push_back(p);
+		header.preds = preds;
+	}
+
+	bool licm() noexcept {
+		for (bool made = true; made;) {
+			made = false;
+			for (auto& loop : loops) if (preheader(loop) == None) {
+				make_preheader(loop);
+				analyze();
+				made = true;
+				break;
+			}
+		}
+		index_values();
+
+		// Inner loops first, what they hoist can then leave the loops around them.
+		std::vector<size_t> order;
+		for (size_t l = 0; l < loops.size(); ++l) order.push_back(l);
+		std::stable_sort(std::begin(order), std::end(order), [&] (size_t a, size_t b) {
+			return loops[a].size < loops[b].size;
+		});
+
+		bool changed = false;
+		for (auto l : order) {
+			auto& loop = loops[l];
+			size_t pre = preheader(loop);
+			if (pre == None) continue;
+
+			for (auto b : rpo) if (loop.body[b]) for (auto& inst : blocks[b].code) {
+				if (!is_pure(inst.x) || !safe_divisor(inst)) continue;
+
+				bool invariant = true;
+				for_each_use(inst, [&] (Reg& r) { if (loop.body[defs[r].block]) invariant = false; });
+				if (!invariant) continue;
+
+				auto& to = blocks[pre].code;
+				to.insert(std::end(to) - 1, inst);
+				defs[inst.def] = { pre, to.size() - 2, false };
+				inst.x.kind = I::None_Kind;
+				changed = true;
+			}
+		}
+
+		compact();
+		return changed;
+	}
+
+	void dce() noexcept {
+		index_values();
+
+		std::vector<bool> live(replaced.size(), false);
+		std::vector<Reg> work;
+		auto mark = [&] (Reg& r) {
+			if (r == No_Register || live[r]) return;
+			live[r] = true;
+			work.push_back(r);
+		};
+
+		for (auto b : rpo) for (auto& inst : blocks[b].code)
+			if (!is_pure(inst.x) || !safe_divisor(inst)) for_each_use(inst, mark);
+
+		while (!work.empty()) {
+			Reg v = work.back();
+			work.pop_back();
+			auto& d = defs[v];
+			if (d.block == None || d.idx == None) continue;
+			if (d.phi) for (auto& r : blocks[d.block].phis[d.idx].operands) mark(r);
+			else for_each_use(blocks[d.block].code[d.idx], mark);
+		}
+
+		for (auto b : rpo) {
+			for (auto& phi : blocks[b].phis) if (!live[phi.def]) phi.def = No_Register;
+			for (auto& inst : blocks[b].code) {
+				if (inst.def == No_Register || live[inst.def]) continue;
+				if (inst.x.typecheck(I::Call_Kind)) inst.def = No_Register;
+				else if (is_pure(inst.x) && safe_divisor(inst)) inst.x.kind = I::None_Kind;
+			}
+		}
+		compact();
+	}
+
+	// An edge from a block with two successors to one with phis gets a block of its own for the
+	// phi copies, they would run on the other path too otherwise.
+	void split_critical_edges() noexcept {
+		size_t n = blocks.size();
+		for (size_t b = 0; b < n; ++b) {
+			if (blocks[b].dead || blocks[b].phis.empty()) continue;
+			for (size_t k = 0; k < blocks[b].preds.size(); ++k) {
+				size_t p = blocks[b].preds[k];
+				if (blocks[p].succs.size() < 2) continue;
+
+				size_t e = blocks.size();
+				blocks.emplace_back();
+				blocks[e].code.push_back(instruction(RI::Jmp{}));
+				blocks[e].preds = { p };
+				blocks[e].succs = { b };
+				for (auto& s : blocks[p].succs) if (s == b) s = e;
+				blocks[b].preds[k] = e;
+			}
+		}
+		analyze();
+	}
+
+	Reg find(Reg v) noexcept {
+		while (parent[v] != v) v = parent[v] = parent[parent[v]];
+		return v;
+	}
+
+	// Goes back to registers, fills color.
+	void out_of_ssa() noexcept {
+		split_critical_edges();
+
+		// x = phi(a, b) becomes x' = phi(a', b') with a' = a and b' = b copied at the end of the
+		// preds and x = x' at the start of the block. x', a' and b' never interfere, they share a
+		// register and the phi itself is nothing.
+		parent.clear();
+		std::vector<std::pair<Reg, Reg>> classes;
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+			std::vector<Inst> copies;
+			for (auto& phi : block.phis) {
+				Reg x = phi.def;
+				phi.def = new_value();
+				for (size_t k = 0; k < phi.operands.size(); ++k) {
+					Reg a = phi.operands[k];
+					if (a == undefined) {
+						phi.operands[k] = No_Register;
+						continue;
+					}
+					auto copy = instruction(RI::Move{ 0, a }, new_value());
+					auto& pred = blocks[block.preds[k]].code;
+					pred.insert(std::end(pred) - 1, copy);
+					phi.operands[k] = copy.def;
+					classes.push_back({ phi.def, copy.def });
+				}
+				copies.push_back(instruction(RI::Move{ 0, phi.def }, x));
+			}
+			block.code.insert(std::begin(block.code), std::begin(copies), std::end(copies));
+		}
+
+		size_t n = replaced.size();
+		parent.resize(n);
+		for (Reg v = 0; v < n; ++v) parent[v] = v;
+		for (auto [a, b] : classes) parent[find(b)] = find(a);
+
+		auto is_value = [&] (Reg r) { return r != No_Register && r != undefined; };
+
+		// Liveness, the phi operands are used at the end of the preds.
+		std::vector<Bits> uses(blocks.size());
+		std::vector<Bits> kills(blocks.size());
+		std::vector<Bits> live_in(blocks.size());
+		std::vector<Bits> live_out(blocks.size());
+		std::vector<Bits> phi_uses(blocks.size());
+		for (size_t b = 0; b < blocks.size(); ++b) {
+			uses[b].resize(n);
+			kills[b].resize(n);
+			live_in[b].resize(n);
+			live_out[b].resize(n);
+			phi_uses[b].resize(n);
+		}
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+			for (auto& phi : block.phis) {
+				kills[b].set(phi.def);
+				for (size_t k = 0; k < phi.operands.size(); ++k) if (is_value(phi.operands[k]))
+					phi_uses[block.preds[k]].set(phi.operands[k]);
+			}
+			for (auto& inst : block.code) {
+				for_each_use(inst, [&] (Reg& r) { if (is_value(r) && !kills[b].test(r)) uses[b].set(r); });
+				if (inst.def != No_Register) kills[b].set(inst.def);
+			}
+		}
+		for (bool changed = true; changed;) {
+			changed = false;
+			for (size_t i = rpo.size(); i-- > 0;) {
+				size_t b = rpo[i];
+				auto out = phi_uses[b];
+				for (auto s : blocks[b].succs)
+					for (size_t w = 0; w < out.words.size(); ++w) out.words[w] |= live_in[s].words[w];
+				auto in = uses[b];
+				for (size_t w = 0; w < in.words.size(); ++w) in.words[w] |= out.words[w] & ~kills[b].words[w];
+				if (in.words != live_in[b].words || out.words != live_out[b].words) changed = true;
+				live_in[b] = std::move(in);
+				live_out[b] = std::move(out);
+			}
+		}
+
+		// A value interferes with everything live where it's defined, except the source of the
+		// copy defining it.
+		std::vector<Bits> edges(n);
+		for (auto& e : edges) e.resize(n);
+		auto interfere = [&] (Reg a, Reg b) {
+			a = find(a);
+			b = find(b);
+			if (a == b) return;
+			edges[a].set(b);
+			edges[b].set(a);
+		};
+		for (auto b : rpo) {
+			auto& block = blocks[b];
+			auto live = live_out[b];
+			for (size_t i = block.code.size(); i-- > 0;) {
+				auto& inst = block.code[i];
+				if (inst.def != No_Register) {
+					Reg source = inst.x.typecheck(I::Move_Kind) ? inst.x.Move_.a : No_Register;
+					live.for_each([&] (size_t l) { if (l != inst.def && l != source) interfere(inst.def, l); });
+					live.reset(inst.def);
+				}
+				for_each_use(inst, [&] (Reg& r) { if (is_value(r)) live.set(r); });
+			}
+			for (auto& phi : block.phis)
+				live.for_each([&] (size_t l) { if (l != phi.def) interfere(phi.def, l); });
+			for (auto& phi : block.phis) live.reset(phi.def);
+
+			// What's left at the entry are the parameters, they all arrive together.
+			if (b == 0) live.for_each([&] (size_t a) { live.for_each([&] (size_t l) { interfere(a, l); }); });
+		}
+
+		std::vector<Reg> precolor(n, No_Register);
+		for (Reg i = 0; i < parameter_values.size(); ++i) precolor[find(parameter_values[i])] = i;
+
+		// Coalescing, the copies in the deepest loops first.
+		std::vector<size_t> order = rpo;
+		std::stable_sort(std::begin(order), std::end(order), [&] (size_t a, size_t b) {
+			return loop_depth[a] > loop_depth[b];
+		});
+		for (auto b : order) for (auto& inst : blocks[b].code) {
+			Reg source = No_Register;
+			if (inst.x.typecheck(I::Move_Kind))  source = inst.x.Move_.a;
+			if (inst.x.typecheck(I::Inc_Kind))   source = inst.x.Inc_.a;
+			if (inst.x.typecheck(I::Inc_I_Kind)) source = inst.x.Inc_I_.a;
+			if (!is_value(source)) continue;
+
+			Reg a = find(inst.def);
+			Reg c = find(source);
+			if (a == c || edges[a].test(c)) continue;
+			if (precolor[a] != No_Register && precolor[c] != No_Register) continue;
+
+			parent[c] = a;
+			for (size_t w = 0; w < edges[a].words.size(); ++w) edges[a].words[w] |= edges[c].words[w];
+			edges[c].for_each([&] (size_t x) { edges[x].set(a); });
+			if (precolor[a] == No_Register) precolor[a] = precolor[c];
+		}
+
+		color.assign(n, No_Register);
+		for (Reg v = 0; v < n; ++v) if (precolor[v] != No_Register && find(v) == v) color[v] = precolor[v];
+
+		std::vector<bool> taken;
+		auto pick = [&] (Reg v) {
+			v = find(v);
+			if (color[v] != No_Register) return;
+			taken.assign(n + 1, false);
+			edges[v].for_each([&] (size_t x) {
+				Reg c = color[find(x)];
+				if (c != No_Register) taken[c] = true;
+			});
+			Reg c = 0;
+			while (taken[c]) c++;
+			color[v] = c;
+		};
+		for (auto b : rpo) {
+			for (auto& phi : blocks[b].phis) pick(phi.def);
+			for (auto& inst : blocks[b].code) if (inst.def != No_Register) pick(inst.def);
+		}
+	}
+
+	Reg color_of(Reg v) noexcept {
+		if (v == No_Register) return No_Register;
+		if (v == undefined) return 0;
+		return color[find(v)];
+	}
+
+	// Lays the blocks out in their original order, the ones made by the passes just before the
+	// block they go to. A block that's only a jump is skipped and so is a jump to the next block.
+	std::vector<I> emit(std::vector<Reg>& arguments, size_t& registers) noexcept {
+		// The undefined value reads r0.
+		registers = std::max<size_t>(parameters, 1);
+		std::vector<std::vector<I>> bodies(blocks.size());
+		std::vector<I> terminators(blocks.size());
+		for (auto b : rpo) {
+			auto& code = blocks[b].code;
+			for (size_t i = 0; i < code.size(); ++i) {
+				auto inst = code[i];
+				for_each_use(inst, [&] (Reg& r) { r = color_of(r); });
+				Reg d = color_of(inst.def);
+				if (d != No_Register) registers = std::max<size_t>(registers, d + 1);
+				auto& x = inst.x;
+
+				if (i + 1 == code.size()) {
+					terminators[b] = x;
+					continue;
+				}
+				if (x.typecheck(I::Move_Kind) && x.Move_.a == d) continue;
+				if (x.typecheck(I::Inc_Kind) && x.Inc_.a != d) {
+					bodies[b].push_back(RI::Move{ d, x.Inc_.a });
+					x.Inc_.a = d;
+				}
+				if (x.typecheck(I::Inc_I_Kind) && x.Inc_I_.a != d) {
+					bodies[b].push_back(RI::Move{ d, x.Inc_I_.a });
+					x.Inc_I_.a = d;
+				}
+				if (x.typecheck(I::Call_Kind)) {
+					x.Call_.arguments = (std::uint32_t)arguments.size();
+					x.Call_.n = (std::uint32_t)inst.arguments.size();
+					arguments.insert(std::end(arguments), std::begin(inst.arguments), std::end(inst.arguments));
+				}
+				if (auto* dst = dst_field(x)) *dst = d;
+				bodies[b].push_back(x);
+			}
+		}
+
+		auto forward = [&] (size_t b) {
+			size_t t = b;
+			for (size_t hops = 0; hops <= blocks.size(); ++hops) {
+				if (!bodies[t].empty() || !terminators[t].typecheck(I::Jmp_Kind)) return t;
+				t = blocks[t].succs[0];
+			}
+			// Only empty blocks jumping around in circles.
+			return b;
+		};
+
+		std::vector<size_t> layout = { forward(0) };
+		for (auto b : rpo) if (b != layout[0] && forward(b) == b) layout.push_back(b);
+		auto position = [&] (auto& self, size_t b, size_t depth) -> std::pair<size_t, size_t> {
+			if (b < original_blocks || depth > blocks.size()) return { b, 1 };
+			return { self(self, blocks[b].succs[0], depth + 1).first, 0 };
+		};
+		std::stable_sort(std::begin(layout) + 1, std::end(layout), [&] (size_t a, size_t b) {
+			return position(position, a, 0) < position(position, b, 0);
+		});
+
+		std::vector<I> code;
+		std::vector<size_t> address(blocks.size(), None);
+		std::vector<std::pair<size_t, size_t>> jumps;
+		for (size_t i = 0; i < layout.size(); ++i) {
+			size_t b = layout[i];
+			size_t next = i + 1 < layout.size() ? layout[i + 1] : None;
+			address[b] = code.size();
+			code.insert(std::end(code), std::begin(bodies[b]), std::end(bodies[b]));
+
+			auto& x = terminators[b];
+			auto& succs = blocks[b].succs;
+			size_t to = None;
+			if (x.typecheck(I::Jmp_Kind)) {
+				to = forward(succs[0]);
+			} else if (is_conditional(x)) {
+				size_t fall = forward(succs[0]);
+				to = forward(succs[1]);
+				if (fall == to) {
+					to = fall;
+				} else {
+					jumps.push_back({ code.size(), to });
+					code.push_back(x);
+					to = fall;
+				}
+			} else {
+				code.push_back(x);
+			}
+			if (to != None && to != next) {
+				jumps.push_back({ code.size(), to });
+				code.push_back(RI::Jmp{});
+			}
+		}
+		for (auto [ip, b] : jumps) *jump_dt(code[ip]) = (int)address[b] - (int)ip;
+
+		return code;
+	}
+
+	void optimize() noexcept {
+		for (size_t round = 0; round < 8; ++round) {
+			bool changed = fold();
+			changed |= gvn();
+			if (!changed) break;
+		}
+		licm();
+		gvn();
+		dce();
+		out_of_ssa();
+	}
+};
+
+void optimize_ssa(Register_Program& program) noexcept {
+	std::vector<Reg> arguments;
+	size_t frame_size = 0;
+
+	// The functions still have their code from before linking, where Function holds the index of
+	// the function and not its address.
+	for (size_t i = 0; i < program.functions.size(); ++i) {
+		auto& f = program.functions[i];
+
+		SSA_Function ssa(program);
+		ssa.build(f.code, program.arguments, f.parameters, i == 0);
+		ssa.optimize();
+
+		size_t registers = 0;
+		f.code = ssa.emit(arguments, registers);
+		frame_size = std::max(frame_size, registers);
+	}
+
+	program.arguments = std::move(arguments);
+	program.frame_size = frame_size;
+	program.link();
+}
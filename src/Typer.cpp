@@ -0,0 +1,474 @@
+#include "Typer.hpp"
+
+#include <unordered_set>
+
+#include "xstd.hpp"
+
+static constexpr size_t Bool_Id = AST_Interpreter::Bool_Type::unique_id;
+static constexpr size_t Real_Id = AST_Interpreter::Real_Type::unique_id;
+static constexpr size_t Byte_Id = AST_Interpreter::Byte_Type::unique_id;
+static constexpr size_t Nat_Id  = AST_Interpreter::Nat_Type::unique_id;
+static constexpr size_t Int_Id  = AST_Interpreter::Int_Type::unique_id;
+static constexpr size_t Void_Id = AST_Interpreter::Void_Type::unique_id;
+
+struct Typer_State {
+	const std::vector<AST::Node>& nodes;
+	std::string_view file;
+	AST_Interpreter& interpreter;
+
+	Typed_AST result;
+
+	// Type the proc being typed returns, 0 at the top level.
+	size_t return_type = 0;
+
+	// Proc definitions whose variable is assigned or has its address taken somewhere, the
+	// variable can then hold another proc.
+	std::unordered_set<size_t> reassigned;
+
+	Typer_State(
+		const std::vector<AST::Node>& nodes, std::string_view file, AST_Interpreter& interpreter
+	) noexcept : nodes(nodes), file(file), interpreter(interpreter) {
+		result.types.resize(nodes.size(), 0);
+		result.operand_types.resize(nodes.size(), 0);
+		result.procs.resize(nodes.size(), 0);
+		result.constants.resize(nodes.size(), 0);
+	}
+
+	std::string_view name_of(const Token& token) const noexcept {
+		return string_view_from_view(file, token.lexeme);
+	}
+
+	// Only the first error is reported, what comes after is likely to follow from it.
+	size_t error(size_t idx, const char* what) noexcept {
+		if (result.ok) println("Line %zu: %s", nodes[idx]->loc.line + 1, what);
+		result.ok = false;
+		return 0;
+	}
+
+	AST_Interpreter::Type::Kind kind_of(size_t type_id) noexcept {
+		if (!type_id || !interpreter.types.count(type_id)) return AST_Interpreter::Type::None_Kind;
+		return interpreter.types.at(type_id).kind;
+	}
+};
+
+static bool is_number(size_t type_id) noexcept {
+	return type_id == Real_Id || type_id == Int_Id || type_id == Nat_Id || type_id == Byte_Id;
+}
+
+static bool is_proc(Typer_State& state, size_t type_id) noexcept {
+	auto kind = state.kind_of(type_id);
+	return
+		kind == AST_Interpreter::Type::User_Function_Type_Kind ||
+		kind == AST_Interpreter::Type::Function_Signature_Kind;
+}
+
+// If a value of type from can be stored in a variable of type to. Numbers are converted and any
+// proc goes where a proc is expected, signatures aren't checked yet.
+static bool assignable(Typer_State& state, size_t from, size_t to) noexcept {
+	if (!from || !to || from == to) return true;
+	if (is_number(from) && is_number(to)) return true;
+	return is_proc(state, from) && is_proc(state, to);
+}
+
+static size_t type_expression(Typer_State& state, size_t idx) noexcept;
+static void   type_statement (Typer_State& state, size_t idx) noexcept;
+static void   condition      (Typer_State& state, size_t idx) noexcept;
+
+static size_t identifier(Typer_State& state, size_t idx) noexcept {
+	auto name = state.name_of(state.nodes[idx].Identifier_.token);
+	auto id = state.interpreter.lookup(name);
+	if (!id.typecheck(AST_Interpreter::Value::Identifier_Kind))
+		return state.error(idx, "Unknown identifier.");
+
+	// See declaration, it's where the variable comes from.
+	size_t from = id.Identifier_.memory_idx;
+	if (from && state.nodes[from].typecheck(AST::Node::Declaration_Kind))
+		state.result.constants[idx] = from;
+	else
+		state.result.procs[idx] = from;
+	return id.Identifier_.type_descriptor_id;
+}
+
+static size_t litteral(Typer_State& state, size_t idx) noexcept {
+	auto& node = state.nodes[idx].Litteral_;
+	auto view = node.token.lexeme;
+
+	switch (node.token.type) {
+	case Token::Type::Number: {
+		std::int64_t x = 0;
+		auto text = state.name_of(node.token);
+		return AST_Interpreter::parse_integer(text, x) ? Int_Id : Real_Id;
+	}
+	case Token::Type::True:
+	case Token::Type::False:
+		return Bool_Id;
+	case Token::Type::String:
+		// The length as 8 bytes and then the characters, see the compiler.
+		return state.interpreter.create_array_type(Byte_Id, view.size - 2 + 8).get_unique_id();
+	default:
+		return state.error(idx, "Unknown litteral.");
+	}
+}
+
+static size_t list_op(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Operation_List_;
+
+	if (node.op == AST::Operator::Dot)
+		return state.error(node.left_idx, "Members are not supported yet.");
+
+	if (node.op == AST::Operator::Assign) {
+		if (!nodes[node.left_idx].typecheck(AST::Node::Identifier_Kind))
+			return state.error(idx, "Can only assign to a variable.");
+
+		size_t to   = type_expression(state, node.left_idx);
+		size_t from = type_expression(state, node.rest_idx);
+		if (state.result.constants[node.left_idx])
+			return state.error(idx, "Assigning to a constant.");
+		state.reassigned.insert(state.result.procs[node.left_idx]);
+		if (!assignable(state, from, to))
+			return state.error(idx, "Assigning a value of another type.");
+		return to;
+	}
+	if (node.op == AST::Operator::As) {
+		state.result.operand_types[idx] = type_expression(state, node.left_idx);
+		return state.interpreter.type_interpret(nodes, node.rest_idx, state.file).get_unique_id();
+	}
+
+	bool is_comparison =
+		node.op == AST::Operator::Eq || node.op == AST::Operator::Neq ||
+		node.op == AST::Operator::Lt || node.op == AST::Operator::Leq ||
+		node.op == AST::Operator::Gt;
+	bool is_arithmetic =
+		node.op == AST::Operator::Plus || node.op == AST::Operator::Minus ||
+		node.op == AST::Operator::Star || node.op == AST::Operator::Div ||
+		node.op == AST::Operator::Mod;
+	if (!is_comparison && !is_arithmetic) return state.error(idx, "Unsupported operation.");
+
+	size_t left  = type_expression(state, node.left_idx);
+	size_t right = type_expression(state, node.rest_idx);
+	if (!left || !right) return 0;
+
+	// Moving a pointer by a number, the address is computed on as a nat.
+	bool pointer = state.kind_of(left) == AST_Interpreter::Type::Pointer_Type_Kind;
+	if (pointer && is_number(right) && node.op == AST::Operator::Plus) {
+		state.result.operand_types[idx] = Nat_Id;
+		return left;
+	}
+
+	if (!is_number(left))  return state.error(node.left_idx, "Expected a number.");
+	if (!is_number(right)) return state.error(node.rest_idx, "Expected a number.");
+
+	if (left == Byte_Id)  left  = Int_Id;
+	if (right == Byte_Id) right = Int_Id;
+
+	size_t operand = Real_Id;
+	if (left != Real_Id && right != Real_Id)
+		operand = left == Nat_Id || right == Nat_Id ? Nat_Id : Int_Id;
+
+	state.result.operand_types[idx] = operand;
+	return is_comparison ? Bool_Id : operand;
+}
+
+static size_t unary_op(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Unary_Operation_;
+
+	bool on_variable = nodes[node.right_idx].typecheck(AST::Node::Identifier_Kind);
+	if (node.op == AST::Operator::Amp || node.op == AST::Operator::Inc) {
+		if (!on_variable) return state.error(idx, "Expected a variable.");
+	}
+
+	size_t right = type_expression(state, node.right_idx);
+	if (!right) return 0;
+	if (node.op == AST::Operator::Amp || node.op == AST::Operator::Inc) {
+		if (state.result.constants[node.right_idx]) return state.error(idx, "Modifying a constant.");
+	}
+	if (node.op == AST::Operator::Amp) state.reassigned.insert(state.result.procs[node.right_idx]);
+
+	switch (node.op) {
+	case AST::Operator::Minus:
+		if (!is_number(right)) return state.error(idx, "Expected a number.");
+		return right == Real_Id ? Real_Id : Int_Id;
+	case AST::Operator::Not:
+		if (right != Bool_Id && !is_number(right)) return state.error(idx, "Expected a bool or a number.");
+		return Bool_Id;
+	case AST::Operator::Inc:
+		if (!is_number(right)) return state.error(idx, "Expected a number.");
+		return Void_Id;
+	case AST::Operator::Star:
+		if (state.kind_of(right) != AST_Interpreter::Type::Pointer_Type_Kind)
+			return state.error(idx, "Expected a pointer.");
+		return state.interpreter.types.at(right).Pointer_Type_.user_type_descriptor_idx;
+	case AST::Operator::Amp:
+		return state.interpreter.create_pointer_type(right).get_unique_id();
+	default:
+		return state.error(idx, "Unsupported operation.");
+	}
+}
+
+static size_t function_call(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Function_Call_;
+
+	if (!nodes[node.identifier_idx].typecheck(AST::Node::Identifier_Kind))
+		return state.error(idx, "Methods are not supported yet.");
+
+	size_t n_arguments = 0;
+	for (size_t i = node.argument_list_idx; i; i = nodes[i]->next_statement, n_arguments++)
+		type_expression(state, nodes[i].Argument_.value_idx);
+
+	auto name = state.name_of(nodes[node.identifier_idx].Identifier_.token);
+	// >TODO(Tackwin): The compiled print only prints its first argument.
+	if (name == "print") {
+		if (!n_arguments) return state.error(idx, "Expected an argument.");
+		return 0;
+	}
+	if (name == "sleep" || name == "int") {
+		if (n_arguments != 1) return state.error(idx, "Expected one argument.");
+
+		size_t arg = state.result.types[nodes[node.argument_list_idx].Argument_.value_idx];
+		if (!is_number(arg)) return state.error(idx, "Expected a number.");
+		return name == "int" ? Int_Id : 0;
+	}
+
+	size_t callee = type_expression(state, node.identifier_idx);
+	if (!callee) return 0;
+
+	auto& type = state.interpreter.types.at(callee);
+	const std::vector<size_t>* parameters = nullptr;
+	const std::vector<size_t>* returns    = nullptr;
+	if (type.kind == AST_Interpreter::Type::User_Function_Type_Kind) {
+		parameters = &type.User_Function_Type_.parameter_type;
+		returns    = &type.User_Function_Type_.return_type;
+	} else if (type.kind == AST_Interpreter::Type::Function_Signature_Kind) {
+		parameters = &type.Function_Signature_.parameter_types;
+		returns    = &type.Function_Signature_.return_types;
+	} else {
+		return state.error(idx, "Calling something that isn't a proc.");
+	}
+
+	// A proc parameter's signature is only a hint for now, f: proc (real) -> real can be called
+	// with more arguments. The arguments are only checked against a declared proc.
+	bool declared = type.kind == AST_Interpreter::Type::User_Function_Type_Kind;
+	if (declared && parameters->size() != n_arguments)
+		return state.error(idx, "Wrong number of arguments.");
+
+	size_t arg_idx = 0;
+	for (size_t i = node.argument_list_idx; i; i = nodes[i]->next_statement, arg_idx++) {
+		size_t arg = state.result.types[nodes[i].Argument_.value_idx];
+		if (declared && !assignable(state, arg, (*parameters)[arg_idx]))
+			return state.error(i, "Argument of the wrong type.");
+	}
+
+	// >TODO(Tackwin): >Return Handle multiple returns
+	return returns->empty() ? 0 : returns->front();
+}
+
+static void function(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Function_Definition_;
+	if (node.is_method) {
+		state.error(idx, "Methods are not supported yet.");
+		return;
+	}
+
+	state.interpreter.push_scope();
+	state.interpreter.scopes.back().fence = true;
+	defer { state.interpreter.pop_scope(); };
+
+	for (size_t i = node.parameter_list_idx; i; i = nodes[i]->next_statement) {
+		auto& param = nodes[i].Declaration_;
+
+		AST_Interpreter::Identifier id;
+		id.type_descriptor_id = state.interpreter.type_interpret(
+			nodes, param.type_expression_idx, state.file
+		).get_unique_id();
+		state.result.types[i] = id.type_descriptor_id;
+		state.interpreter.new_variable(state.name_of(param.identifier), id);
+	}
+
+	auto old_return_type = state.return_type;
+	defer { state.return_type = old_return_type; };
+	state.return_type = 0;
+	if (node.return_list_idx) {
+		auto& ret = nodes[node.return_list_idx].Return_Parameter_;
+		state.return_type = state.interpreter.type_interpret(
+			nodes, ret.type_identifier, state.file
+		).get_unique_id();
+	}
+
+	for (size_t i = node.statement_list_idx; i; i = nodes[i]->next_statement)
+		type_statement(state, i);
+}
+
+static size_t declaration(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Declaration_;
+	auto name = state.name_of(node.identifier);
+	auto value = node.value_expression_idx;
+
+	// Type definitions, the variable is the proc itself or a name for the struct.
+	if (value && nodes[value].typecheck(AST::Node::Function_Definition_Kind)) {
+		auto t = state.interpreter.type_interpret(nodes, value, state.file);
+
+		// The variable remembers its definition in memory_idx, unused by the type checker.
+		AST_Interpreter::Identifier id;
+		id.memory_idx = value;
+		id.type_descriptor_id = t.get_unique_id();
+		// Declared before typing the body, the proc can be passed to itself.
+		state.interpreter.new_variable(name, id);
+		function(state, value);
+		return id.type_descriptor_id;
+	}
+	if (value && nodes[value].typecheck(AST::Node::Struct_Definition_Kind)) {
+		auto t = state.interpreter.type_interpret(nodes, value, state.file);
+		state.interpreter.type_name_to_hash[name] = t.get_unique_id();
+		return 0;
+	}
+
+	size_t declared = 0;
+	if (node.type_expression_idx) {
+		declared = state.interpreter.type_interpret(
+			nodes, node.type_expression_idx, state.file
+		).get_unique_id();
+	}
+
+	size_t type = declared;
+	if (value) {
+		size_t from = type_expression(state, value);
+		if (!declared) type = from;
+		if (!type) return state.error(idx, "Can't infer the type of the variable.");
+	}
+
+	// A const variable remembers its declaration in memory_idx, like a proc its definition.
+	AST_Interpreter::Identifier id;
+	id.type_descriptor_id = type;
+	auto type_node = node.type_expression_idx;
+	if (
+		type_node &&
+		nodes[type_node].typecheck(AST::Node::Type_Identifier_Kind) &&
+		nodes[type_node].Type_Identifier_.is_const
+	) {
+		if (!value) return state.error(idx, "A constant needs a value.");
+		id.memory_idx = idx;
+	}
+	state.interpreter.new_variable(name, id);
+	return type;
+}
+
+static size_t return_call(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Return_Call_;
+
+	for (size_t i = node.return_value_idx; i; i = nodes[i]->next_statement) {
+		size_t type = type_expression(state, i);
+
+		// >TODO(Tackwin): >Return Handle multiple returns
+		if (i == node.return_value_idx && !assignable(state, type, state.return_type))
+			return state.error(i, "Returning a value of another type.");
+	}
+	return 0;
+}
+
+static size_t init_list(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx].Initializer_List_;
+
+	for (size_t i = node.expression_list_idx; i; i = nodes[i]->next_statement)
+		type_expression(state, i);
+
+	// >TODO(Tackwin): auto deduce type from context.
+	if (!node.type_identifier) return state.error(idx, "Please specify the type explicitely.");
+	return state.interpreter.type_interpret(nodes, *node.type_identifier, state.file)
+		.get_unique_id();
+}
+
+static size_t type_expression(Typer_State& state, size_t idx) noexcept {
+	auto& nodes = state.nodes;
+	auto& node = nodes[idx];
+
+	size_t type = 0;
+	switch (node.kind) {
+	case AST::Node::Identifier_Kind:       type = identifier   (state, idx); break;
+	case AST::Node::Litteral_Kind:         type = litteral     (state, idx); break;
+	case AST::Node::Operation_List_Kind:   type = list_op      (state, idx); break;
+	case AST::Node::Unary_Operation_Kind:  type = unary_op     (state, idx); break;
+	case AST::Node::Function_Call_Kind:    type = function_call(state, idx); break;
+	case AST::Node::Return_Call_Kind:      type = return_call  (state, idx); break;
+	case AST::Node::Initializer_List_Kind: type = init_list    (state, idx); break;
+	case AST::Node::Declaration_Kind:      type = declaration  (state, idx); break;
+	case AST::Node::Group_Expression_Kind:
+		type = type_expression(state, node.Group_Expression_.inner_idx);
+		break;
+	case AST::Node::Group_Statement_Kind: {
+		state.interpreter.push_scope();
+		defer { state.interpreter.pop_scope(); };
+		for (size_t i = node.Group_Statement_.inner_idx; i; i = nodes[i]->next_statement)
+			type_statement(state, i);
+		break;
+	}
+	case AST::Node::If_Kind: {
+		auto& x = node.If_;
+		condition(state, x.condition_idx);
+		type_statement(state, x.if_statement_idx);
+		if (x.else_statement_idx) type_statement(state, x.else_statement_idx);
+		break;
+	}
+	case AST::Node::For_Kind: {
+		auto& x = node.For_;
+		state.interpreter.push_scope();
+		defer { state.interpreter.pop_scope(); };
+		type_statement(state, x.init_statement_idx);
+		condition(state, x.cond_statement_idx);
+		type_statement(state, x.loop_statement_idx);
+		type_statement(state, x.next_statement_idx);
+		break;
+	}
+	case AST::Node::While_Kind:        return state.error(idx, "While loops are not supported yet.");
+	case AST::Node::Array_Access_Kind: return state.error(idx, "Arrays are not supported yet.");
+	default: break;
+	}
+
+	state.result.types[idx] = type;
+	return type;
+}
+
+static void type_statement(Typer_State& state, size_t idx) noexcept {
+	if (idx) type_expression(state, idx);
+}
+
+// A number is true when it isn't 0, the compiler converts an integer to a real to branch on it.
+static void condition(Typer_State& state, size_t idx) noexcept {
+	if (!idx) return;
+	size_t type = type_expression(state, idx);
+	if (type && type != Bool_Id && !is_number(type))
+		state.error(idx, "Expected a bool or a number condition.");
+}
+
+Typed_AST type_check(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file,
+	AST_Interpreter& interpreter,
+	const std::vector<Extern_Proc>& externs
+) noexcept {
+	Typer_State state(nodes, file, interpreter);
+
+	// The top level gets its own scope, the compiler declares the same variables after us.
+	interpreter.push_scope();
+	defer { interpreter.pop_scope(); };
+
+	for (auto& x : externs) {
+		AST_Interpreter::Identifier id;
+		id.type_descriptor_id = interpreter.create_signature_type(
+			x.parameter_types, x.return_types
+		).get_unique_id();
+		interpreter.new_variable(x.name, id);
+	}
+
+	for (size_t idx = 1; idx < nodes.size(); ++idx) if (nodes[idx]->depth == 0)
+		type_statement(state, idx);
+
+	for (auto& x : state.result.procs) if (state.reassigned.count(x)) x = 0;
+	return std::move(state.result);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <string_view>
+
+#include "AST.hpp"
+#include "Interpreter.hpp"
+
+// The types of every expression of a program, worked out before it's compiled so the compiler
+// knows what each value is before emitting the code computing it.
+struct Typed_AST {
+	// Indexed like the nodes. The type id of the value of each expression, 0 for statements and
+	// type definitions. For a declaration it's the type of the variable it declares, infered
+	// from its value when there is no explicit type.
+	std::vector<size_t> types;
+
+	// For the arithmetic and comparison operations, the type both operands are converted to
+	// before applying the operation: Int, Nat or Real. Bytes are computed on as ints.
+	std::vector<size_t> operand_types;
+
+	// For an identifier naming a proc variable that is never assigned nor has its address taken,
+	// the index of the proc definition it was declared with, 0 otherwise. Calls through it can
+	// only reach that proc.
+	std::vector<size_t> procs;
+
+	// For an identifier naming a const variable, the index of its declaration, 0 otherwise. A
+	// const can't be assigned nor have its address taken, the compiler works its value out when
+	// it can.
+	std::vector<size_t> constants;
+
+	// Cleared on the first type error, it's reported with its line.
+	bool ok = true;
+};
+
+// A top level proc of another file, by name and builtin type ids: the ids of the other types
+// are only meaningful in the interpreter that made them.
+struct Extern_Proc {
+	std::string name;
+	std::vector<size_t> parameter_types;
+	std::vector<size_t> return_types;
+};
+
+// Types are created in the interpreter, the compiler has to use the same one to find them. The
+// externs are declared at the top level before the program, as proc variables.
+extern Typed_AST type_check(
+	const std::vector<AST::Node>& nodes,
+	std::string_view file,
+	AST_Interpreter& interpreter,
+	const std::vector<Extern_Proc>& externs = {}
+) noexcept;
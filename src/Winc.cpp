@@ -0,0 +1,299 @@
+#include "Bytecode.hpp"
+#include "File.hpp"
+
+#include <algorithm>
+
+// A .winc file is a compiled program ready to run, what the VM needs and the line table:
+//
+//   "WINC", u32 version, u32 size of a real, u32 flags, u64 instruction set
+//   u64 counts of: data bytes, words, wide operands, pure addresses, function constants,
+//                  line table bytes, line table checkpoints
+//   then each of these, in that order and starting on 8 bytes
+//
+// Every integer is little endian whatever the machine. data is the exception, it's the constants
+// as the VM reads them, with reals in the machine's format. The flags say if it was written
+// little endian, and with the size of a real the loader refuses what it can't read.
+//
+// The instruction set is a hash of the opcode names in order, a file written with other opcodes
+// is refused too. Loading checks everything an instruction points to is in the file: jumps land
+// in the code, constants are in data and so on.
+
+static constexpr char          Magic[4] = { 'W', 'I', 'N', 'C' };
+static constexpr std::uint32_t Version  = 1;
+static constexpr std::uint32_t Little_Endian_Data = 1;
+
+static bool host_little_endian() noexcept {
+	std::uint16_t x = 1;
+	std::uint8_t first;
+	memcpy(&first, &x, 1);
+	return first == 1;
+}
+
+static std::uint64_t instruction_set() noexcept {
+	#define X(x) + 1
+	constexpr size_t n = 1 IS_LIST(X);
+	#undef X
+
+	// FNV-1a
+	std::uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 1; i < n; ++i) {
+		IS::Instruction x;
+		x.kind = (IS::Instruction::Kind)i;
+		for (const char* c = x.name(); ; ++c) {
+			hash = (hash ^ (std::uint8_t)*c) * 1099511628211ull;
+			if (!*c) break;
+		}
+	}
+	return hash;
+}
+
+struct Winc_Writer {
+	std::vector<std::uint8_t> bytes;
+
+	void u32(std::uint32_t x) noexcept {
+		for (size_t i = 0; i < 4; ++i) bytes.push_back((std::uint8_t)(x >> (8 * i)));
+	}
+	void u64(std::uint64_t x) noexcept {
+		for (size_t i = 0; i < 8; ++i) bytes.push_back((std::uint8_t)(x >> (8 * i)));
+	}
+	void raw(const void* data, size_t n) noexcept {
+		auto* it = (const std::uint8_t*)data;
+		bytes.insert(std::end(bytes), it, it + n);
+	}
+	void align() noexcept {
+		while (bytes.size() % 8) bytes.push_back(0);
+	}
+};
+
+// Every read is bound checked, ok is cleared on the first one going past the end.
+struct Winc_Reader {
+	const std::uint8_t* begin = nullptr;
+	const std::uint8_t* it    = nullptr;
+	const std::uint8_t* end   = nullptr;
+	bool ok = true;
+
+	const std::uint8_t* raw(std::uint64_t n) noexcept {
+		if (!ok || n > (std::uint64_t)(end - it)) {
+			ok = false;
+			return nullptr;
+		}
+		auto* res = it;
+		it += n;
+		return res;
+	}
+	std::uint64_t number(size_t size) noexcept {
+		auto* p = raw(size);
+		std::uint64_t x = 0;
+		if (p) for (size_t i = 0; i < size; ++i) x |= (std::uint64_t)p[i] << (8 * i);
+		return x;
+	}
+	std::uint32_t u32() noexcept { return (std::uint32_t)number(4); }
+	std::uint64_t u64() noexcept { return number(8); }
+	// For an array of n elements of size bytes, checked before n * size can overflow.
+	bool fits(std::uint64_t n, size_t size) const noexcept {
+		return ok && n <= (std::uint64_t)(end - it) / size;
+	}
+	void align() noexcept {
+		raw((8 - (it - begin) % 8) % 8);
+	}
+};
+
+extern bool save_program(const Program& program, const char* path) noexcept {
+	auto& table = program.line_table;
+
+	Winc_Writer w;
+	w.raw(Magic, sizeof(Magic));
+	w.u32(Version);
+	w.u32(sizeof(IS::Real));
+	w.u32(host_little_endian() ? Little_Endian_Data : 0);
+	w.u64(instruction_set());
+
+	w.u64(program.data.size());
+	w.u64(program.bytecode.size());
+	w.u64(program.wide.size());
+	w.u64(program.pure_addresses.size());
+	w.u64(program.function_constants.size());
+	w.u64(table.bytes.size());
+	w.u64(table.checkpoints.size());
+
+	w.raw(program.data.data(), program.data.size());
+	w.align();
+	for (auto x : program.bytecode) w.u64(x);
+	for (auto& x : program.wide) {
+		w.u64(x.a);
+		w.u64(x.b);
+		w.u64(x.c);
+	}
+	// Sorted, the same program always gives the same file.
+	std::vector<size_t> pure(std::begin(program.pure_addresses), std::end(program.pure_addresses));
+	std::sort(std::begin(pure), std::end(pure));
+	for (auto x : pure) w.u64(x);
+	for (auto x : program.function_constants) w.u64(x);
+	w.raw(table.bytes.data(), table.bytes.size());
+	w.align();
+	for (auto& x : table.checkpoints) {
+		w.u64(x.ip);
+		w.u64(x.byte);
+		w.u64(x.loc.line);
+		w.u64(x.loc.offset);
+		w.u64(x.loc.length);
+	}
+
+	if (!write_whole_file(path, w.bytes.data(), w.bytes.size())) {
+		println("Couldn't write %s.", path);
+		return false;
+	}
+	return true;
+}
+
+static bool is_relative_jump(IS::Instruction::Kind kind) noexcept {
+	switch (kind) {
+	case IS::Instruction::Jmp_Rel_Kind:
+	case IS::Instruction::If_Jmp_Rel_Kind:
+	case IS::Instruction::If_Not_Jmp_Rel_Kind:
+	#define X(k) case IS::Instruction::Jmp_Unless_##k##_Kind:
+	IS_COMPARISON_LIST(X)
+	#undef X
+		return true;
+	default:
+		return false;
+	}
+}
+
+// What the instructions point to has to be in the program, the VM doesn't check it.
+static const char* validate(const Program& program) noexcept {
+	#define X(x) + 1
+	constexpr size_t n_opcodes = 1 IS_LIST(X);
+	#undef X
+
+	size_t n = program.bytecode.size();
+	if (!n) return "No code.";
+
+	for (size_t ip = 0; ip < n; ++ip) {
+		auto word = program.bytecode[ip];
+		auto kind = (IS::Instruction::Kind)IS::opcode(word);
+		if (kind >= n_opcodes) return "Unknown opcode.";
+
+		IS::Operands arg;
+		arg.a = IS::operand_a(word);
+		arg.b = IS::operand_b(word);
+		if (arg.a == IS::Wide) {
+			if (arg.b >= program.wide.size()) return "Wide operands out of bounds.";
+			arg = program.wide[arg.b];
+		}
+
+		if (is_relative_jump(kind)) {
+			auto target = (std::int64_t)ip + (std::int32_t)arg.b;
+			if (target < 0 || target > (std::int64_t)n) return "Jump out of the code.";
+		}
+		if (kind == IS::Instruction::Call_Kind || kind == IS::Instruction::Tail_Call_Kind) {
+			if (arg.b >= n) return "Call out of the code.";
+		}
+		if (kind == IS::Instruction::Constant_Kind) {
+			if (arg.b > program.data.size() || arg.a > program.data.size() - arg.b)
+				return "Constant out of the data.";
+		}
+	}
+
+	for (auto x : program.pure_addresses) if (x >= n) return "Proc out of the code.";
+	for (auto cst : program.function_constants) {
+		if (cst > program.data.size() || program.data.size() - cst < sizeof(std::uint64_t))
+			return "Proc constant out of the data.";
+
+		std::uint64_t address;
+		memcpy(&address, program.data.data() + cst, sizeof(address));
+		if (address >= n) return "Proc out of the code.";
+	}
+
+	// A varint can't go past the end when the last byte ends one.
+	auto& table = program.line_table;
+	if (!table.bytes.empty() && (table.bytes.back() & 0x80)) return "Truncated line table.";
+	if (table.checkpoints.empty() != table.bytes.empty()) return "Bad line table.";
+	for (size_t i = 0; i < table.checkpoints.size(); ++i) {
+		auto& x = table.checkpoints[i];
+		if (x.byte > table.bytes.size()) return "Bad line table.";
+		if (i ? x.ip <= table.checkpoints[i - 1].ip : x.ip || x.byte) return "Bad line table.";
+	}
+
+	return nullptr;
+}
+
+extern bool load_program(Program& program, const char* path) noexcept {
+	Mapped_File file;
+	if (!file.open(path)) {
+		println("Couldn't map %s.", path);
+		return false;
+	}
+
+	auto fail = [&] (const char* what) {
+		println("%s: %s", path, what);
+		program.ok = false;
+		return false;
+	};
+
+	Winc_Reader r;
+	r.begin = r.it = file.data;
+	r.end = file.data + file.size;
+
+	auto* magic = r.raw(sizeof(Magic));
+	if (!magic || memcmp(magic, Magic, sizeof(Magic)) != 0) return fail("Not a .winc file.");
+	if (r.u32() != Version) return fail("Unsupported version.");
+	if (r.u32() != sizeof(IS::Real)) return fail("Compiled with another size of real.");
+	auto flags = r.u32();
+	if (((flags & Little_Endian_Data) != 0) != host_little_endian())
+		return fail("Compiled on a machine of the other endianness.");
+	if (r.u64() != instruction_set()) return fail("Compiled with other instructions.");
+
+	auto n_data      = r.u64();
+	auto n_words     = r.u64();
+	auto n_wide      = r.u64();
+	auto n_pure      = r.u64();
+	auto n_constants = r.u64();
+	auto n_lines     = r.u64();
+	auto n_points    = r.u64();
+	if (!r.ok) return fail("Truncated header.");
+
+	program = Program();
+
+	if (!r.fits(n_data, 1)) return fail("Truncated data.");
+	auto* data = r.raw(n_data);
+	program.data.assign(data, data + n_data);
+	r.align();
+
+	if (!r.fits(n_words, 8)) return fail("Truncated code.");
+	program.bytecode.resize(n_words);
+	for (auto& x : program.bytecode) x = r.u64();
+
+	if (!r.fits(n_wide, 24)) return fail("Truncated operands.");
+	program.wide.resize(n_wide);
+	for (auto& x : program.wide) {
+		x.a = r.u64();
+		x.b = r.u64();
+		x.c = r.u64();
+	}
+
+	if (!r.fits(n_pure, 8)) return fail("Truncated procs.");
+	for (size_t i = 0; i < n_pure; ++i) program.pure_addresses.insert(r.u64());
+	if (!r.fits(n_constants, 8)) return fail("Truncated procs.");
+	program.function_constants.resize(n_constants);
+	for (auto& x : program.function_constants) x = r.u64();
+
+	auto& table = program.line_table;
+	if (!r.fits(n_lines, 1)) return fail("Truncated line table.");
+	auto* lines = r.raw(n_lines);
+	table.bytes.assign(lines, lines + n_lines);
+	r.align();
+	if (!r.fits(n_points, 40)) return fail("Truncated line table.");
+	table.checkpoints.resize(n_points);
+	for (auto& x : table.checkpoints) {
+		x.ip         = r.u64();
+		x.byte       = r.u64();
+		x.loc.line   = r.u64();
+		x.loc.offset = r.u64();
+		x.loc.length = r.u64();
+	}
+	if (!r.ok) return fail("Truncated file.");
+
+	if (auto error = validate(program)) return fail(error);
+	return true;
+}